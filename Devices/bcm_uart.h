@@ -44,3 +44,23 @@ enum { UART_Busy = 1 << 3,
        UART_TxEmpty = 1 << 7
      };
 
+// Interrupt bits, in interrupt_mask (1 = enabled), the status registers
+// and interrupt_clear
+enum { UART_RxInterrupt = 1 << 4,
+       UART_TxInterrupt = 1 << 5,
+       UART_RxTimeoutInterrupt = 1 << 6,
+       UART_OverrunInterrupt = 1 << 10
+     };
+
+// interrupt_fifo_level_select, interrupt when the FIFO is filled (Rx), or
+// emptied (Tx), past the level
+enum { UART_FIFO_1_8 = 0,
+       UART_FIFO_1_4 = 1,
+       UART_FIFO_1_2 = 2,
+       UART_FIFO_3_4 = 3,
+       UART_FIFO_7_8 = 4
+     };
+
+#define UART_TxLevel( l ) (l)
+#define UART_RxLevel( l ) ((l) << 3)
+
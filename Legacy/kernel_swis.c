@@ -476,6 +476,12 @@ OSTask *do_OS_ServiceCall( svc_registers *regs )
   return 0;
 }
 
+// For any subsystem caching information from system variables
+__attribute__(( weak ))
+void system_variable_changed()
+{
+}
+
 OSTask *do_OS_PlatformFeatures( svc_registers *regs )
 {
   switch (regs->r[0]) {
@@ -641,26 +647,41 @@ bool handler_available( uint32_t swi )
   return false;
 }
 
-static inline
-bool needs_legacy_stack( uint32_t swi )
-{
-  int32_t legacy[] = {
-    0b11111111111111111111111111111111,         // 0-31 (0 on left!)
-    0b11111111111111111111111111111111,         // 32-63
-    0b11111111111111111111111111111111,         // 64-95
-    0b11111111111111111111111111111111,         // 96-127
+// Kernel SWIs that may be run by any number of tasks at once, on their
+// own cores, are implemented in C in run_the_swi and only use per-task
+// state, constants, or words in zero page that are written atomically.
+// Everything else in 0-255 is legacy code, which uses shared workspace,
+// calls vectors, or translates errors (calling MessageTrans), and needs
+// exclusive use of the legacy stack. So do C implementations that call
+// a legacy SWI, like OS_WriteEnv (OS_Heap).
+//   OS_GetEnv, OS_BinaryToDecimal, OS_ReadEscapeState,
+//   OS_SWINumberFromString, OS_ReadMonotonicTime, OS_ReadMemMapInfo,
+//   OS_PlatformFeatures, OS_SynchroniseCodeAreas,
+//   and the conversion SWIs (0xd0-0xe7).
+//   OS_WriteI+ (0x100-0x1ff) are all OS_WriteC.
+static uint32_t const legacy_swis[16] = {
+    0b11111111111111110111111111111111,         // 0-31 (0 on left!)
+    0b11111111011101111111111110111111,         // 32-63
+    0b11011111111111111011111111111111,         // 64-95
+    0b11111111111110011111111111111111,         // 96-127
     0b11111111111111111111111111111111,         // 128-159
     0b11111111111111111111111111111111,         // 160-191
     0b11111111111111110000000000000000,         // 192-223
-    0b00000000111111111111111111111111 };       // 224-255
+    0b00000000111111111111111111111111,         // 224-255
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff };
 
-  switch (swi) {
-  case 0x000 ... 0x0ff:
+// Called for every SWI, so a single lookup for each class: the kernel
+// SWIs above, OSTask SWIs, or module SWIs (see handler_available).
+static inline
+bool needs_legacy_stack( uint32_t swi )
+{
+  if (swi < 0x200) {
     // Shift the n-th from left bit to the top of the word
-    return ((legacy[swi / 32]) << (swi % 32)) < 0;
-  case 0x100 ... 0x1ff:
-    return true; // OS_WriteI+
-  case OSTask_Yield ... OSTask_Yield + 63:
+    return (int32_t) (legacy_swis[swi / 32] << (swi % 32)) < 0;
+  }
+
+  if (swi - OSTask_Yield < 64) {
     return false;
   }
 
@@ -864,6 +885,40 @@ struct legacy_stack_frame {
   void *blocked_sp;
 };
 
+static
+void do_binary_to_decimal( svc_registers *regs )
+{
+  int32_t value = regs->r[0];
+  char *buffer = (void*) regs->r[1];
+  uint32_t size = regs->r[2];
+
+  // Without 64-bit division, and -2^31 can't be negated
+  uint32_t magnitude = (value < 0) ? -(uint32_t) value : value;
+
+  char digits[10];
+  uint32_t count = 0;
+  do {
+    digits[count++] = '0' + (magnitude % 10);
+    magnitude = magnitude / 10;
+  } while (magnitude != 0);
+
+  uint32_t length = count + ((value < 0) ? 1 : 0);
+
+  if (length > size) {
+    static error_block const error = { 0x1e4, "Buffer overflow" };
+    regs->r[0] = (uint32_t) &error;
+    regs->spsr |= VF;
+    return;
+  }
+
+  if (value < 0) *buffer++ = '-';
+  while (count > 0) {
+    *buffer++ = digits[--count];
+  }
+
+  regs->r[2] = length;
+}
+
 //static
 OSTask *run_the_swi( svc_registers *regs, uint32_t number )
 {
@@ -910,9 +965,10 @@ OSTask *run_the_swi( svc_registers *regs, uint32_t number )
           running->banked_lr_usr = (uint32_t) unexpected_task_return;
 
           running->saved = run_the_swi;
+          pmu_task_stopped( running );
 
           OSTask *owner = shared.legacy.owner;
-          mpsafe_insert_OSTask_at_tail( &shared.ostask.runnable, owner );
+          make_runnable( owner );
 
           // Passing running to ensure banked registers set
           return_to_swi_caller( running, &running->regs, std_top );
@@ -981,6 +1037,22 @@ OSTask *run_the_swi( svc_registers *regs, uint32_t number )
     break;
 
   case OS_SynchroniseCodeAreas: break;
+
+  case OS_ReadMonotonicTime:
+    {
+      regs->r[0] = legacy_zero_page.MetroGnome;
+    }
+    break;
+  case OS_ReadEscapeState:
+    {
+      if (0 != (legacy_zero_page.ESC_Status & 0x40))
+        regs->spsr |= CF;
+      else
+        regs->spsr &= ~CF;
+    }
+    break;
+  case OS_BinaryToDecimal: do_binary_to_decimal( regs ); break;
+
   case OS_SWINumberFromString:
     {
       // TODO in Modules
@@ -1098,6 +1170,8 @@ OSTask *run_the_swi( svc_registers *regs, uint32_t number )
         uint32_t entry = JTABLE[swi];
         run_riscos_code_implementing_swi( regs, swi, entry );
 
+        if (swi == OS_SetVarVal) system_variable_changed();
+
 #ifdef DEBUG__CHECK_CALLBACKS
         if (swi == OS_AddCallBack) {
           if (0 == legacy_zero_page.CallBack_Vector) PANIC;
@@ -1424,7 +1498,7 @@ void execute_swi( svc_registers *regs, int number )
       // A legacy SWI task has been blocked, listen for legacy SWIs again.
       // (Also listening for tasks becoming active again.)
       OSTask *owner = shared.legacy.owner;
-      mpsafe_insert_OSTask_at_tail( &shared.ostask.runnable, owner );
+      make_runnable( owner );
     }
   }
   else {
@@ -1535,14 +1609,14 @@ Task_LogNewLine();
       // It's been resumed
       OSTask *caller = shared.legacy.frame->caller;
       assert( !caller->running );
-      mpsafe_insert_OSTask_at_tail( &shared.ostask.runnable, caller );
+      make_runnable( caller );
     }
     else {
       // We can accept a new task calling a legacy SWI (or the current
       // stack owner being resumed, if there is one).
       OSTask *owner = shared.legacy.owner;
       assert( !owner->running );
-      mpsafe_insert_OSTask_at_tail( &shared.ostask.runnable, owner );
+      make_runnable( owner );
     }
 
     // Carry on the legacy task
@@ -1760,13 +1834,19 @@ void __attribute__(( noreturn )) startup()
   uint32_t handle = Task_SpawnTask1( serve_legacy_swis, 0, queue );
   assert( shared.legacy.owner == 0 );
 
+  boot_trace( "setup_legacy_svc_stack", 0 );
   setup_legacy_svc_stack();
+  boot_trace( "setup_legacy_zero_page", 0 );
   setup_legacy_zero_page();
 
+  boot_trace( "setup_system_heap", 0 );
   setup_system_heap(); // System heap
+  boot_trace( "setup_shared_heap", 0 );
   setup_shared_heap(); // RMA heap
+  boot_trace( "setup_MOS_workspace", 0 );
   setup_MOS_workspace(); // Hopefully soon to be removed
 
+  boot_trace( "RamFSDA", 0 );
   RamFSDA();
 
   uint32_t const tick_stack_size = 256; // regs, buffer & a bit more
@@ -1774,8 +1854,10 @@ void __attribute__(( noreturn )) startup()
   uint32_t cs = Task_CreateTask0( centiseconds, tick_stack_size + base );
   assert( cs != 0 );
 
+  boot_trace( "fill_legacy_zero_page", 0 );
   fill_legacy_zero_page();
 
+  boot_trace( "make_desktop_workspace", 0 );
   make_desktop_workspace();
   make_sprite_extend_workspace(); // FIXME!! IDK why this is here!
 
@@ -1810,6 +1892,8 @@ void __attribute__(( noreturn )) startup()
   Task_LogString( modcflags, 0 );
   Task_LogNewLine();
 
+  boot_trace( "RMRun", "HAL" );
+
   // RMRun HAL
   register uint32_t run asm ( "r0" ) = 0; // RMRun
   register char const *module asm ( "r1" ) = "System:Modules.HAL";
@@ -15,8 +15,9 @@
 
 #include "common.h"
 
-const unsigned module_flags = 1;
+const unsigned module_flags = 3;
 // Bit 0: 32-bit compatible
+// Bit 1: Initialisation may run alongside that of other modules
 
 #define MODULE_CHUNK "0x400"
 
@@ -141,7 +141,102 @@ static inline void Plot( uint32_t code, uint32_t x, uint32_t y )
     , "r" (ypos) );
 }
 
-void __attribute__(( noreturn )) boot( char const *cmd, workspace *ws )
+// INITIAL_MODULES provided by build script.
+// Must be a single string consiting of nul-terminated module
+// names, e.g. "QA7\0BCM_GPIO\0". (That final null is important,
+// it ensures the string is double-nul-terminated.)
+//
+// Each name may be followed by the modules it depends on, each preceded
+// by a |, e.g. "BCM2835Display|GPUMailbox\0". A module with no | is
+// initialised after the one before it in the list, one ending with a
+// single | depends on nothing. Modules whose dependencies have all been
+// initialised may be initialised at the same time, on different cores.
+// (| starts a comment in a RISC OS command line, so it can't be part of
+// a module's parameters.)
+//
+// Whether a module can actually be initialised alongside others is up
+// to the kernel (see bit 1 of the module flags); this only decides the
+// order.
+
+#define MAX_INITIAL_MODULES 128
+
+typedef enum { WAITING, STARTED, DONE } initial_state;
+
+typedef struct {
+  char const *entry;
+  initial_state state;
+} initial_module;
+
+typedef struct {
+  uint32_t lock;
+  uint32_t count;
+  uint32_t workers;
+  initial_module module[MAX_INITIAL_MODULES];
+} boot_state;
+
+static char const *dependencies( char const *entry )
+{
+  while (*entry != '\0' && *entry != '|') entry++;
+  return (*entry == '|') ? entry + 1 : 0;
+}
+
+// dep is terminated by | or nul, the name in entry by space, | or nul
+static bool provides( char const *entry, char const *dep )
+{
+  while (*entry == *dep && *entry > ' ' && *entry != '|') {
+    entry++;
+    dep++;
+  }
+  return (*dep == '|' || *dep == '\0')
+      && (*entry <= ' ' || *entry == '|');
+}
+
+static bool ready( boot_state *b, uint32_t i )
+{
+  char const *dep = dependencies( b->module[i].entry );
+
+  if (dep == 0) return i == 0 || b->module[i-1].state == DONE;
+
+  while (*dep != '\0') {
+    // A dependency that isn't in the list is ignored
+    for (int j = 0; j < b->count; j++) {
+      if (provides( b->module[j].entry, dep )
+       && b->module[j].state != DONE) return false;
+    }
+    while (*dep != '\0' && *dep != '|') dep++;
+    if (*dep == '|') dep++;
+  }
+
+  return true;
+}
+
+#define NONE_READY -1
+#define NONE_WAITING -2
+
+static int next_module( boot_state *b )
+{
+  int result = NONE_WAITING;
+
+  bool reclaimed = Task_LockClaim( &b->lock );
+  if (reclaimed) asm ( "udf 9" );
+
+  for (int i = 0; i < b->count; i++) {
+    if (b->module[i].state == WAITING) {
+      if (ready( b, i )) {
+        b->module[i].state = STARTED;
+        result = i;
+        break;
+      }
+      result = NONE_READY;
+    }
+  }
+
+  Task_LockRelease( &b->lock );
+
+  return result;
+}
+
+static void load_module( char const *entry )
 {
   static char const base[] = "System:Modules.";
   char command[128];
@@ -151,47 +246,151 @@ void __attribute__(( noreturn )) boot( char const *cmd, workspace *ws )
     *mod++ = *b++;
   }
 
-  // INITIAL_MODULES provided by build script.
-  // Must be a single string consiting of nul-terminated module
-  // names, e.g. "QA7\0BCM_GPIO\0". (That final null is important,
-  // it ensures the string is double-nul-terminated.)
-  char const *s = INITIAL_MODULES;
+  char const *s = entry;
+  char *p = mod;
+  while (*s >= ' ' && *s != '|') {
+    *p++ = *s++;
+  }
+  *p++ = '\n'; // Terminator
 
-  while (*s != '\0') {
-    char *p = mod;
-    do {
-      *p++ = *s++;
-    } while (*s >= ' ');
-    *p++ = '\n'; // Terminator
-    s++;
+  Task_LogString( command, p - command );
 
-    Task_LogString( command, p - command );
-    Task_Yield();
+  register uint32_t load asm ( "r0" ) = 1; // RMLoad
+  register char const *module asm ( "r1" ) = command;
+  register error_block *error asm ( "r0" );
+
+  asm ( "svc %[swi]"
+    "\n  movvc r0, #0"
+    : "=r" (error)
+    : [swi] "i" (OS_Module), "r" (load), "r" (module)
+    : "cc", "memory" );
+  // "memory" is required because the SWI accesses memory
+  // (the module name). Without it, the final *p = '\n'; may
+  // be delayed until after the SWI is called.
+
+  if (error != 0) {
+    asm ( "udf 7" );
+  }
+}
 
-    register uint32_t load asm ( "r0" ) = 1; // RMLoad
-    register char const *module asm ( "r1" ) = command;
-    register error_block *error asm ( "r0" );
-
-    asm ( "svc %[swi]"
-      "\n  movvc r0, #0"
-      : "=r" (error)
-      : [swi] "i" (OS_Module), "r" (load), "r" (module)
-      : "cc", "memory" );
-    // "memory" is required because the SWI accesses memory
-    // (the module name). Without it, the final *p = '\n'; may
-    // be delayed until after the SWI is called.
-
-    if (error != 0) {
-      asm ( "udf 7" );
+static void initialise_modules( boot_state *b )
+{
+  for (;;) {
+    int i = next_module( b );
+
+    if (i == NONE_WAITING) return;
+
+    if (i != NONE_READY) {
+      load_module( b->module[i].entry );
+
+      bool reclaimed = Task_LockClaim( &b->lock );
+      if (reclaimed) asm ( "udf 9" );
+      b->module[i].state = DONE;
+      Task_LockRelease( &b->lock );
     }
 
     // In case the initialisation kicked off some tasks, let them run!
     // Legacy modules might have set callbacks, they'll have been run
     // by the time we get here. (Modules are not permitted to call
     // Yield in their svc mode initialisation code.)
+    // Or, give the modules being initialised on other cores a chance
+    // to complete.
+
+    Task_Yield();
+  }
+}
+
+void __attribute__(( noreturn )) worker( uint32_t handle, uint32_t core,
+                                         boot_state *b )
+{
+  Task_SwitchToCore( core );
+
+  initialise_modules( b );
+
+  bool reclaimed = Task_LockClaim( &b->lock );
+  if (reclaimed) asm ( "udf 9" );
+  b->workers--;
+  Task_LockRelease( &b->lock );
+
+  Task_EndTask();
+
+  __builtin_unreachable();
+}
+
+#ifdef DEBUG__BOOT_TRACE
+// Writes the kernel's boot trace to the log, waiting for space in the
+// log pipe rather than losing lines. Modules are built with MODCFLAGS,
+// so DEBUG__BOOT_TRACE has to go there as well as to the kernel.
+void boot_trace_writer( uint32_t handle )
+{
+  char line[96];
+  uint32_t length;
+
+  for (uint32_t n = 0;
+       0 != (length = Task_BootTraceLine( n, line, sizeof( line ) ));
+       n++) {
+    Task_LogStringWait( line, length );
+  }
+
+  Task_EndTask();
+}
+#endif
 
-    // Task_Yield(); Moved to after the LogString and after the loop
+void __attribute__(( noreturn )) boot( char const *cmd, workspace *ws )
+{
+  boot_state *b = rma_claim( sizeof( boot_state ) );
+  b->lock = 0;
+  b->count = 0;
+  b->workers = 0;
+
+  bool parallel = false;
+
+  char const *s = INITIAL_MODULES;
+
+  while (*s != '\0') {
+    if (b->count == MAX_INITIAL_MODULES) asm ( "udf 10" );
+    b->module[b->count].entry = s;
+    b->module[b->count].state = WAITING;
+    if (dependencies( s ) != 0) parallel = true;
+    b->count++;
+    while (*s != '\0') s++;
+    s++;
+  }
+
+  if (parallel) {
+    // One worker on each of the other cores, this task is the first
+    core_info cores = Task_Cores();
+    uint32_t const stack_size = 512;
+
+    b->workers = cores.total - 1;
+
+    for (int i = 1; i < cores.total; i++) {
+      uint8_t *stack = rma_claim( stack_size );
+      Task_SpawnTask2( worker, aligned_stack( stack + stack_size ),
+                       i, (uint32_t) b );
+    }
+  }
+
+  initialise_modules( b );
+
+  while (b->workers != 0) {
+    Task_Yield();
+  }
+
+  // Service_PostInit: all the initial modules are initialised
+  register uint32_t code asm ( "r1" ) = 0x73;
+  asm volatile ( "svc %[swi]"
+    : "=r" (code)
+    : [swi] "i" (OS_ServiceCall | Xbit), "r" (code)
+    : "lr", "cc", "memory" );
+
+#ifdef DEBUG__BOOT_TRACE
+  {
+    uint32_t const stack_size = 512;
+    uint8_t *stack = rma_claim( stack_size );
+    Task_CreateTask0( boot_trace_writer, aligned_stack( stack + stack_size ) );
   }
+#endif
 
   Task_Yield();
 
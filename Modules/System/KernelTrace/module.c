@@ -0,0 +1,194 @@
+/* Copyright 2025 Simon Willcocks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Commands to control the kernel event trace (see OSTask_Trace):
+//   *KTraceOn [<mask>]  Start recording (all events, by default)
+//   *KTraceOff          Stop recording
+//   *KTraceDump         Log the records from every core
+// The dump is written to the log, one line per record, in hex:
+//   KTRACE hz <ticks per second>
+//   KTRACE <core> <sequence> <time> <event> <task> <a> <b>
+// Modules/System/KernelTrace/chrome_trace converts a captured log into
+// a Chrome trace (JSON) file, for chrome://tracing or ui.perfetto.dev.
+
+#include "CK_types.h"
+#include "ostaskops.h"
+
+#define MODULE_CHUNK "0"
+
+const unsigned module_flags = 3;
+// Bit 0: 32-bit compatible
+// Bit 1: Initialisation may run alongside that of other modules
+
+#include "module.h"
+
+NO_start;
+NO_init;
+NO_finalise;
+NO_service_call;
+//NO_title;
+//NO_help;
+//NO_keywords;
+NO_swi_handler;
+NO_swi_names;
+NO_swi_decoder;
+NO_messages_file;
+
+const char title[] = "KernelTrace";
+const char help[] = "KernelTrace\t0.01 (" CREATION_DATE ")";
+
+const char trace_on_help[] =
+  "*KTraceOn starts recording kernel events, optionally only those whose "
+  "bits are set in the (hex) mask.\rSyntax: *KTraceOn [<mask>]";
+const char trace_off_help[] =
+  "*KTraceOff stops recording kernel events.\rSyntax: *KTraceOff";
+const char trace_dump_help[] =
+  "*KTraceDump writes the recorded kernel events to the log.\r"
+  "Syntax: *KTraceDump";
+
+asm ( "keywords:"
+ "\n  .asciz \"KTraceOn\""
+ "\n  .align"
+ "\n  .word trace_on_command - header"
+ "\n  .word 0x00010000" // Up to one parameter
+ "\n  .word 0"
+ "\n  .word trace_on_help - header"
+ "\n  .asciz \"KTraceOff\""
+ "\n  .align"
+ "\n  .word trace_off_command - header"
+ "\n  .word 0x00000000" // No parameters
+ "\n  .word 0"
+ "\n  .word trace_off_help - header"
+ "\n  .asciz \"KTraceDump\""
+ "\n  .align"
+ "\n  .word trace_dump_command - header"
+ "\n  .word 0x00000000" // No parameters
+ "\n  .word 0"
+ "\n  .word trace_dump_help - header"
+ "\n  .word 0" );
+
+static char *hex( char *p, uint32_t n )
+{
+  *p++ = ' ';
+  for (int i = 28; i >= 0; i -= 4) {
+    uint32_t d = (n >> i) & 0xf;
+    *p++ = d < 10 ? '0' + d : 'a' + d - 10;
+  }
+  return p;
+}
+
+void c_trace_on_command( char const *tail )
+{
+  uint32_t mask = 0;
+
+  while (*tail == ' ') tail++;
+  if (*tail == '&') tail++;
+
+  if (*tail < ' ') {
+    mask = ~0;
+  }
+  else {
+    for (;;) {
+      char c = *tail++;
+      if (c >= '0' && c <= '9') mask = (mask << 4) | (c - '0');
+      else if (c >= 'a' && c <= 'f') mask = (mask << 4) | (c - 'a' + 10);
+      else if (c >= 'A' && c <= 'F') mask = (mask << 4) | (c - 'A' + 10);
+      else break;
+    }
+  }
+
+  Task_TraceMask( mask, 0 );
+}
+
+void c_trace_off_command()
+{
+  Task_TraceMask( 0, 0 );
+}
+
+void c_trace_dump_command()
+{
+  uint32_t ticks_per_second;
+
+  // Stop recording while the rings are read
+  uint32_t mask = Task_TraceMask( 0, &ticks_per_second );
+
+  Task_LogString( "KTRACE hz ", 10 );
+  Task_LogSmallNumber( ticks_per_second );
+  Task_LogNewLine();
+
+  core_info cores = Task_Cores();
+
+  for (int core = 0; core < cores.total; core++) {
+    trace_record records[16];
+    uint32_t sequence = 0;
+    uint32_t count;
+
+    while (0 != (count = Task_TraceRead( core, &sequence, records, 16 ))) {
+      for (int i = 0; i < count; i++) {
+        char line[7 + 2 + 7 * 9 + 1];
+        char *p = line;
+        for (char const *s = "KTRACE "; *s != '\0'; s++) *p++ = *s;
+        *p++ = '0' + core;
+        p = hex( p, sequence - count + i );
+        p = hex( p, records[i].time );
+        p = hex( p, records[i].event );
+        p = hex( p, records[i].task );
+        p = hex( p, records[i].a );
+        p = hex( p, records[i].b );
+        *p++ = '\n';
+
+        Task_LogStringWait( line, p - line );
+      }
+    }
+  }
+
+  Task_TraceMask( mask, 0 );
+}
+
+void __attribute__(( naked )) trace_on_command()
+{
+  asm ( "push { r12, lr }" );
+
+  // r0 -> command tail
+  register char const *tail asm ( "r0" );
+  asm ( "" : "=r" (tail) );
+  c_trace_on_command( tail );
+
+  // Clear V, no error
+  asm ( "cmp r0, r0"
+    "\n  pop { r12, pc }" );
+}
+
+void __attribute__(( naked )) trace_off_command()
+{
+  asm ( "push { r12, lr }" );
+
+  c_trace_off_command();
+
+  // Clear V, no error
+  asm ( "cmp r0, r0"
+    "\n  pop { r12, pc }" );
+}
+
+void __attribute__(( naked )) trace_dump_command()
+{
+  asm ( "push { r12, lr }" );
+
+  c_trace_dump_command();
+
+  // Clear V, no error
+  asm ( "cmp r0, r0"
+    "\n  pop { r12, pc }" );
+}
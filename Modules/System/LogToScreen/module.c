@@ -15,6 +15,7 @@
 
 #include "CK_types.h"
 #include "ostaskops.h"
+#include "log_record.h"
 #include "bcm_uart.h"
 
 
@@ -24,7 +25,7 @@ typedef struct workspace workspace;
 struct workspace {
   uint32_t lock;
   uint32_t output_pipe;
-  uint32_t stack[60];
+  uint32_t stack[60 + LOG_RECORD_LINE / 4];
 };
 
 #define MODULE_CHUNK "0"
@@ -63,7 +64,7 @@ typedef struct window {
   char display[24][60];
   uint8_t bottom_row;
   uint8_t index;
-  uint32_t stack[32];
+  uint32_t stack[32 + LOG_RECORD_LINE / 4];
 } window;
 
 uint32_t *const screen = (void*) 0xc0000000;
@@ -173,7 +174,15 @@ void core_debug_task( uint32_t handle, int core, window *w, uint32_t pipe )
   for (;;) {
     PipeSpace data = PipeOp_WaitForData( pipe, 1 );
     while (data.available != 0) {
-      add_to_display( w, data.location, data.available );
+      char const *p = data.location;
+      uint32_t left = data.available;
+      while (left != 0) {
+        char line[LOG_RECORD_LINE];
+        log_piece piece = log_next_piece( p, left, line, sizeof( line ) );
+        add_to_display( w, piece.text, piece.length );
+        p += piece.consumed;
+        left -= piece.consumed;
+      }
       data = PipeOp_DataConsumed( pipe, data.available );
     }
 
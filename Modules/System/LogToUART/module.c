@@ -15,25 +15,55 @@
 
 #include "CK_types.h"
 #include "ostaskops.h"
+#include "log_record.h"
 #include "bcm_uart.h"
 
 // Note for when the UART code is written; associated interrupt is 57
 
+// Each core's log pipe is read by a task on that core, which formats any
+// records and copies the text into a buffer of its own, with no locking.
+// Whichever of those tasks holds the drain lock sends the entries from
+// all the buffers to the UART, oldest first. A task that has added an
+// entry takes the lock if it is free; if not, the holder will find the
+// entry before it lets go. A task with a full buffer waits for the lock,
+// so nothing polls.
+// Entries are stamped from a shared counter as they are taken from the
+// log pipes, which orders them across cores.
 
 void send_to_uart( char const *string, uint32_t length );
 
+#define LOG_CORES 4
+#define LOG_BUFFER 4096         // Bytes per core, power of two
+#define LOG_ENTRY_MAX 512       // Longer text is split into entries
+#define LOG_WRAP 0xffffffff     // Entry length: continue at the start
+
+typedef struct {
+  uint32_t stamp;
+  uint32_t length;              // Of the text that follows, or LOG_WRAP
+} log_entry;
+
+typedef struct {
+  uint32_t volatile written;    // Only changed by the core's task
+  uint32_t volatile read;       // Only changed by the drain task
+  uint8_t buffer[LOG_BUFFER];
+} core_log;
+
 typedef struct workspace workspace;
 
 struct workspace {
-  uint32_t lock;
-  uint32_t output_pipe;
+  uint32_t stamp;               // The next one
+  uint32_t lock;                // Task lock, held while draining
+  int last_core;                // Only changed with the lock held
+  uint32_t cores;
+  core_log core[LOG_CORES];
   uint32_t stack[60];
 };
 
 #define MODULE_CHUNK "0"
 
-const unsigned module_flags = 1;
+const unsigned module_flags = 3;
 // Bit 0: 32-bit compatible
+// Bit 1: Initialisation may run alongside that of other modules
 
 #include "module.h"
 
@@ -59,81 +89,102 @@ static inline void push_writes_to_device()
   asm ( "dsb" );
 }
 
-void transfer_to_output( uint32_t me, PipeSpace data, workspace *ws, int core )
+// Entries are eight byte aligned, so there is always room for a wrap
+// entry at the end of the buffer.
+static inline uint32_t entry_size( uint32_t length )
 {
-  assert( data.available != 0 );
-
-  bool reclaimed = Task_LockClaim( &ws->lock );
-
-  if (!reclaimed) {
-    // You might think SetSender would be necessary, but as long as you're
-    // sure the owner is currently 0, the first wait call will set the
-    // current task as the sender (or receiver on WaitForData).
-    // PipeOp_SetSender( ws->output_pipe, me );
-
-    // Colour by core number \033[01;32m
-    // High number cores are going to look odd, but the first 16 should be
-    // distinguishable
-
-    char colour[8];
-    colour[0] = '\033';
-    colour[1] = '[';
-    colour[2] = '0' + ((core >> 6) & 7);
-    colour[3] = '0' + ((core >> 3) & 7);
-    colour[4] = ';';
-    colour[5] = '3';
-    colour[6] = '7' - (core & 7);
-    colour[7] = 'm';
-    PipeSpace data = { .location = colour, .available = sizeof( colour ) };
-
-    transfer_to_output( me, data, ws, core );
-  }
+  return sizeof( log_entry ) + ((length + 7) & ~7);
+}
+
+static uint32_t next_stamp( workspace *ws )
+{
+  uint32_t failed;
+  uint32_t stamp;
 
-  uint32_t i = 0;
-
-  uint32_t output_pipe = ws->output_pipe;
-
-/* confused things...
-char num[9];
-num[0] = '0' + 0xf & (data.available >> 28);
-num[1] = '0' + 0xf & (data.available >> 24);
-num[2] = '0' + 0xf & (data.available >> 20);
-num[3] = '0' + 0xf & (data.available >> 16);
-num[4] = '0' + 0xf & (data.available >> 12);
-num[5] = '0' + 0xf & (data.available >> 8);
-num[6] = '0' + 0xf & (data.available >> 4);
-num[7] = '0' + 0xf & (data.available >> 0);
-num[8] = '\n';
-send_to_uart( num, 9 );
-*/
-
-  char const *s = data.location;
   do {
-    PipeSpace space = PipeOp_WaitForSpace( output_pipe, data.available );
-    // We might get less space available than data.available if the output
-    // pipe is too small. We can work with that, but this task may block...
+    asm volatile ( "ldrex %[stamp], [%[word]]"
+                   : [stamp] "=&r" (stamp)
+                   : [word] "r" (&ws->stamp) );
 
-if (space.available < data.available) asm ( "bkpt 888" );
+    asm volatile ( "strex %[failed], %[next], [%[word]]"
+                   : [failed] "=&r" (failed)
+                   : [word] "r" (&ws->stamp)
+                   , [next] "r" (stamp + 1) );
+  } while (failed);
 
-    while (space.available != 0 && i < data.available) {
-      char *d = space.location;
-      int n = 0; // Offset from start of space
-      while (n < space.available && i < data.available) {
-        d[n++] = s[i++];
-      }
-      space = PipeOp_SpaceFilled( output_pipe, n );
+  return stamp;
+}
+
+// Task_LockClaim without the wait; true if the lock was free
+static bool claim_if_free( uint32_t *lock, uint32_t handle )
+{
+  uint32_t failed;
+  uint32_t value;
+
+  do {
+    asm volatile ( "ldrex %[value], [%[word]]"
+                   : [value] "=&r" (value)
+                   : [word] "r" (lock) );
+
+    if (value != 0) {
+      asm ( "clrex" );
+      return false;
     }
-  } while (i < data.available);
 
-  if (!reclaimed) {
-    PipeOp_SetSender( output_pipe, 0 );
-    // The next owner of the lock can be sure the sender is unset.
-    Task_LockRelease( &ws->lock );
+    asm volatile ( "strex %[failed], %[handle], [%[word]]"
+                   : [failed] "=&r" (failed)
+                   : [word] "r" (lock)
+                   , [handle] "r" (handle) );
+  } while (failed);
+
+  memory_read_barrier(); // Lock before the buffers
+
+  return true;
+}
+
+static void drain( workspace *ws, uint32_t handle );
+
+// Called only by the core's task
+static void add_to_buffer( workspace *ws, uint32_t handle, core_log *log,
+                           uint32_t stamp,
+                           char const *text, uint32_t length )
+{
+  while (length != 0) {
+    uint32_t n = (length > LOG_ENTRY_MAX) ? LOG_ENTRY_MAX : length;
+    uint32_t size = entry_size( n );
+    uint32_t offset = log->written & (LOG_BUFFER - 1);
+    uint32_t skip = (offset + size > LOG_BUFFER) ? LOG_BUFFER - offset : 0;
+
+    // Never drops anything; the pipe from the kernel will fill up, instead
+    // The lock holder drains this buffer too, before letting go.
+    while (LOG_BUFFER - (log->written - log->read) < skip + size) {
+      Task_LockClaim( &ws->lock );
+      drain( ws, handle );
+    }
+
+    if (skip != 0) {
+      log_entry *wrap = (void*) &log->buffer[offset];
+      wrap->length = LOG_WRAP;
+      offset = 0;
+    }
+
+    log_entry *entry = (void*) &log->buffer[offset];
+    entry->stamp = stamp;
+    entry->length = n;
+    memcpy( entry + 1, (void*) text, n );
+
+    memory_write_barrier(); // Entry before the index
+    log->written += skip + size;
+
+    text += n;
+    length -= n;
   }
 }
 
 void core_debug_task( uint32_t handle, int core, workspace *ws, uint32_t pipe )
 {
+  core_log *log = &ws->core[core];
+
   Task_LogString( "Waiting for log ", 16 );
 
   Task_LogHex( pipe );
@@ -141,9 +192,106 @@ void core_debug_task( uint32_t handle, int core, workspace *ws, uint32_t pipe )
   for (;;) {
     PipeSpace data = PipeOp_WaitForData( pipe, 1 );
     while (data.available != 0) {
-      transfer_to_output( handle, data, ws, core );
-if ((ws->lock & ~1) == handle) asm ( "bkpt 999" );
+      uint32_t stamp = next_stamp( ws );
+
+      char const *p = data.location;
+      uint32_t left = data.available;
+      while (left != 0) {
+        char line[LOG_RECORD_LINE];
+        log_piece piece = log_next_piece( p, left, line, sizeof( line ) );
+        add_to_buffer( ws, handle, log, stamp, piece.text, piece.length );
+        p += piece.consumed;
+        left -= piece.consumed;
+      }
+
       data = PipeOp_DataConsumed( pipe, data.available );
+
+      memory_write_barrier(); // Entries before looking at the lock
+      if (claim_if_free( &ws->lock, handle )) drain( ws, handle );
+    }
+  }
+}
+
+// The core's oldest entry, or 0
+static log_entry *first_entry( core_log *log )
+{
+  for (;;) {
+    uint32_t read = log->read;
+    if (read == log->written) return 0;
+
+    memory_read_barrier(); // Index before the entry
+
+    log_entry *entry = (void*) &log->buffer[read & (LOG_BUFFER - 1)];
+    if (entry->length != LOG_WRAP) return entry;
+
+    log->read = (read + LOG_BUFFER) & ~(LOG_BUFFER - 1);
+  }
+}
+
+static bool entries_waiting( workspace *ws )
+{
+  for (int i = 0; i < ws->cores; i++) {
+    if (ws->core[i].read != ws->core[i].written) return true;
+  }
+  return false;
+}
+
+// Called with the lock held, returns having released it.
+static void drain( workspace *ws, uint32_t handle )
+{
+  for (;;) {
+    int core = -1;
+    log_entry *oldest = 0;
+
+    for (int i = 0; i < ws->cores; i++) {
+      log_entry *entry = first_entry( &ws->core[i] );
+      if (entry != 0
+       && (oldest == 0 || (int32_t) (entry->stamp - oldest->stamp) < 0)) {
+        oldest = entry;
+        core = i;
+      }
+    }
+
+    if (oldest == 0) {
+      Task_LockRelease( &ws->lock );
+
+      // A task that added an entry after the search, and found the lock
+      // still held, left it for this one.
+      memory_write_barrier();
+      if (!entries_waiting( ws ) || !claim_if_free( &ws->lock, handle ))
+        return;
+
+      continue;
+    }
+
+    if (core != ws->last_core) {
+      // Colour by core number \033[01;32m
+      // High number cores are going to look odd, but the first 16 should
+      // be distinguishable
+      char colour[8];
+      colour[0] = '\033';
+      colour[1] = '[';
+      colour[2] = '0' + ((core >> 6) & 7);
+      colour[3] = '0' + ((core >> 3) & 7);
+      colour[4] = ';';
+      colour[5] = '3';
+      colour[6] = '7' - (core & 7);
+      colour[7] = 'm';
+      send_to_uart( colour, sizeof( colour ) );
+      ws->last_core = core;
+    }
+
+    send_to_uart( (char const *) (oldest + 1), oldest->length );
+
+    core_log *log = &ws->core[core];
+    memory_write_barrier(); // Finished with the entry before releasing it
+    log->read += entry_size( oldest->length );
+
+    if (tasks_waiting_for( &ws->lock )) {
+      // Another core's task is waiting for space; hand the lock over (it
+      // will carry on draining), and get back to this core's pipe.
+      Task_LockRelease( &ws->lock );
+      return;
     }
   }
 }
@@ -165,9 +313,11 @@ void send_to_uart( char const *string, uint32_t length )
   return;
 #else
   for (int i = 0; i < length; i++) {
-    // FIXME Yielding or sleeping breaks something!
-    while (0 != (uart->flags & UART_TxFull)) { for (int i = 0; i < 10000; i++) asm ( "" : : "r"(i) ); }
-     // 
+    // Only the drain lock holder sends, and the tasks waiting for the
+    // lock are waiting for the UART anyway, so it can sleep while the
+    // FIFO empties. (The FIFO holds about 1.4ms of data at 115200 baud.)
+    while (0 != (uart->flags & UART_TxFull)) { Task_Sleep( 1 ); }
+
     uart->data = string[i];
     ensure_changes_observable();
   }
@@ -268,19 +418,16 @@ void start_log( uint32_t handle, workspace *ws )
 //  UART volatile * const uart = (void*) 0xfffff000;
   while (UART_TxEmpty != (uart->flags & (UART_Busy | UART_TxEmpty))) { for (int i = 0; i < 1000; i++) asm ( "" ); }
 
-  ws->output_pipe = PipeOp_CreateForTransfer( 4096 );
-
-  // Before creating any of the tasks that might want to use it...
-  PipeOp_SetSender( ws->output_pipe, 0 );
-
   // Note: This loop ends up with this routine running on the last core
   // every time, perhaps it would be better to start with the current
   // core and wrap around to zero, ending up back on the core we started
   // on?
   core_info cores = Task_Cores();
 
-  for (int i = 0; i < cores.total; i++) {
-    uint32_t const stack_size = 256;
+  ws->cores = (cores.total < LOG_CORES) ? cores.total : LOG_CORES;
+
+  for (int i = 0; i < ws->cores; i++) {
+    uint32_t const stack_size = 256 + LOG_RECORD_LINE;
     uint8_t *stack = rma_claim( stack_size );
 
     // Note: The above rma_claim may (probably will) result in the core
@@ -345,20 +492,8 @@ void start_log( uint32_t handle, workspace *ws )
       : "lr", "cc" );
   }
 
-  uint32_t output_pipe = ws->output_pipe;
-  for (;;) {
-    PipeSpace data = PipeOp_WaitForData( output_pipe, 1 );
-
-    while (data.available != 0) {
-      char *string = data.location;
-      send_to_uart( string, data.available );
-      if (string[0] == 'p' && string[1] == 'g') asm ( "bkpt 1" );
-      if (string[1] == 'p' && string[2] == 'g') asm ( "bkpt 1" );
-      if (string[2] == 'p' && string[3] == 'g') asm ( "bkpt 1" );
-      if (string[3] == 'p' && string[4] == 'g') asm ( "bkpt 1" );
-      data = PipeOp_DataConsumed( output_pipe, data.available );
-    }
-  }
+  // The core tasks drain the buffers between them
+  Task_EndTask();
 }
 
 void __attribute__(( noinline )) c_init( workspace **private,
@@ -367,8 +502,8 @@ void __attribute__(( noinline )) c_init( workspace **private,
 {
   workspace *ws = rma_claim( sizeof( workspace ) );
   *private = ws;
-  ws->lock = 0;
-  ws->output_pipe = 0;
+  memset( ws, 0, sizeof( workspace ) - sizeof( ws->stack ) );
+  ws->last_core = -1;
 
   register void *start asm( "r0" ) = start_log;
   register uint32_t sp asm( "r1" ) = aligned_stack( ws + 1 );
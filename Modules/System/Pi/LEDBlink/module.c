@@ -23,8 +23,9 @@ typedef struct workspace workspace;
 
 #define MODULE_CHUNK "0x1040"
 
-const unsigned module_flags = 1;
+const unsigned module_flags = 3;
 // Bit 0: 32-bit compatible
+// Bit 1: Initialisation may run alongside that of other modules
 
 #include "module.h"
 
@@ -162,12 +162,8 @@ typedef struct {
 
 void RectCopy( copy_parms *const copy )
 {
-  Task_LogString( "Source left edge ", 0 ); Task_LogSmallNumber( copy->sl ); Task_LogNewLine();
-  Task_LogString( "Source bottom edge ", 0 ); Task_LogSmallNumber( copy->sb ); Task_LogNewLine();
-  Task_LogString( "Dest left edge ", 0 ); Task_LogSmallNumber( copy->dl ); Task_LogNewLine();
-  Task_LogString( "Dest bottom edge ", 0 ); Task_LogSmallNumber( copy->db ); Task_LogNewLine();
-  Task_LogString( "Width-1 ", 0 ); Task_LogSmallNumber( copy->w ); Task_LogNewLine();
-  Task_LogString( "Height-1 ", 0 ); Task_LogSmallNumber( copy->h ); Task_LogNewLine();
+  Task_LogF( "RectCopy source %d,%d dest %d,%d width-1 %d height-1 %d\n",
+             copy->sl, copy->sb, copy->dl, copy->db, copy->w, copy->h );
   // TODO Hardware acceleration, or at least efficient implementation!
   if (copy->sb < copy->db) {
     // Go top to bottom, in case of overlap
@@ -230,13 +226,11 @@ void RectFill( fill_parms *const fill )
 {
   ECF const *ecf = fill->ecf;
 
-  char const text[] = " ECF\n";
-  Task_LogString( text, sizeof( text )-1 );
+  Task_LogF( "RectFill %d,%d - %d,%d ECF\n",
+             fill->left, fill->bottom, fill->right, fill->top );
 
   for (int i = 0; i < 8; i++) {
-    Task_LogHex( ecf->line[i].or_mask );
-    Task_LogHex( ecf->line[i].eor_mask );
-    Task_LogNewLine();
+    Task_LogF( "%x%x\n", ecf->line[i].or_mask, ecf->line[i].eor_mask );
   }
 
   if (ecf->line[0].or_mask == 0xffffffff) {
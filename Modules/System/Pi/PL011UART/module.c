@@ -17,19 +17,43 @@
 #include "ostaskops.h"
 #include "bcm_uart.h"
 
-// Note for when the UART code is written; associated interrupt is 57
+// Interrupt driven PL011 UART driver, for Raspberry Pi 2 - 3
+//
+// SWI 0x10c0 PL011UART_Pipes
+//   OUT: r0 = pipe to the UART, r1 = pipe from the UART
+//        (both 0 until the driver is ready)
+//
+// Transmitting: the transmit task moves data from the output pipe into
+// the TX FIFO until the FIFO is full, then waits for the FIFO level
+// interrupt. Senders are held up by the pipe when it is full, nothing
+// spins.
+// Receiving: the interrupt task empties the RX FIFO into the input pipe
+// on the level and timeout interrupts. There's no flow control on the
+// line, so if the pipe is full, received bytes are dropped (and counted).
+// Only one task can wait for an interrupt, so the interrupt task passes
+// transmit interrupts on to the transmit task, through a pipe.
+//
+// UART interrupt: GPU IRQ 57, via the QA7 module.
+
+#define UART_IRQ 57
 
 typedef struct workspace workspace;
 
 struct workspace {
   uint32_t output_pipe;
+  uint32_t input_pipe;
+  uint32_t tx_ready;            // Interrupt task to transmit task
+  uint32_t dropped;             // Received with nowhere to go
+  uint32_t overruns;            // Received too late, by the hardware
+  uint32_t irq_stack[64];
   uint32_t stack[60];
 };
 
-#define MODULE_CHUNK "0"
+#define MODULE_CHUNK "0x10c0"
 
-const unsigned module_flags = 1;
+const unsigned module_flags = 3;
 // Bit 0: 32-bit compatible
+// Bit 1: Initialisation may run alongside that of other modules
 
 #include "module.h"
 
@@ -46,44 +70,95 @@ NO_swi_decoder;
 NO_messages_file;
 
 const char title[] = "PL011UART";
-const char help[] = "PL011UART\t0.01 (" CREATION_DATE ")";
+const char help[] = "PL011UART\t0.02 (" CREATION_DATE ")";
 
 // TEMPORARY GPIO stuff is at 0x2000
 UART volatile *const uart  = (void*) 0x1000;
 
-// Hopefully no stack at all...
-__attribute__(( optimize( "O4" ), naked, noreturn ))
-void send_to_uart( uint32_t handle, uint32_t pipe )
+static uint32_t const rx_interrupts = UART_RxInterrupt
+                                    | UART_RxTimeoutInterrupt
+                                    | UART_OverrunInterrupt;
+
+// SWI 0x10c0
+void pipes( svc_registers *regs, void *private, int core, uint32_t task )
+{
+  workspace *ws = private;
+  regs->r[0] = ws->output_pipe;
+  regs->r[1] = ws->input_pipe;
+}
+
+static void receive( workspace *ws )
+{
+  PipeSpace space = PipeOp_WaitForSpace( ws->input_pipe, 0 );
+  char *dest = space.location;
+  uint32_t n = 0;
+
+  while (0 == (uart->flags & UART_RxEmpty)) {
+    char c = uart->data;
+    if (n < space.available)
+      dest[n++] = c;
+    else
+      ws->dropped++;
+  }
+
+  if (n != 0) PipeOp_SpaceFilled( ws->input_pipe, n );
+}
+
+void interrupt_task( uint32_t handle, workspace *ws )
 {
+  register uint32_t num asm ( "r0" ) = UART_IRQ;
+  asm ( "svc 0x1000" : : "r" (num) );
+
   Task_EnablingInterrupts();
-  qa7->Core_Mailboxes_Interrupt_control[core] = 1;
-  int count = 0;
 
   for (;;) {
-    if ((count++ & 0xfff) == 0) *(uint32_t*) 0xfffff000 = '0' + core;
-
-    register uint32_t num asm ( "r0" ) = 0x84; // Mailbox 0 interrupt
+    // This SWI enables the interrupt internally
+    register uint32_t num asm ( "r0" ) = UART_IRQ;
     asm ( "svc 0x1001" : : "r" (num) );
 
-    qa7->Core_write_clear[core].Mailbox[0] = 0xffffffff;
+    uint32_t active = uart->masked_interrupt_status;
+
+    if (0 != (active & UART_OverrunInterrupt)) ws->overruns++;
+
+    if (0 != (active & rx_interrupts)) {
+      uart->interrupt_clear = rx_interrupts;
+      receive( ws );
+    }
+
+    if (0 != (active & UART_TxInterrupt)) {
+      // The transmit task unmasks it again when it needs it
+      uart->interrupt_mask = rx_interrupts;
+      PipeOp_WaitForSpace( ws->tx_ready, 1 ); // Never blocks
+      PipeOp_SpaceFilled( ws->tx_ready, 1 );
+    }
+
+    ensure_changes_observable();
   }
 }
 
-void send_to_uart( char const *string, uint32_t length )
+// Returns the number of bytes written to the FIFO
+static uint32_t fill_fifo( char const *data, uint32_t length )
 {
-  for (int i = 0; i < length; i++) {
-    // Send to UART (this should work on qemu, but not on real hardware;
-    // that needs to wait for ready to send interrupts
-    // Note: this is writing a whole word to the UART, could be a
-    // problem.
-    // The real thing will also have to claim the appropriate GPIO pins
-    // and set the alternate functions.
-    // FIXME Yielding or sleeping breaks something!
-    while (0 != (uart->flags & UART_TxFull)) { for (int i = 0; i < 10000; i++) asm ( "" : : "r"(i) ); }
-     // 
-    uart->data = string[i];
-    ensure_changes_observable();
+  // Any transmit interrupt from here on, as the FIFO drains, will be seen
+  uart->interrupt_clear = UART_TxInterrupt;
+
+  uint32_t n = 0;
+  while (n < length && 0 == (uart->flags & UART_TxFull)) {
+    uart->data = data[n++];
   }
+
+  ensure_changes_observable();
+
+  return n;
+}
+
+static void wait_for_fifo_space( workspace *ws )
+{
+  uart->interrupt_mask = rx_interrupts | UART_TxInterrupt;
+  ensure_changes_observable();
+
+  PipeSpace ready = PipeOp_WaitForData( ws->tx_ready, 1 );
+  PipeOp_DataConsumed( ws->tx_ready, ready.available );
 }
 
 // Replace this GPIO stuff with SWIs to:
@@ -110,8 +185,6 @@ static inline void setup_pins()
 static inline
 void initialise_PL011_uart( UART volatile *uart, uint32_t freq, uint32_t baud )
 {
-  // TODO: block when the FIFO is full, wait for interrupts, etc.
-
   // FIXME remove this delay, intended to let the other core run in qemu,
   // like I suspect is happening in real hardware
   for (int i = 0; i < 0x1000000; i++) asm ( "" );
@@ -146,14 +219,19 @@ void initialise_PL011_uart( UART volatile *uart, uint32_t freq, uint32_t baud )
 
   uart->line_control = (eight_bits | one_stop_bit | fifo_enable);
 
+  // Transmit interrupt when the FIFO is half empty, receive when it is
+  // half full (or the line has been quiet for a while, with bytes still
+  // in the FIFO).
+  uart->interrupt_fifo_level_select = UART_TxLevel( UART_FIFO_1_2 )
+                                    | UART_RxLevel( UART_FIFO_1_2 );
   uart->interrupt_mask = 0;
+  uart->interrupt_clear = 0x7ff;
 
   uint32_t const transmit_enable = (1 << 8);
   uint32_t const receive_enable = (1 << 9);
   uint32_t const uart_enable = 1;
 
-  // No interrupts, for the time being, transmit only
-  uart->control = uart_enable | transmit_enable;
+  uart->control = uart_enable | transmit_enable | receive_enable;
   asm ( "dsb" );
 }
 
@@ -172,22 +250,29 @@ void manage( uint32_t handle, workspace *ws )
   // TODO
   initialise_PL011_uart( uart, 3000000, 115200 );
 
-  uint32_t output_pipe = ws->output_pipe;
-
-  {
-    register char *var asm( "r0" ) = "PL011UART";
-    register uint32_t val asm( "r1" ) = &output_pipe;
-    register uint32_t len asm( "r2" ) = 4;
-    register uint32_t ctx asm( "r3" ) = 0;
-    register uint32_t type asm( "r4" ) = 1;
-    asm ( "svc 0x24" : 
-        : "r" (var)
-        , "r" (val)
-        , "r" (len)
-        , "r" (ctx)
-        , "r" (type)
-        );
-  }
+  // This task receives from the output pipe and the tx_ready pipe, the
+  // interrupt task sends to the input pipe and the tx_ready pipe; the
+  // first wait call by each will make it the sender.
+  uint32_t output_pipe = PipeOp_CreateForTransfer( 4096 );
+  PipeOp_SetSender( output_pipe, 0 );
+
+  uint32_t input_pipe = PipeOp_CreateForTransfer( 4096 );
+  PipeOp_SetSender( input_pipe, 0 );
+  PipeOp_SetReceiver( input_pipe, 0 );
+
+  ws->tx_ready = PipeOp_CreateForTransfer( 4096 );
+  PipeOp_SetSender( ws->tx_ready, 0 );
+
+  ws->input_pipe = input_pipe;
+
+  uart->interrupt_mask = rx_interrupts;
+  ensure_changes_observable();
+
+  Task_CreateTask1( interrupt_task, aligned_stack( &ws->irq_stack + 1 ),
+                    (uint32_t) ws );
+
+  // Ready for clients
+  ws->output_pipe = output_pipe;
 
   for (;;) {
     PipeSpace data = PipeOp_WaitForData( output_pipe, 1 );
@@ -197,9 +282,13 @@ void manage( uint32_t handle, workspace *ws )
     }
 
     while (data.available != 0) {
-      char *string = data.location;
-      send_to_uart( string, data.available );
-      data = PipeOp_DataConsumed( output_pipe, data.available );
+      uint32_t sent = fill_fifo( data.location, data.available );
+
+      data = PipeOp_DataConsumed( output_pipe, sent );
+
+      if (data.available != 0 && 0 != (uart->flags & UART_TxFull)) {
+        wait_for_fifo_space( ws );
+      }
     }
   }
 }
@@ -211,8 +300,15 @@ void __attribute__(( noinline )) c_init( workspace **private,
   workspace *ws = rma_claim( sizeof( workspace ) );
   *private = ws;
 
-  ws->output_pipe = PipeOp_CreateForTransfer( 4096 );
-  PipeOp_SetSender( ws->output_pipe, 0 );
+  ws->output_pipe = 0;
+  ws->input_pipe = 0;
+  ws->dropped = 0;
+  ws->overruns = 0;
+
+  swi_handlers handlers = { };
+  handlers.action[0].code = pipes;
+
+  Task_RegisterSWIHandlers( &handlers );
 
   register void *start asm( "r0" ) = manage;
   register uint32_t sp asm( "r1" ) = aligned_stack( ws + 1 );
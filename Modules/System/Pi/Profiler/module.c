@@ -0,0 +1,387 @@
+/* Copyright 2025 Simon Willcocks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Sampling profiler, for Raspberry Pi 2 - 3 (see OSTask_Profile)
+//   *ProfileOn [<rate>]  Clear the profile, sample <rate> times a second
+//                        on each core (default 1000)
+//   *ProfileOff          Stop sampling
+//   *ProfileDump         Log the profile
+// A sampler task on each core routes the core's virtual timer interrupt
+// to it (QA7 SWI 0x1005), starts the kernel sampling and passes the samples through
+// a pipe to the collector task, which counts them by task and pc.
+// The dump is written to the log, numbers in hex, except the counts:
+//   PROF rate <samples per second per core>
+//   PROF samples <total> lost <dropped by the kernel or the collector>
+//   PROF <task> <mode> <pc> <count>
+// Modules/System/Pi/Profiler/symbolise turns a captured log into flat
+// and per-task profiles.
+
+#include "CK_types.h"
+#include "ostaskops.h"
+
+#define PROFILE_ENTRIES 2048 // Power of two
+
+typedef struct workspace workspace;
+
+struct workspace {
+  uint32_t lock;        // Held by the sampler sending to the pipe
+  uint32_t table_lock;
+  uint32_t pipe;
+  uint32_t rate;        // Samples per second on each core, or 0
+  uint32_t samples;
+  uint32_t lost;
+  uint32_t core_lost[4];
+  struct {
+    uint32_t pc;
+    uint32_t task;
+    uint32_t mode;
+    uint32_t count;
+  } entry[PROFILE_ENTRIES];
+};
+
+#define MODULE_CHUNK "0"
+
+const unsigned module_flags = 3;
+// Bit 0: 32-bit compatible
+// Bit 1: Initialisation may run alongside that of other modules
+
+#include "module.h"
+
+NO_start;
+//NO_init;
+NO_finalise;
+NO_service_call;
+//NO_title;
+//NO_help;
+//NO_keywords;
+NO_swi_handler;
+NO_swi_names;
+NO_swi_decoder;
+NO_messages_file;
+
+const char title[] = "Profiler";
+const char help[] = "Profiler\t0.01 (" CREATION_DATE ")";
+
+const char profile_on_help[] =
+  "*ProfileOn clears the profile and samples each core the given number "
+  "of times a second (default 1000).\rSyntax: *ProfileOn [<rate>]";
+const char profile_off_help[] =
+  "*ProfileOff stops sampling.\rSyntax: *ProfileOff";
+const char profile_dump_help[] =
+  "*ProfileDump writes the profile to the log.\rSyntax: *ProfileDump";
+
+asm ( "keywords:"
+ "\n  .asciz \"ProfileOn\""
+ "\n  .align"
+ "\n  .word profile_on_command - header"
+ "\n  .word 0x00010000" // Up to one parameter
+ "\n  .word 0"
+ "\n  .word profile_on_help - header"
+ "\n  .asciz \"ProfileOff\""
+ "\n  .align"
+ "\n  .word profile_off_command - header"
+ "\n  .word 0x00000000" // No parameters
+ "\n  .word 0"
+ "\n  .word profile_off_help - header"
+ "\n  .asciz \"ProfileDump\""
+ "\n  .align"
+ "\n  .word profile_dump_command - header"
+ "\n  .word 0x00000000" // No parameters
+ "\n  .word 0"
+ "\n  .word profile_dump_help - header"
+ "\n  .word 0" );
+
+static void send_samples( workspace *ws, profile_sample *samples, uint32_t count )
+{
+  bool reclaimed = Task_LockClaim( &ws->lock );
+  assert( !reclaimed );
+
+  // As in LogToUART, the pipe's sender is unset while the lock is free,
+  // so the first wait call makes this task the sender.
+  uint32_t bytes = count * sizeof( profile_sample );
+  PipeSpace space = PipeOp_WaitForSpace( ws->pipe, bytes );
+
+  if (space.available >= bytes) {
+    profile_sample *dest = space.location;
+    for (int i = 0; i < count; i++) {
+      dest[i] = samples[i];
+    }
+    PipeOp_SpaceFilled( ws->pipe, bytes );
+  }
+
+  PipeOp_SetSender( ws->pipe, 0 );
+  Task_LockRelease( &ws->lock );
+}
+
+void sampler( uint32_t handle, uint32_t core, workspace *ws )
+{
+  uint32_t rate = 0;
+
+  for (;;) {
+    // The kernel's samples are per core; sleeping may have moved this task
+    Task_SwitchToCore( core );
+
+    if (rate != ws->rate) {
+      rate = ws->rate;
+
+      // Route (or stop routing) the core's virtual timer interrupt
+      // (nCNTVIRQ) to the core. Unclaimed, the QA7 module's core irq
+      // task will find no source for it: the kernel clears it first.
+      register uint32_t source asm( "r0" ) = 3;
+      register uint32_t route asm( "r1" ) = (rate != 0);
+      asm volatile ( "svc 0x1005"
+                     : : "r" (source), "r" (route)
+                     : "lr", "cc", "memory" );
+
+      Task_ProfileStart( rate );
+    }
+
+    profile_sample samples[32];
+    uint32_t lost;
+    uint32_t count = Task_ProfileRead( samples, 32, &lost );
+
+    ws->core_lost[core] += lost;
+
+    if (count != 0) send_samples( ws, samples, count );
+
+    if (count < 32) Task_Sleep( rate == 0 ? 100 : 10 );
+  }
+}
+
+static void count_sample( workspace *ws, profile_sample const *sample )
+{
+  uint32_t hash = (sample->pc >> 2) ^ (sample->task * 0x9e3779b1);
+
+  for (int i = 0; i < PROFILE_ENTRIES; i++) {
+    uint32_t index = (hash + i) & (PROFILE_ENTRIES - 1);
+
+    if (ws->entry[index].count == 0) {
+      ws->entry[index].pc = sample->pc;
+      ws->entry[index].task = sample->task;
+      ws->entry[index].mode = sample->mode;
+      ws->entry[index].count = 1;
+      return;
+    }
+
+    if (ws->entry[index].pc == sample->pc
+     && ws->entry[index].task == sample->task) {
+      ws->entry[index].count++;
+      return;
+    }
+  }
+
+  ws->lost++; // Table full
+}
+
+void collector( uint32_t handle, workspace *ws )
+{
+  ws->pipe = PipeOp_CreateForTransfer( 4096 );
+
+  // Before creating any of the tasks that might want to use it...
+  PipeOp_SetSender( ws->pipe, 0 );
+
+  core_info cores = Task_Cores();
+
+  for (int i = 0; i < cores.total && i < 4; i++) {
+    uint32_t const stack_size = 512;
+    uint8_t *stack = rma_claim( stack_size );
+
+    Task_CreateTask2( sampler, aligned_stack( stack + stack_size ),
+                      i, (uint32_t) ws );
+  }
+
+  for (;;) {
+    PipeSpace data = PipeOp_WaitForData( ws->pipe, sizeof( profile_sample ) );
+
+    uint32_t count = data.available / sizeof( profile_sample );
+    profile_sample const *samples = data.location;
+
+    bool reclaimed = Task_LockClaim( &ws->table_lock );
+    assert( !reclaimed );
+
+    for (int i = 0; i < count; i++) {
+      count_sample( ws, &samples[i] );
+    }
+    ws->samples += count;
+
+    Task_LockRelease( &ws->table_lock );
+
+    PipeOp_DataConsumed( ws->pipe, count * sizeof( profile_sample ) );
+  }
+}
+
+void c_profile_on_command( char const *tail, workspace *ws )
+{
+  uint32_t rate = 0;
+
+  while (*tail == ' ') tail++;
+  while (*tail >= '0' && *tail <= '9') {
+    rate = rate * 10 + (*tail++ - '0');
+  }
+  if (rate == 0) rate = 1000;
+
+  bool reclaimed = Task_LockClaim( &ws->table_lock );
+  assert( !reclaimed );
+
+  memset( ws->entry, 0, sizeof( ws->entry ) );
+  ws->samples = 0;
+  ws->lost = 0;
+  for (int i = 0; i < 4; i++) ws->core_lost[i] = 0;
+
+  Task_LockRelease( &ws->table_lock );
+
+  ws->rate = rate;
+}
+
+void c_profile_off_command( workspace *ws )
+{
+  ws->rate = 0;
+}
+
+static char *hex( char *p, uint32_t n )
+{
+  *p++ = ' ';
+  for (int i = 28; i >= 0; i -= 4) {
+    uint32_t d = (n >> i) & 0xf;
+    *p++ = d < 10 ? '0' + d : 'a' + d - 10;
+  }
+  return p;
+}
+
+static char *decimal( char *p, uint32_t n )
+{
+  char digits[10];
+  int i = 0;
+  do {
+    digits[i++] = '0' + n % 10;
+    n = n / 10;
+  } while (n != 0);
+
+  *p++ = ' ';
+  while (i > 0) *p++ = digits[--i];
+  return p;
+}
+
+void c_profile_dump_command( workspace *ws )
+{
+  bool reclaimed = Task_LockClaim( &ws->table_lock );
+  assert( !reclaimed );
+
+  uint32_t lost = ws->lost;
+  for (int i = 0; i < 4; i++) lost += ws->core_lost[i];
+
+  Task_LogString( "PROF rate ", 10 );
+  Task_LogSmallNumber( ws->rate );
+  Task_LogNewLine();
+  Task_LogString( "PROF samples ", 13 );
+  Task_LogSmallNumber( ws->samples );
+  Task_LogString( " lost ", 6 );
+  Task_LogSmallNumber( lost );
+  Task_LogNewLine();
+
+  for (int i = 0; i < PROFILE_ENTRIES; i++) {
+    if (ws->entry[i].count != 0) {
+      char line[4 + 3 * 9 + 11 + 1];
+      char *p = line;
+      for (char const *s = "PROF"; *s != '\0'; s++) *p++ = *s;
+      p = hex( p, ws->entry[i].task );
+      p = hex( p, ws->entry[i].mode );
+      p = hex( p, ws->entry[i].pc );
+      p = decimal( p, ws->entry[i].count );
+      *p++ = '\n';
+
+      Task_LogStringWait( line, p - line );
+    }
+  }
+
+  Task_LockRelease( &ws->table_lock );
+}
+
+void __attribute__(( naked )) profile_on_command()
+{
+  asm ( "push { r12, lr }" );
+
+  // r0 -> command tail, r12 -> private word
+  register char const *tail asm ( "r0" );
+  register workspace **private asm ( "r12" );
+  asm ( "" : "=r" (tail), "=r" (private) );
+  c_profile_on_command( tail, *private );
+
+  // Clear V, no error
+  asm ( "cmp r0, r0"
+    "\n  pop { r12, pc }" );
+}
+
+void __attribute__(( naked )) profile_off_command()
+{
+  asm ( "push { r12, lr }" );
+
+  register workspace **private asm ( "r12" );
+  asm ( "" : "=r" (private) );
+  c_profile_off_command( *private );
+
+  // Clear V, no error
+  asm ( "cmp r0, r0"
+    "\n  pop { r12, pc }" );
+}
+
+void __attribute__(( naked )) profile_dump_command()
+{
+  asm ( "push { r12, lr }" );
+
+  register workspace **private asm ( "r12" );
+  asm ( "" : "=r" (private) );
+  c_profile_dump_command( *private );
+
+  // Clear V, no error
+  asm ( "cmp r0, r0"
+    "\n  pop { r12, pc }" );
+}
+
+void __attribute__(( noinline )) c_init( workspace **private,
+                                         char const *env,
+                                         uint32_t instantiation )
+{
+  if (*private == 0) {
+    *private = rma_claim( sizeof( workspace ) );
+    memset( *private, 0, sizeof( workspace ) );
+  }
+  else {
+    asm ( "udf 1" );
+  }
+
+  workspace *ws = *private;
+
+  // The collector gets a slot of its own, to map the QA7 into
+  uint32_t const stack_size = 256;
+  uint8_t *stack = rma_claim( stack_size );
+
+  Task_SpawnTask1( collector, aligned_stack( stack + stack_size ),
+                   (uint32_t) ws );
+}
+
+void __attribute__(( naked )) init()
+{
+  register struct workspace **private asm ( "r12" );
+  register char const *env asm ( "r10" );
+  register uint32_t instantiation asm ( "r11" );
+
+  // Move r12 into argument register
+  asm volatile ( "push { lr }" );
+
+  c_init( private, env, instantiation );
+
+  asm ( "pop { pc }" );
+}
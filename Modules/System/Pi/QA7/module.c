@@ -25,20 +25,38 @@ typedef struct workspace workspace;
 
 typedef struct qa7_irq_sources qa7_irq_sources;
 
+#define QA7_LATENCY_BUCKETS 16
+
+typedef struct {
+  uint32_t task;        // Waiting for the interrupt, or 0
+  uint32_t count;       // Times it has occurred
+  uint32_t unclaimed;   // Times it occurred with no task waiting
+} irq_entry;
+
 struct qa7_irq_sources {
   uint32_t core_irq_task;
-  uint32_t task[12];
+  irq_entry irq[12];
+  // Ticks from an interrupt being taken to its task being released by
+  // this core's irq task, bucket n counting those of n significant bits
+  uint32_t latency[QA7_LATENCY_BUCKETS];
 };
 
+#define BALANCE_INTERVAL 100 // ms
+#define BALANCE_MARGIN 16     // Interrupts per interval
+
 struct workspace {
-  uint32_t lock;
+  uint32_t lock;        // Held while changing a GPU interrupt's task or
+                        // the core handling the GPU interrupts
   uint32_t queue;
   core_info cores;
   struct {
     uint32_t stack[64];
   } runstack;
   uint32_t gpu_handler;
-  uint32_t gpu_task[72];
+  uint32_t gpu_core;    // The core gpu_handler runs on
+  uint32_t gpu_target;  // The core that should take the GPU interrupts
+  bool gpu_balance;     // Let the balancer choose gpu_target
+  irq_entry gpu[72];
   struct qa7_irq_sources tasks[]; // One set per core
 };
 
@@ -61,10 +79,63 @@ struct workspace {
 // This call enables the interrupt in the interrupt controller and returns
 // when one occurs.
 
+// SWI 1002 - Interrupt statistics
+//    IN: r0 = 0, r1 = irq number, r2 = core (QA7 interrupts only)
+//    OUT: r0 = number of times it has occurred
+//         r1 = number of those with no task waiting for it
+//    IN: r0 = 1, r1 = core, r2 -> QA7_LATENCY_BUCKETS words
+//    OUT: The core's latency histogram, the timer ticks from each
+//         interrupt being taken to its task being released: bucket n
+//         counts those of n significant bits (the last bucket, any more).
+// An interrupt that occurs with no task waiting for it is masked. GPU
+// interrupts are enabled again when a task waits for them, the QA7 timer,
+// mailbox, PMU and local timer interrupts have to be re-enabled at the QA7
+// by the task that uses them.
+
+// SWI 1003 - For the module's own irq tasks, allows usr32 code on the
+// core to read the generic timer's virtual count.
+
+// SWI 1004 - GPU interrupt affinity
+//    IN: r0 = 0: read
+//        r0 = 1: route GPU interrupts to core r1
+//        r0 = 2: let the balancer choose the core
+//    OUT: r0 = the core taking the GPU interrupts
+//         r1 = the core that will take them (they move when the current
+//              core next takes one)
+//         r2 = 1 if the balancer is choosing
+// The QA7 can only route all the GPU interrupts to the same core. Every
+// BALANCE_INTERVAL ms, the balancer moves them to another core if that
+// reduces the most interrupts handled by any one core (by more than
+// BALANCE_MARGIN).
+// A task waiting for an interrupt is always released on the core that
+// handled it (it has interrupts disabled, so the kernel keeps it there),
+// and so runs with that core's caches.
+
+// SWI 1005 - Route a core timer interrupt to the calling core
+//    IN: r0 = QA7 timer source: 0 (nCNTPSIRQ), 2 (nCNTHPIRQ) or
+//             3 (nCNTVIRQ)
+//        r1 = non-zero to route it to the core, zero to stop
+//    OUT: All registers preserved, or error
+// Core_timers_Interrupt_control is also changed by the core's irq task
+// (masking unclaimed sources), so nothing outside this module should
+// write it.
+
 // IRQ numbers 0-71 are GPU interrupts, 128-... are QA7 interrupts.
 
-const unsigned module_flags = 1;
+// Once claimed, a QA7 interrupt, 128 + n, may be bound to the claiming
+// task instead, with Task_BindInterrupt( n ) (after
+// Task_EnablingInterrupts, on the core the interrupt is routed to). The
+// kernel then wakes the task from Task_WaitForInterrupt without involving
+// this module, see OSTask/interrupts.c.
+
+// QA7 interrupt 129 (nCNTPNSIRQ, each core's generic physical timer) is
+// routed to every core for the kernel's per-core timers (see
+// OSTask/timers.c), and can't be claimed.
+#define KERNEL_TIMER_SOURCE 1
+
+const unsigned module_flags = 3;
 // Bit 0: 32-bit compatible
+// Bit 1: Initialisation may run alongside that of other modules
 
 #include "module.h"
 
@@ -127,175 +198,150 @@ uint32_t change_word_if_equal( uint32_t *word, uint32_t from, uint32_t to )
   return value;
 }
 
-void __attribute__(( noinline )) release_irq_tasks( uint32_t active, uint32_t *irq_tasks )
+static inline void record_latency( uint32_t *histogram, uint32_t taken )
+{
+  uint32_t now;
+  uint32_t hi;
+  asm volatile ( "mrrc p15, 1, %[lo], %[hi], c14"
+                 : [lo] "=r" (now), [hi] "=r" (hi) );
+
+  uint32_t ticks = now - taken;
+  uint32_t bucket = (ticks == 0) ? 0 : 32 - __builtin_clz( ticks );
+  if (bucket >= QA7_LATENCY_BUCKETS) bucket = QA7_LATENCY_BUCKETS - 1;
+
+  histogram[bucket]++;
+}
+
+// Release the tasks waiting for the active interrupts, visiting only
+// the set bits (lowest first; rbit, clz). Returns the interrupts with no
+// task waiting.
+uint32_t __attribute__(( noinline )) release_irq_tasks( uint32_t active,
+                                                      irq_entry *irqs,
+                                                      uint32_t taken,
+                                                      uint32_t *histogram )
 {
-  uint32_t *waiting = irq_tasks;
+  uint32_t unclaimed = 0;
+
   while (active != 0) {
-    if (0 != (1 & active)) {
-      uint32_t task = *waiting;
-      if (task != 0) {
-        *waiting = 0;
-        Task_ReleaseTask( task, 0 );
-      }
-      else {
-        uint32_t volatile *u = (void*) 0xfffff000;
-        {
-          for (int i = 0; i < 0x100000; i++) asm ( "" ); 
-          *u = '@' + (waiting - irq_tasks);
-        }
-      }
+    uint32_t n = __builtin_ctz( active );
+    active &= active - 1;
+
+    irq_entry *irq = &irqs[n];
+    irq->count++;
+
+    uint32_t task = irq->task;
+    if (task != 0) {
+      irq->task = 0;
+      record_latency( histogram, taken );
+      Task_ReleaseTask( task, 0 );
     }
-    waiting++;
-    active = active >> 1;
+    else {
+      irq->unclaimed++;
+      unclaimed |= (1 << n);
+    }
+  }
+
+  return unclaimed;
+}
+
+// Disable a core's QA7 interrupt source at the QA7, where that's possible
+static void mask_core_source( uint32_t core, uint32_t source )
+{
+  if (source < 4) {
+    qa7->Core_timers_Interrupt_control[core] &= ~(1 << source);
+  }
+  else if (source < 8) {
+    qa7->Core_Mailboxes_Interrupt_control[core] &= ~(1 << (source - 4));
+  }
+  else if (source == 9) {
+    qa7->Performance_Monitor_Interrupts_routing_clear = (1 << core);
+  }
+  else if (source == 11) {
+    qa7->Local_timer_control_and_status &= ~(1 << 29);
   }
+  // GPU interrupts (8) are masked at the GPU, the AXI counter interrupt
+  // (10) can't be masked here.
 }
 
-static void release_gpu_handlers( workspace *ws )
+static void release_gpu_handlers( workspace *ws, uint32_t taken,
+                                  uint32_t *histogram )
 {
-  // Bits 10, 11, 12, 13 & 14 are IRQ 7, 9, 10, 18 & 19
-  static uint32_t const mapping1[] = {
-    0,
-    (1 << 7),
-    (1 << 9),
-    (1 << 9) | (1 << 7),
-    (1 << 10),
-    (1 << 10) | (1 << 7),
-    (1 << 10) | (1 << 9),
-    (1 << 10) | (1 << 9) | (1 << 7),
-    (1 << 18),
-    (1 << 18) | (1 << 7),
-    (1 << 18) | (1 << 9),
-    (1 << 18) | (1 << 9) | (1 << 7),
-    (1 << 18) | (1 << 10),
-    (1 << 18) | (1 << 10) | (1 << 7),
-    (1 << 18) | (1 << 10) | (1 << 9),
-    (1 << 18) | (1 << 10) | (1 << 9) | (1 << 7),
-    (1 << 19),
-    (1 << 19) | (1 << 7),
-    (1 << 19) | (1 << 9),
-    (1 << 19) | (1 << 9) | (1 << 7),
-    (1 << 19) | (1 << 10),
-    (1 << 19) | (1 << 10) | (1 << 7),
-    (1 << 19) | (1 << 10) | (1 << 9),
-    (1 << 19) | (1 << 10) | (1 << 9) | (1 << 7),
-    (1 << 19) | (1 << 18),
-    (1 << 19) | (1 << 18) | (1 << 7),
-    (1 << 19) | (1 << 18) | (1 << 9),
-    (1 << 19) | (1 << 18) | (1 << 9) | (1 << 7),
-    (1 << 19) | (1 << 18) | (1 << 10),
-    (1 << 19) | (1 << 18) | (1 << 10) | (1 << 7),
-    (1 << 19) | (1 << 18) | (1 << 10) | (1 << 9),
-    (1 << 19) | (1 << 18) | (1 << 10) | (1 << 9) | (1 << 7) };
-
-  // Bits 15-19 & 20 are IRQs 21-25 & 30
-  static uint32_t const mapping2[] = {
-    0,
-    (1 << 21),
-    (1 << 22),
-    (1 << 22) | (1 << 21),
-    (1 << 23),
-    (1 << 23) | (1 << 21),
-    (1 << 23) | (1 << 22),
-    (1 << 23) | (1 << 22) | (1 << 21),
-    (1 << 24),
-    (1 << 24) | (1 << 21),
-    (1 << 24) | (1 << 22),
-    (1 << 24) | (1 << 22) | (1 << 21),
-    (1 << 24) | (1 << 23),
-    (1 << 24) | (1 << 23) | (1 << 21),
-    (1 << 24) | (1 << 23) | (1 << 22),
-    (1 << 24) | (1 << 23) | (1 << 22) | (1 << 21),
-    (1 << 25),
-    (1 << 25) | (1 << 21),
-    (1 << 25) | (1 << 22),
-    (1 << 25) | (1 << 22) | (1 << 21),
-    (1 << 25) | (1 << 23),
-    (1 << 25) | (1 << 23) | (1 << 21),
-    (1 << 25) | (1 << 23) | (1 << 22),
-    (1 << 25) | (1 << 23) | (1 << 22) | (1 << 21),
-    (1 << 25) | (1 << 24),
-    (1 << 25) | (1 << 24) | (1 << 21),
-    (1 << 25) | (1 << 24) | (1 << 22),
-    (1 << 25) | (1 << 24) | (1 << 22) | (1 << 21),
-    (1 << 25) | (1 << 24) | (1 << 23),
-    (1 << 25) | (1 << 24) | (1 << 23) | (1 << 21),
-    (1 << 25) | (1 << 24) | (1 << 23) | (1 << 22),
-    (1 << 25) | (1 << 24) | (1 << 23) | (1 << 22) | (1 << 21),
-    (1 << 30),
-    (1 << 30) | (1 << 21),
-    (1 << 30) | (1 << 22),
-    (1 << 30) | (1 << 22) | (1 << 21),
-    (1 << 30) | (1 << 23),
-    (1 << 30) | (1 << 23) | (1 << 21),
-    (1 << 30) | (1 << 23) | (1 << 22),
-    (1 << 30) | (1 << 23) | (1 << 22) | (1 << 21),
-    (1 << 30) | (1 << 24),
-    (1 << 30) | (1 << 24) | (1 << 21),
-    (1 << 30) | (1 << 24) | (1 << 22),
-    (1 << 30) | (1 << 24) | (1 << 22) | (1 << 21),
-    (1 << 30) | (1 << 24) | (1 << 23),
-    (1 << 30) | (1 << 24) | (1 << 23) | (1 << 21),
-    (1 << 30) | (1 << 24) | (1 << 23) | (1 << 22),
-    (1 << 30) | (1 << 24) | (1 << 23) | (1 << 22) | (1 << 21),
-    (1 << 30) | (1 << 25),
-    (1 << 30) | (1 << 25) | (1 << 21),
-    (1 << 30) | (1 << 25) | (1 << 22),
-    (1 << 30) | (1 << 25) | (1 << 22) | (1 << 21),
-    (1 << 30) | (1 << 25) | (1 << 23),
-    (1 << 30) | (1 << 25) | (1 << 23) | (1 << 21),
-    (1 << 30) | (1 << 25) | (1 << 23) | (1 << 22),
-    (1 << 30) | (1 << 25) | (1 << 23) | (1 << 22) | (1 << 21),
-    (1 << 30) | (1 << 25) | (1 << 24),
-    (1 << 30) | (1 << 25) | (1 << 24) | (1 << 21),
-    (1 << 30) | (1 << 25) | (1 << 24) | (1 << 22),
-    (1 << 30) | (1 << 25) | (1 << 24) | (1 << 22) | (1 << 21),
-    (1 << 30) | (1 << 25) | (1 << 24) | (1 << 23),
-    (1 << 30) | (1 << 25) | (1 << 24) | (1 << 23) | (1 << 21),
-    (1 << 30) | (1 << 25) | (1 << 24) | (1 << 23) | (1 << 22),
-    (1 << 30) | (1 << 25) | (1 << 24) | (1 << 23) | (1 << 22) | (1 << 21)
-  };
+  // Bits 10-20 of base_pending are shortcuts to these interrupts in
+  // pending1 (bits 10-14) and pending2 (bits 15-20)
+  static uint8_t const shortcut[11] = { 7, 9, 10, 18, 19,
+                                        21, 22, 23, 24, 25, 30 };
 
   // Assuming pending registers only include enabled IRQs
-  uint32_t base_pending;
+  uint32_t base_pending = gpu->base_pending;
 
-  base_pending = gpu->base_pending;
+  uint32_t pending1 = 0;
+  uint32_t pending2 = 0;
 
-  uint32_t pending1;
+  // Bits 8 and 9: other interrupts pending in pending1 or 2 (which also
+  // include the shortcut interrupts)
+  if (0 != (base_pending & (1 << 8))) pending1 = gpu->pending1;
+  if (0 != (base_pending & (1 << 9))) pending2 = gpu->pending2;
 
-  if (0 != (base_pending & (1 << 8))) {
-    pending1 = gpu->pending1;
-    // (Includes all the ones mapped to base_pending)
-  }
-  else {
-    pending1 = mapping1[(base_pending >> 10) & 31];
-  }
+  uint32_t shortcuts = (base_pending >> 10) & 0x7ff;
+  while (shortcuts != 0) {
+    uint32_t n = __builtin_ctz( shortcuts );
+    shortcuts &= shortcuts - 1;
 
-  if (pending1 != 0) {
-    gpu->disable_irqs1 = pending1;
-    release_irq_tasks( pending1, &ws->gpu_task[0] );
+    if (n < 5)
+      pending1 |= (1 << shortcut[n]);
+    else
+      pending2 |= (1 << shortcut[n]);
   }
 
-  uint32_t pending2;
+  // Each interrupt stays disabled until a task waits for it again, so
+  // unclaimed interrupts are masked as well.
 
-  if (0 != (base_pending & (1 << 9))) {
-    pending2 = gpu->pending2;
-  }
-  else {
-    pending2 = mapping2[(base_pending >> 15) & 63];
+  if (pending1 != 0) {
+    gpu->disable_irqs1 = pending1;
+    release_irq_tasks( pending1, &ws->gpu[0], taken, histogram );
   }
 
   if (pending2 != 0) {
     gpu->disable_irqs2 = pending2;
-    release_irq_tasks( pending2, &ws->gpu_task[32] );
+    release_irq_tasks( pending2, &ws->gpu[32], taken, histogram );
   }
 
   base_pending &= 0xff;
   if (0 != base_pending) {
     gpu->disable_base = base_pending;
-    release_irq_tasks( base_pending, &ws->gpu_task[64] );
+    release_irq_tasks( base_pending, &ws->gpu[64], taken, histogram );
+  }
+
+  ensure_changes_observable();
+}
+
+// Called by the irq task handling the GPU interrupts, with interrupts
+// disabled. Any GPU interrupt taken by this core after this will be
+// ignored, the new core will take it.
+// An irq task must never block, so if irq_manager holds the lock, the
+// move is left until the next GPU interrupt.
+static void move_gpu_interrupts( workspace *ws, uint32_t handle )
+{
+  // Claims a free task lock, as Task_LockClaim would
+  if (0 != change_word_if_equal( &ws->lock, 0, handle )) return;
+
+  uint32_t core = ws->gpu_target;
+  uint32_t handler = ws->tasks[core].core_irq_task;
+
+  // The new core's irq task will be releasing the waiting tasks
+  for (int i = 0; i < number_of( ws->gpu ); i++) {
+    uint32_t task = ws->gpu[i].task;
+    if (task != 0) Task_ChangeController( task, handler );
   }
 
+  ws->gpu_handler = handler;
+  ws->gpu_core = core;
   ensure_changes_observable();
+
+  qa7->GPU_interrupts_routing = core;
+  ensure_changes_observable();
+
+  Task_LockRelease( &ws->lock );
 }
 
 // Hopefully no stack at all...
@@ -344,6 +390,9 @@ void core_irq_task( uint32_t handle, uint32_t core, workspace *ws )
     gpu->disable_base = 0xff;
     ensure_changes_observable();
 
+    ws->gpu_core = core;
+    ws->gpu_target = core;
+
     qa7->GPU_interrupts_routing = core;
 
     ensure_changes_observable();
@@ -354,12 +403,21 @@ void core_irq_task( uint32_t handle, uint32_t core, workspace *ws )
   // is running with interrupts disabled, so there's no race condition.
   ws->tasks[core].core_irq_task = handle;
 
-  uint32_t *tasks_on_this_core = &ws->tasks[core].task[0];
+  irq_entry *irqs_on_this_core = &ws->tasks[core].irq[0];
+  uint32_t *histogram = &ws->tasks[core].latency[0];
 
-  for (;;) {
-    Task_WaitForInterrupt();
+  // For record_latency
+  asm volatile ( "svc 0x1003" : : : "lr", "cc", "memory" );
+
+  // The kernel's timer
+  qa7->Core_timers_Interrupt_control[core] |= (1 << KERNEL_TIMER_SOURCE);
+  ensure_changes_observable();
 
-    uint32_t interrupts = qa7->Core_IRQ_Source[core];
+  for (;;) {
+    // The kernel reads Core_IRQ_Source, and leaves out the sources bound
+    // to tasks (waiting or not), so they are never masked here.
+    uint32_t taken;
+    uint32_t interrupts = Task_WaitForInterruptTaken( &taken );
 
 // This approach is multi processor safe because:
 //  Word read/writes are atomic.
@@ -371,14 +429,27 @@ void core_irq_task( uint32_t handle, uint32_t core, workspace *ws )
 
     if ((interrupts & (1 << 8)) != 0) { // GPU interrupt
 
-      if (handle != ws->gpu_handler) asm ( "bkpt 8" );
-
       interrupts &= ~(1 << 8);
 
-      release_gpu_handlers( ws );
+      // Unless the interrupts have just been moved to another core
+      if (handle == ws->gpu_handler) {
+        release_gpu_handlers( ws, taken, histogram );
+
+        if (ws->gpu_target != core) move_gpu_interrupts( ws, handle );
+      }
     }
 
-    release_irq_tasks( interrupts, tasks_on_this_core );
+    uint32_t unclaimed = release_irq_tasks( interrupts, irqs_on_this_core,
+                                            taken, histogram );
+
+    while (unclaimed != 0) {
+      uint32_t n = __builtin_ctz( unclaimed );
+      unclaimed &= unclaimed - 1;
+
+      mask_core_source( core, n );
+    }
+
+    ensure_changes_observable();
 
     // nudge_other_cores( core, cores.total );
   }
@@ -405,6 +476,9 @@ void ticker( uint32_t handle, QA7 volatile *qa7 )
   core_info cores = Task_Cores();
   int core = cores.current;
 
+  // Woken directly by the kernel, not by the core's irq task
+  if (0 != Task_BindInterrupt( irq_number - 128 )) asm ( "bkpt 9" );
+
   qa7->Local_Interrupt_routing0 = core; // IRQ to this core, please
 
   // Just in case the above needs to be processed before the first
@@ -442,8 +516,7 @@ void ticker( uint32_t handle, QA7 volatile *qa7 )
   Task_LogNewLine();
 
   for (;;) {
-    register uint32_t irq asm ( "r0" ) = irq_number;
-    asm ( "svc 0x1001" : : "r" (irq) );
+    Task_WaitForInterrupt();
 
     // There's only one place in each system that calls this,
     // so there's no point in putting it into ostaskops.h
@@ -488,6 +561,77 @@ void start_ticker()
 
 //////////////////////////////////////////////////
 
+static uint32_t interrupts_on_core( workspace *ws, uint32_t core )
+{
+  uint32_t total = 0;
+  for (int i = 0; i < number_of( ws->tasks[core].irq ); i++) {
+    total += ws->tasks[core].irq[i].count;
+  }
+  return total;
+}
+
+static uint32_t gpu_interrupts( workspace *ws )
+{
+  uint32_t total = 0;
+  for (int i = 0; i < number_of( ws->gpu ); i++) {
+    total += ws->gpu[i].count;
+  }
+  return total;
+}
+
+static inline uint32_t max( uint32_t a, uint32_t b )
+{
+  return (a > b) ? a : b;
+}
+
+// Interrupts handled by each core in the last interval, apart from the
+// GPU interrupts, which all went to gpu_core.
+void balancer( uint32_t handle, workspace *ws )
+{
+  uint32_t previous[4] = { };
+  uint32_t previous_gpu = gpu_interrupts( ws );
+  uint32_t cores = ws->cores.total;
+  if (cores > 4) cores = 4;
+
+  for (int i = 0; i < cores; i++) {
+    previous[i] = interrupts_on_core( ws, i );
+  }
+
+  for (;;) {
+    Task_Sleep( BALANCE_INTERVAL );
+
+    uint32_t load[4];
+    for (int i = 0; i < cores; i++) {
+      uint32_t count = interrupts_on_core( ws, i );
+      load[i] = count - previous[i];
+      previous[i] = count;
+    }
+
+    uint32_t count = gpu_interrupts( ws );
+    uint32_t gpu = count - previous_gpu;
+    previous_gpu = count;
+
+    uint32_t from = ws->gpu_core;
+
+    // Not balancing, or still moving
+    if (!ws->gpu_balance || ws->gpu_target != from) continue;
+
+    uint32_t to = from;
+    for (int i = 0; i < cores; i++) {
+      if (load[i] < load[to]) to = i;
+    }
+
+    uint32_t busiest_now = max( load[from] + gpu, load[to] );
+    uint32_t busiest_after = max( load[to] + gpu, load[from] );
+
+    if (busiest_after + BALANCE_MARGIN < busiest_now) {
+      ws->gpu_target = to;
+    }
+  }
+}
+
+//////////////////////////////////////////////////
+
 void irq_manager( uint32_t handle, workspace *ws )
 {
           { char const text[] = "IRQ manager workspace: ";
@@ -501,6 +645,14 @@ void irq_manager( uint32_t handle, workspace *ws )
   Task_MapDevicePages( qa7, qa7_page, 1 );
   Task_MapDevicePages( gpu, gpu_page, 1 );
 
+  // Before the irq tasks first wait, so that the kernel passes them the
+  // interrupt sources from the first interrupt.
+  uint32_t const sources = (qa7_page << 12) + offset_of( QA7, Core_IRQ_Source );
+  if (0 != Task_InterruptSources( sources, sizeof( uint32_t ),
+                                  KERNEL_TIMER_SOURCE )) {
+    asm ( "bkpt 9" );
+  }
+
   // One IRQ task per core
   for (int i = 0; i < ws->cores.total; i++) {
     uint32_t const stack_size = 256;
@@ -551,6 +703,13 @@ void irq_manager( uint32_t handle, workspace *ws )
 #warning "Sleep ticker disabled"
 #endif
 
+  {
+    uint32_t const stack_size = 256;
+    uint8_t *stack = rma_claim( stack_size );
+    Task_CreateTask1( balancer, aligned_stack( stack + stack_size ),
+                      (uint32_t) ws );
+  }
+
   // Note: This loop is running with interrupts disabled, so that the
   // core requesting the services aren't interruptable by the interrupt
   // they just enabled.
@@ -582,6 +741,36 @@ void irq_manager( uint32_t handle, workspace *ws )
       Task_SwitchToCore( client.core );
       Task_ReleaseTask( client.task_handle, 0 );
       break;
+    case 5: // Route core timer interrupt
+      {
+        svc_registers regs;
+
+        Task_GetRegisters( client.task_handle, &regs );
+
+        uint32_t source = regs.r[0];
+
+        if (source >= 4 || source == KERNEL_TIMER_SOURCE) {
+          static error_block bad_source = { 0x888, "Invalid QA7 timer source" };
+          regs.r[0] = (uint32_t) &bad_source;
+          regs.spsr |= VF;
+        }
+        else {
+          // The core's irq task only changes the register on its own
+          // core, with interrupts disabled, as does this task once it's
+          // on that core, so neither can interrupt the other's change.
+          Task_SwitchToCore( client.core );
+
+          if (regs.r[1] != 0)
+            qa7->Core_timers_Interrupt_control[client.core] |= (1 << source);
+          else
+            qa7->Core_timers_Interrupt_control[client.core] &= ~(1 << source);
+
+          ensure_changes_observable();
+        }
+
+        Task_ReleaseTask( client.task_handle, &regs );
+      }
+      break;
     case 1: // Wait for interrupt
       {
         svc_registers regs;
@@ -590,18 +779,23 @@ void irq_manager( uint32_t handle, workspace *ws )
 
         uint32_t req = regs.r[0];
 
+        // The GPU interrupts' handler may be moving
+        bool reclaimed = Task_LockClaim( &ws->lock );
+        assert( !reclaimed );
+
         if (0 == (regs.spsr & 0x80)) asm ( "bkpt 2" );
         if ((req >= 72 && req < 128) || req >= 128 + 12) asm ( "bkpt 3" );
+        if (req == 128 + KERNEL_TIMER_SOURCE) asm ( "bkpt 3" );
 
         uint32_t *task_entry;
         uint32_t handler;
 
         if (req < 72) { // GPU interrupt
-          task_entry = &ws->gpu_task[req];
+          task_entry = &ws->gpu[req].task;
           handler = ws->gpu_handler;
         }
         else { // QA7 interrupt
-          task_entry = &ws->tasks[client.core].task[req-128];
+          task_entry = &ws->tasks[client.core].irq[req-128].task;
           handler = ws->tasks[client.core].core_irq_task;
         }
 
@@ -637,6 +831,8 @@ void irq_manager( uint32_t handle, workspace *ws )
         }
 
         ensure_changes_observable();
+
+        Task_LockRelease( &ws->lock );
       }
       break;
     default:
@@ -645,6 +841,98 @@ void irq_manager( uint32_t handle, workspace *ws )
   }
 }
 
+void statistics( svc_registers *regs, void *private, int core, uint32_t task )
+{
+  workspace *ws = private;
+
+  static error_block bad_reason = { 0x888, "Unknown QA7 statistics reason" };
+  static error_block bad_irq = { 0x888, "Invalid interrupt number" };
+
+  uint32_t n = regs->r[1];
+
+  switch (regs->r[0]) {
+  case 0:
+    {
+      irq_entry *irq = 0;
+
+      if (n < 72) {
+        irq = &ws->gpu[n];
+      }
+      else if (n >= 128 && n < 128 + 12 && regs->r[2] < ws->cores.total) {
+        irq = &ws->tasks[regs->r[2]].irq[n - 128];
+      }
+
+      if (irq == 0) {
+        regs->r[0] = (uint32_t) &bad_irq;
+        regs->spsr |= VF;
+        return;
+      }
+
+      regs->r[0] = irq->count;
+      regs->r[1] = irq->unclaimed;
+    }
+    break;
+  case 1:
+    {
+      if (n >= ws->cores.total) {
+        regs->r[0] = (uint32_t) &bad_irq;
+        regs->spsr |= VF;
+        return;
+      }
+
+      uint32_t *histogram = (void*) regs->r[2];
+      for (int i = 0; i < QA7_LATENCY_BUCKETS; i++) {
+        histogram[i] = ws->tasks[n].latency[i];
+      }
+    }
+    break;
+  default:
+    regs->r[0] = (uint32_t) &bad_reason;
+    regs->spsr |= VF;
+  }
+}
+
+void affinity( svc_registers *regs, void *private, int core, uint32_t task )
+{
+  workspace *ws = private;
+
+  static error_block bad_reason = { 0x888, "Unknown QA7 affinity reason" };
+  static error_block bad_core = { 0x888, "Invalid core" };
+
+  switch (regs->r[0]) {
+  case 0: break;
+  case 1:
+    if (regs->r[1] >= ws->cores.total) {
+      regs->r[0] = (uint32_t) &bad_core;
+      regs->spsr |= VF;
+      return;
+    }
+    ws->gpu_balance = false;
+    ws->gpu_target = regs->r[1];
+    break;
+  case 2:
+    ws->gpu_balance = true;
+    break;
+  default:
+    regs->r[0] = (uint32_t) &bad_reason;
+    regs->spsr |= VF;
+    return;
+  }
+
+  regs->r[0] = ws->gpu_core;
+  regs->r[1] = ws->gpu_target;
+  regs->r[2] = ws->gpu_balance;
+}
+
+void enable_timer_reads( svc_registers *regs, void *private, int core,
+                         uint32_t task )
+{
+  uint32_t cntkctl;
+  asm volatile ( "mrc p15, 0, %[v], c14, c1, 0" : [v] "=r" (cntkctl) );
+  cntkctl |= 2; // EL0VCTEN
+  asm volatile ( "mcr p15, 0, %[v], c14, c1, 0" : : [v] "r" (cntkctl) );
+}
+
 void __attribute__(( noinline )) c_init( workspace **private,
                                          char const *env,
                                          uint32_t instantiation )
@@ -668,6 +956,10 @@ void __attribute__(( noinline )) c_init( workspace **private,
   swi_handlers handlers = { };
   handlers.action[0].queue = ws->queue;
   handlers.action[1].queue = ws->queue;
+  handlers.action[2].code = statistics;
+  handlers.action[3].code = enable_timer_reads;
+  handlers.action[4].code = affinity;
+  handlers.action[5].queue = ws->queue;
 
   Task_RegisterSWIHandlers( &handlers );
 
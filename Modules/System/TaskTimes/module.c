@@ -0,0 +1,116 @@
+/* Copyright 2025 Simon Willcocks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// *TaskTimes: logs the CPU time used by each OSTask (see OSTask_TaskTimes)
+// One line per task:
+//   <handle> [idle <core>] switches <n> user <ms> kernel <ms> waiting <ms>
+
+#include "CK_types.h"
+#include "ostaskops.h"
+
+#define MODULE_CHUNK "0"
+
+const unsigned module_flags = 3;
+// Bit 0: 32-bit compatible
+// Bit 1: Initialisation may run alongside that of other modules
+
+#include "module.h"
+
+NO_start;
+NO_init;
+NO_finalise;
+NO_service_call;
+//NO_title;
+//NO_help;
+//NO_keywords;
+NO_swi_handler;
+NO_swi_names;
+NO_swi_decoder;
+NO_messages_file;
+
+const char title[] = "TaskTimes";
+const char help[] = "TaskTimes\t0.01 (" CREATION_DATE ")";
+
+const char task_times_help[] =
+  "*TaskTimes lists the CPU time each task has used, and how long it has "
+  "spent waiting for a core.\rSyntax: *TaskTimes";
+
+asm ( "keywords:"
+ "\n  .asciz \"TaskTimes\""
+ "\n  .align"
+ "\n  .word task_times_command - header"
+ "\n  .word 0x00000000" // No parameters
+ "\n  .word 0"
+ "\n  .word task_times_help - header"
+ "\n  .word 0" );
+
+// No 64-bit division available
+static uint32_t ticks_to_ms( uint64_t ticks, uint32_t khz )
+{
+  uint64_t ms = 0;
+  uint64_t remainder = 0;
+
+  for (int i = 63; i >= 0; i--) {
+    remainder = (remainder << 1) | ((ticks >> i) & 1);
+    if (remainder >= khz) {
+      remainder -= khz;
+      ms |= 1ull << i;
+    }
+  }
+
+  return ms;
+}
+
+static void log_ms( char const *label, uint64_t ticks, uint32_t khz )
+{
+  Task_Space();
+  Task_LogString( label, 0 );
+  Task_Space();
+  Task_LogSmallNumber( ticks_to_ms( ticks, khz ) );
+}
+
+void c_task_times_command()
+{
+  task_times times;
+  uint32_t index = 0;
+
+  while (0 != (index = Task_TaskTimes( index, &times ))) {
+    uint32_t khz = times.ticks_per_second / 1000;
+    if (khz == 0) khz = 1;
+
+    Task_LogHex( times.handle );
+    if (times.idle_core != 0) {
+      Task_LogString( " idle ", 6 );
+      Task_LogSmallNumber( times.idle_core - 1 );
+    }
+    Task_LogString( " switches ", 10 );
+    Task_LogSmallNumber( times.switches );
+    log_ms( "user", times.user, khz );
+    log_ms( "kernel", times.kernel, khz );
+    log_ms( "waiting", times.waiting, khz );
+    Task_LogNewLine();
+  }
+}
+
+void __attribute__(( naked )) task_times_command()
+{
+  asm ( "push { r12, lr }" );
+
+  c_task_times_command();
+
+  // Clear V, no error
+  asm ( "cmp r0, r0"
+    "\n  pop { r12, pc }" );
+}
@@ -0,0 +1,635 @@
+/* Copyright 2025 Simon Willcocks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Kernel micro-benchmarks, run once at startup, timed with the generic
+// timer's virtual count and the benchmark task's PMU counters (see
+// OSTask_PerformanceCounters).
+//
+// Results go to the log (the PL011 UART, with LogToUART), one line per
+// benchmark, so that runs can be compared by a script:
+//
+//   BENCH start <timer Hz> <cores>
+//   BENCH <name> <parameter> <iterations> <ticks> <cycles> <cycles/iteration>
+//         <L1D refills> <L1D TLB refills> <branch mispredicts> <L2 refills>
+//   BENCH end
+//
+// Benchmarks that need a second core are left out on single core systems.
+// The counters only count for the benchmark task, not its partners; the
+// event counts are zero if the processor doesn't have four counters.
+//
+// irq_latency and timer_latency are the exceptions: the ticks are from a
+// timer's deadline to the waiting task running, in total (and the worst,
+// irq_latency_max and timer_latency_max), and there are no counts.
+
+#include "CK_types.h"
+#include "ostaskops.h"
+
+typedef struct workspace workspace;
+
+#define MODULE_CHUNK "0x80c80"
+
+const unsigned module_flags = 1;
+// Bit 0: 32-bit compatible
+
+#include "module.h"
+
+//NO_start;
+//NO_init;
+NO_finalise;
+NO_service_call;
+//NO_title;
+//NO_help;
+NO_keywords;
+NO_swi_handler;
+NO_swi_names;
+NO_swi_decoder;
+NO_messages_file;
+
+const char title[] = "Bench";
+const char help[] = "Bench\t\t0.01 (" CREATION_DATE ")";
+
+#define ITERATIONS 10000
+#define PIPE_BYTES (256 * 1024)
+#define LOG_LINES 32 // Fits in the log pipe, nothing is dropped
+#define IRQ_SAMPLES 100
+
+struct workspace {
+  uint32_t queue;
+  uint32_t volatile stop;
+  uint32_t lock;
+  uint32_t to;          // Pipes between the benchmark and a partner
+  uint32_t fro;
+  uint32_t block;
+  uint32_t bound;       // irq_latency: bound to the interrupt source
+  uint32_t volatile latency;
+  uint32_t volatile worst;
+};
+
+// SWI 0x80c80, Bench_EnableCounters: allow usr32 code on the calling
+// core to read the timer.
+void enable_counters( svc_registers *regs, void *ws, int core, uint32_t task )
+{
+  uint32_t cntkctl;
+  asm volatile ( "mrc p15, 0, %[v], c14, c1, 0" : [v] "=r" (cntkctl) );
+  cntkctl |= 3; // EL0PCTEN, EL0VCTEN
+  asm volatile ( "mcr p15, 0, %[v], c14, c1, 0" : : [v] "r" (cntkctl) );
+}
+
+// SWI 0x80c81, Bench_Null: SWI entry and exit.
+void null_swi( svc_registers *regs, void *ws, int core, uint32_t task )
+{
+}
+
+// SWI 0x80c82, Bench_Queued: routed to a queue, see server.
+
+// SWI 0x80c83, Bench_VirtualTimer: start the calling core's virtual
+// timer, to fire in r0 ticks (returns the low word of the deadline in
+// r0), or stop it if r0 is zero. (The physical timer is the kernel's, the
+// virtual one is the profiler's, which isn't running during the
+// benchmarks.)
+void virtual_timer( svc_registers *regs, void *ws, int core, uint32_t task )
+{
+  uint32_t ticks = regs->r[0];
+
+  if (ticks == 0) {
+    asm volatile ( "mcr p15, 0, %[c], c14, c3, 1" : : [c] "r" (0) );
+    return;
+  }
+
+  // CNTV_TVAL, then CNTV_CTL: enabled, not masked
+  asm volatile ( "mcr p15, 0, %[t], c14, c3, 0" : : [t] "r" (ticks) );
+  asm volatile ( "mcr p15, 0, %[c], c14, c3, 1" : : [c] "r" (1) );
+
+  uint32_t lo, hi;
+  asm volatile ( "mrrc p15, 3, %[lo], %[hi], c14"
+                 : [lo] "=r" (lo), [hi] "=r" (hi) );
+  regs->r[0] = lo;
+}
+
+static inline uint32_t timer_now()
+{
+  uint32_t lo, hi;
+  asm volatile ( "mrrc p15, 1, %[lo], %[hi], c14"
+                 : [lo] "=r" (lo), [hi] "=r" (hi) );
+  return lo;
+}
+
+typedef struct {
+  uint32_t ticks;
+  pmu_counts counts;
+} stamp;
+
+static inline stamp now()
+{
+  stamp s;
+  Task_PMURead( &s.counts );
+  s.ticks = timer_now();
+  return s;
+}
+
+static inline uint32_t virtual_timer_start( uint32_t ticks )
+{
+  register uint32_t t asm ( "r0" ) = ticks;
+  asm volatile ( "svc 0x80c83" : "=r" (t) : "r" (t) : "lr", "cc", "memory" );
+  return t;
+}
+
+static void log_result( char const *name, uint32_t param, uint32_t iterations,
+                        uint32_t ticks, pmu_counts const *counts )
+{
+  uint32_t cycles = counts->cycles;
+
+  Task_LogString( "BENCH ", 6 );
+  Task_LogString( name, 0 );
+  Task_Space();
+  Task_LogSmallNumber( param );
+  Task_Space();
+  Task_LogSmallNumber( iterations );
+  Task_Space();
+  Task_LogSmallNumber( ticks );
+  Task_Space();
+  Task_LogSmallNumber( cycles );
+  Task_Space();
+  Task_LogSmallNumber( cycles / iterations );
+  for (int i = 0; i < 4; i++) {
+    Task_Space();
+    Task_LogSmallNumber( counts->event[i] );
+  }
+  Task_LogNewLine();
+}
+
+static void report( char const *name, uint32_t param, uint32_t iterations,
+                    stamp start )
+{
+  stamp end = now();
+
+  pmu_counts counts = { .cycles = end.counts.cycles - start.counts.cycles };
+  for (int i = 0; i < 4; i++) {
+    counts.event[i] = end.counts.event[i] - start.counts.event[i];
+  }
+
+  log_result( name, param, iterations, end.ticks - start.ticks, &counts );
+}
+
+static uint32_t start_partner( void *code, workspace *ws, uint32_t core,
+                               bool new_slot )
+{
+  static uint32_t const stack_size = 256;
+  uint8_t *stack = rma_claim( stack_size );
+  uint32_t sp = aligned_stack( stack + stack_size );
+
+  if (new_slot)
+    return Task_SpawnTask2( code, sp, (uint32_t) ws, core );
+  else
+    return Task_CreateTask2( code, sp, (uint32_t) ws, core );
+}
+
+void server( uint32_t handle, uint32_t queue )
+{
+  for (;;) {
+    queued_task client = Task_QueueWait( queue );
+    Task_ReleaseTask( client.task_handle, 0 );
+  }
+}
+
+void yielder( uint32_t handle, workspace *ws, uint32_t core )
+{
+  Task_SwitchToCore( core );
+
+  while (!ws->stop) {
+    Task_Yield();
+  }
+
+  Task_EndTask();
+}
+
+void locker( uint32_t handle, workspace *ws, uint32_t core )
+{
+  Task_SwitchToCore( core );
+
+  while (!ws->stop) {
+    Task_LockClaim( &ws->lock );
+    Task_LockRelease( &ws->lock );
+  }
+
+  Task_EndTask();
+}
+
+// Returns each 4-byte message from ws->to on ws->fro, ITERATIONS times.
+void echo( uint32_t handle, workspace *ws, uint32_t core )
+{
+  Task_SwitchToCore( core );
+
+  for (int i = 0; i < ITERATIONS; i++) {
+    PipeSpace data = PipeOp_WaitForData( ws->to, 4 );
+    PipeSpace space = PipeOp_WaitForSpace( ws->fro, 4 );
+    *(uint32_t*) space.location = *(uint32_t*) data.location;
+    PipeOp_DataConsumed( ws->to, 4 );
+    PipeOp_SpaceFilled( ws->fro, 4 );
+  }
+
+  Task_EndTask();
+}
+
+// Fills PIPE_BYTES of ws->to, ws->block bytes at a time. The content is
+// not written, it's the transfer that's being measured.
+void sender( uint32_t handle, workspace *ws, uint32_t core )
+{
+  Task_SwitchToCore( core );
+
+  uint32_t block = ws->block;
+
+  for (uint32_t sent = 0; sent < PIPE_BYTES; sent += block) {
+    PipeOp_WaitForSpace( ws->to, block );
+    PipeOp_SpaceFilled( ws->to, block );
+  }
+
+  Task_EndTask();
+}
+
+// Waits for the core's virtual timer interrupt (QA7 interrupt 131),
+// IRQ_SAMPLES times, through the QA7 module's queued SWI, or bound to
+// the interrupt source (ws->bound).
+// QA7 SWI 0x1005, route (or stop routing) a core timer interrupt to the
+// calling core
+static inline void route_core_timer( uint32_t source, bool route )
+{
+  register uint32_t s asm( "r0" ) = source;
+  register uint32_t r asm( "r1" ) = route;
+  asm volatile ( "svc 0x1005" : : "r" (s), "r" (r) : "lr", "cc", "memory" );
+}
+
+void timer_waiter( uint32_t handle, workspace *ws, uint32_t core )
+{
+  static uint32_t const source = 3; // nCNTVIRQ
+
+  Task_SwitchToCore( core );
+
+  register uint32_t irq asm ( "r0" ) = 128 + source;
+  asm volatile ( "svc 0x1000" : : "r" (irq) : "lr", "cc", "memory" );
+
+  Task_EnablingInterrupts();
+
+  if (ws->bound && 0 != Task_BindInterrupt( source )) asm ( "udf 2" );
+
+  route_core_timer( source, true );
+
+  uint32_t hz;
+  asm ( "mrc p15, 0, %[hz], c14, c0, 0" : [hz] "=r" (hz) );
+
+  // Long enough for the QA7 module to have dealt with the wait request
+  uint32_t const delay = hz / 100;
+
+  uint32_t total = 0;
+  uint32_t worst = 0;
+
+  for (int i = 0; i < IRQ_SAMPLES; i++) {
+    uint32_t deadline = virtual_timer_start( delay );
+
+    if (ws->bound) {
+      Task_WaitForInterrupt();
+    }
+    else {
+      register uint32_t irq asm ( "r0" ) = 128 + source;
+      asm volatile ( "svc 0x1001" : : "r" (irq) : "lr", "cc", "memory" );
+    }
+
+    uint32_t latency = timer_now() - deadline;
+
+    virtual_timer_start( 0 ); // Clears the interrupt
+
+    total += latency;
+    if (latency > worst) worst = latency;
+  }
+
+  route_core_timer( source, false );
+
+  if (ws->bound) Task_UnbindInterrupt( source );
+
+  ws->latency = total;
+  ws->worst = worst;
+  ws->stop = true;
+
+  Task_EndTask();
+}
+
+static uint32_t new_pipe( uint32_t max_block )
+{
+  uint32_t pipe = PipeOp_CreateForTransfer( max_block );
+  if (pipe == 0) asm ( "udf 1" );
+  PipeOp_SetSender( pipe, 0 );
+  PipeOp_SetReceiver( pipe, 0 );
+  return pipe;
+}
+
+static void bench_swis()
+{
+  stamp start = now();
+  for (int i = 0; i < ITERATIONS; i++) {
+    asm volatile ( "svc 0x80c81" : : : "lr", "cc", "memory" );
+  }
+  report( "swi_module", 0, ITERATIONS, start );
+
+  start = now();
+  for (int i = 0; i < ITERATIONS; i++) {
+    Task_ReadAppTop();
+  }
+  report( "swi_ostask", 0, ITERATIONS, start );
+
+  start = now();
+  for (int i = 0; i < ITERATIONS; i++) {
+    asm volatile ( "svc 0x80c82" : : : "lr", "cc", "memory" );
+  }
+  report( "queue_roundtrip", 0, ITERATIONS, start );
+}
+
+// Parameter: 0 - nothing else to run, 1 - partner in the same slot,
+// 2 - partner in another slot (includes the slot switch)
+static void bench_yield( workspace *ws )
+{
+  stamp start = now();
+  for (int i = 0; i < ITERATIONS; i++) {
+    Task_Yield();
+  }
+  report( "yield", 0, ITERATIONS, start );
+
+  for (int slots = 1; slots <= 2; slots++) {
+    ws->stop = false;
+    start_partner( yielder, ws, 0, slots == 2 );
+    Task_Yield(); // Let it get going
+
+    start = now();
+    for (int i = 0; i < ITERATIONS; i++) {
+      Task_Yield();
+    }
+    report( "yield_pingpong", slots, ITERATIONS, start );
+
+    ws->stop = true;
+    Task_Sleep( 10 );
+  }
+}
+
+// Parameter: number of tasks claiming the lock
+static void bench_locks( workspace *ws, uint32_t cores )
+{
+  stamp start = now();
+  for (int i = 0; i < ITERATIONS; i++) {
+    Task_LockClaim( &ws->lock );
+    Task_LockRelease( &ws->lock );
+  }
+  report( "lock", 1, ITERATIONS, start );
+
+  if (cores < 2) return;
+
+  ws->stop = false;
+  start_partner( locker, ws, 1, false );
+  Task_Sleep( 1 );
+
+  start = now();
+  for (int i = 0; i < ITERATIONS; i++) {
+    Task_LockClaim( &ws->lock );
+    Task_LockRelease( &ws->lock );
+  }
+  report( "lock", 2, ITERATIONS, start );
+
+  ws->stop = true;
+  Task_Sleep( 10 );
+}
+
+// Parameter: the partner's core
+static void bench_pipe_pingpong( workspace *ws, uint32_t core )
+{
+  ws->to = new_pipe( 4096 );
+  ws->fro = new_pipe( 4096 );
+
+  start_partner( echo, ws, core, false );
+
+  stamp start = now();
+  for (int i = 0; i < ITERATIONS; i++) {
+    PipeSpace space = PipeOp_WaitForSpace( ws->to, 4 );
+    *(uint32_t*) space.location = i;
+    PipeOp_SpaceFilled( ws->to, 4 );
+    PipeOp_WaitForData( ws->fro, 4 );
+    PipeOp_DataConsumed( ws->fro, 4 );
+  }
+  report( "pipe_pingpong", core, ITERATIONS, start );
+
+  Task_Sleep( 10 );
+}
+
+// Parameter: block size in bytes
+static void bench_pipe_throughput( workspace *ws, uint32_t block,
+                                   uint32_t core )
+{
+  ws->to = new_pipe( 4096 );
+  ws->block = block;
+
+  start_partner( sender, ws, core, false );
+
+  stamp start = now();
+  for (uint32_t received = 0; received < PIPE_BYTES;) {
+    PipeSpace data = PipeOp_WaitForData( ws->to, block );
+    PipeOp_DataConsumed( ws->to, data.available );
+    received += data.available;
+  }
+  report( "pipe_throughput", block, PIPE_BYTES / block, start );
+
+  Task_Sleep( 10 );
+}
+
+// Parameter: 0 - formatted by the caller, as text, 1 - Task_LogF record,
+// formatted by the log reader. The same line, each time.
+static void bench_log()
+{
+  stamp start = now();
+  for (int i = 0; i < LOG_LINES; i++) {
+    Task_LogString( "bench log ", 10 );
+    Task_LogHex( i );
+    Task_Space();
+    Task_LogSmallNumber( i );
+    Task_Space();
+    Task_LogHex( start.ticks );
+    Task_Space();
+    Task_LogSmallNumber( start.ticks );
+    Task_LogNewLine();
+  }
+  report( "log", 0, LOG_LINES, start );
+
+  Task_Sleep( 100 ); // Let the log empty
+
+  start = now();
+  for (int i = 0; i < LOG_LINES; i++) {
+    Task_LogF( "bench log %x %d %x %d\n", i, i, start.ticks, start.ticks );
+  }
+  report( "log", 1, LOG_LINES, start );
+
+  Task_Sleep( 100 );
+}
+
+// Parameter: 0 - woken through the QA7 module, 1 - bound to the
+// interrupt source, woken by the kernel
+static void bench_irq_latency( workspace *ws, uint32_t core )
+{
+  pmu_counts const none = { };
+
+  for (int bound = 0; bound <= 1; bound++) {
+    ws->bound = bound;
+    ws->stop = false;
+
+    start_partner( timer_waiter, ws, core, false );
+
+    while (!ws->stop) Task_Sleep( 100 );
+
+    log_result( "irq_latency", bound, IRQ_SAMPLES, ws->latency, &none );
+    log_result( "irq_latency_max", bound, 1, ws->worst, &none );
+
+    Task_Sleep( 10 );
+  }
+}
+
+// The kernel's per-core timers: from each Task_SleepUntil deadline to the
+// benchmark task running again (on whichever core picks it up).
+static void bench_timer_latency()
+{
+  pmu_counts const none = { };
+
+  uint32_t const delay = Task_TimeFrequency() / 1000;
+
+  uint32_t total = 0;
+  uint32_t worst = 0;
+
+  for (int i = 0; i < IRQ_SAMPLES; i++) {
+    uint64_t deadline = Task_Time() + delay;
+
+    if (0 != Task_SleepUntil( deadline )) return; // Not available
+
+    uint32_t latency = Task_Time() - deadline;
+
+    total += latency;
+    if (latency > worst) worst = latency;
+  }
+
+  log_result( "timer_latency", 0, IRQ_SAMPLES, total, &none );
+  log_result( "timer_latency_max", 0, 1, worst, &none );
+}
+
+void __attribute__(( noinline )) c_init( workspace **private,
+                                         char const *env,
+                                         uint32_t instantiation )
+{
+  workspace *ws = rma_claim( sizeof( workspace ) );
+  memset( ws, 0, sizeof( workspace ) );
+  *private = ws;
+
+  ws->queue = Task_QueueCreate();
+
+  swi_handlers handlers = { };
+  handlers.action[0].code = enable_counters;
+  handlers.action[1].code = null_swi;
+  handlers.action[2].queue = ws->queue;
+  handlers.action[3].code = virtual_timer;
+
+  static uint32_t const stack_size = 256;
+  uint8_t *stack = rma_claim( stack_size );
+  Task_CreateTask1( server, aligned_stack( stack + stack_size ), ws->queue );
+
+  Task_RegisterSWIHandlers( &handlers );
+}
+
+void __attribute__(( naked )) init()
+{
+  register struct workspace **private asm ( "r12" );
+  register char const *env asm ( "r10" );
+  register uint32_t instantiation asm ( "r11" );
+
+  // Move r12 into argument register
+  asm volatile ( "push { lr }" );
+
+  c_init( private, env, instantiation );
+
+  asm ( "pop { pc }" );
+}
+
+void __attribute__(( noinline, noreturn )) go( workspace *ws )
+{
+  core_info cores = Task_Cores();
+
+  for (int i = cores.total - 1; i >= 0; i--) {
+    Task_SwitchToCore( i );
+    asm volatile ( "svc 0x80c80" : : : "lr", "cc", "memory" );
+  }
+  // Now on core 0
+
+  static uint32_t const events[4] = {
+    PMU_L1D_CACHE_REFILL,
+    PMU_L1D_TLB_REFILL,
+    PMU_BR_MIS_PRED,
+    PMU_L2D_CACHE_REFILL };
+
+  if (0 != Task_PMUConfigure( PMU_CYCLES | 15, events, 0 )) {
+    Task_PMUConfigure( PMU_CYCLES, events, 0 );
+  }
+
+  // Let the rest of the system settle
+  Task_Sleep( 1000 );
+
+  uint32_t hz;
+  asm ( "mrc p15, 0, %[hz], c14, c0, 0" : [hz] "=r" (hz) );
+
+  Task_LogString( "BENCH start ", 12 );
+  Task_LogSmallNumber( hz );
+  Task_Space();
+  Task_LogSmallNumber( cores.total );
+  Task_LogNewLine();
+
+  bench_swis();
+  bench_yield( ws );
+  bench_locks( ws, cores.total );
+
+  bench_pipe_pingpong( ws, 0 );
+  if (cores.total > 1) bench_pipe_pingpong( ws, 1 );
+
+  uint32_t other = (cores.total > 1) ? 1 : 0;
+  bench_pipe_throughput( ws, 16, other );
+  bench_pipe_throughput( ws, 256, other );
+  bench_pipe_throughput( ws, 4096, other );
+
+  bench_log();
+
+  bench_irq_latency( ws, other );
+  bench_timer_latency();
+
+  Task_LogString( "BENCH end", 9 );
+  Task_LogNewLine();
+
+  for (;;) Task_Sleep( 1000000 );
+}
+
+void __attribute__(( naked )) start()
+{
+  register workspace *ws asm ( "r12" );
+
+  // Running in usr32 mode, no stack
+  asm ( "mov r0, #0x9000"
+    "\n  svc %[settop]"
+    "\n  mov sp, r0"
+    :
+    : [settop] "i" (OSTask_AppMemoryTop)
+    : "r0" );
+
+  go( ws );
+
+  __builtin_unreachable();
+}
@@ -0,0 +1,51 @@
+/* Copyright 2025 Simon Willcocks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// A module that listens for one service call, and ignores it.
+// Used in large numbers (instances) to test service call dispatch.
+
+#include "CK_types.h"
+#include "ostaskops.h"
+
+#define MODULE_CHUNK "0"
+
+const unsigned module_flags = 3;
+// Bit 0: 32-bit compatible
+// Bit 1: Initialisation may run alongside that of other modules
+
+#include "module.h"
+
+NO_start;
+NO_init;
+NO_finalise;
+//NO_service_call; See SERVICE_TABLE, below
+//NO_title;
+//NO_help;
+NO_keywords;
+NO_swi_handler;
+NO_swi_names;
+NO_swi_decoder;
+NO_messages_file;
+
+const char title[] = "Listener";
+const char help[] = "Listener\t0.01 (" CREATION_DATE ")";
+
+void __attribute__(( naked )) mode_change()
+{
+  asm ( "bx lr" );
+}
+
+// Service_ModeChange
+SERVICE_TABLE( mode_change, "0x46" );
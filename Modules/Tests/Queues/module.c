@@ -0,0 +1,250 @@
+/* Copyright 2025 Simon Willcocks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Queue throughput test.
+// Four SWIs, each routed to its own queue and served by its own task.
+// One client task per core calls "its" SWI as fast as it can. Since
+// nothing is shared between the clients, the number of SWIs handled
+// per second on each core should be (roughly) independent of the
+// number of cores in use.
+// Build with -DHANDLER_POOL to route all four SWIs to a single queue,
+// served by a pool of four tasks instead; each call should be handled
+// by the task that last handled a call from the same core.
+// The queue statistics (delay before a handler took the call and the
+// time until it released the caller) are logged every second.
+
+#include "CK_types.h"
+#include "ostaskops.h"
+
+typedef struct workspace workspace;
+
+#define MODULE_CHUNK "0x8080"
+
+const unsigned module_flags = 1;
+// Bit 0: 32-bit compatible
+
+#include "module.h"
+
+//NO_start;
+//NO_init;
+NO_finalise;
+NO_service_call;
+//NO_title;
+//NO_help;
+NO_keywords;
+NO_swi_handler;
+NO_swi_names;
+NO_swi_decoder;
+NO_messages_file;
+
+const char title[] = "Queues";
+const char help[] = "Queues test\t0.01 (" CREATION_DATE ")";
+
+#define SERVERS 4
+
+#ifdef HANDLER_POOL
+#define QUEUES 1
+#else
+#define QUEUES SERVERS
+#endif
+
+struct workspace {
+  // Each count in its own cache line
+  struct {
+    uint32_t volatile count;
+    uint32_t pad[15];
+  } client[SERVERS];
+  uint32_t queue[QUEUES];
+};
+
+void server( uint32_t handle, uint32_t queue )
+{
+  for (;;) {
+    queued_task client = Task_QueueWait( queue );
+
+    // Nothing to do but return to the caller; this is a test of the
+    // queue overhead.
+    Task_ReleaseTask( client.task_handle, 0 );
+  }
+}
+
+static inline void call_queued_swi( uint32_t n )
+{
+  switch (n) {
+  case 0: asm volatile ( "svc 0x8080" : : : "lr", "cc", "memory" ); break;
+  case 1: asm volatile ( "svc 0x8081" : : : "lr", "cc", "memory" ); break;
+  case 2: asm volatile ( "svc 0x8082" : : : "lr", "cc", "memory" ); break;
+  case 3: asm volatile ( "svc 0x8083" : : : "lr", "cc", "memory" ); break;
+  }
+}
+
+void client( uint32_t handle, uint32_t n, workspace *ws )
+{
+  Task_SwitchToCore( n );
+
+  uint32_t volatile *count = &ws->client[n].count;
+
+  for (;;) {
+    call_queued_swi( n );
+    (*count)++;
+  }
+}
+
+static void start_task( void *code, uint32_t stack_size,
+                        uint32_t r1, uint32_t r2 )
+{
+  uint8_t *stack = rma_claim( stack_size );
+
+  register void *start asm( "r0" ) = code;
+  register uint32_t sp asm( "r1" ) = aligned_stack( stack + stack_size );
+  register uint32_t a1 asm( "r2" ) = r1;
+  register uint32_t a2 asm( "r3" ) = r2;
+  register uint32_t handle asm( "r0" );
+  asm volatile (
+        "svc %[swi_create]"
+    "\n  mov r1, #0"
+    "\n  svc %[swi_release]"
+    : "=r" (sp)
+    , "=r" (handle)
+    : [swi_create] "i" (OSTask_Create)
+    , [swi_release] "i" (OSTask_ReleaseTask)
+    , "r" (start)
+    , "r" (sp)
+    , "r" (a1)
+    , "r" (a2)
+    : "lr", "cc" );
+}
+
+void __attribute__(( noinline )) c_init( workspace **private,
+                                         char const *env,
+                                         uint32_t instantiation )
+{
+  workspace *ws = rma_claim( sizeof( workspace ) );
+  memset( ws, 0, sizeof( workspace ) );
+  *private = ws;
+
+  swi_handlers handlers = { };
+
+  for (int i = 0; i < QUEUES; i++) {
+    ws->queue[i] = Task_QueueCreate();
+  }
+
+  for (int i = 0; i < SERVERS; i++) {
+    uint32_t queue = ws->queue[i % QUEUES];
+    handlers.action[i].queue = queue;
+    start_task( server, 256, queue, 0 );
+  }
+
+  Task_RegisterSWIHandlers( &handlers );
+}
+
+void __attribute__(( naked )) init()
+{
+  register struct workspace **private asm ( "r12" );
+  register char const *env asm ( "r10" );
+  register uint32_t instantiation asm ( "r11" );
+
+  // Move r12 into argument register
+  asm volatile ( "push { lr }" );
+
+  c_init( private, env, instantiation );
+
+  asm ( "pop { pc }" );
+}
+
+static void log_statistics( uint32_t queue )
+{
+  queue_statistics stats;
+
+  if (0 != Task_QueueStatistics( queue, &stats, true )) return;
+
+  uint32_t ticks_per_us = stats.ticks_per_second / 1000000;
+  if (ticks_per_us == 0) ticks_per_us = 1;
+
+  // The statistics are reset every second, so the totals fit in 32 bits
+  // (and there's no 64-bit division without libgcc).
+  uint32_t total_delay = stats.total_delay;
+  uint32_t total_service = stats.total_service;
+
+  Task_LogString( "  handled", 0 );
+  Task_Space();
+  Task_LogSmallNumber( stats.handled );
+  Task_LogString( " blocked", 0 );
+  Task_Space();
+  Task_LogSmallNumber( stats.blocked );
+  if (stats.handled != 0) {
+    Task_LogString( " delay (us) mean", 0 );
+    Task_Space();
+    Task_LogSmallNumber( total_delay / stats.handled / ticks_per_us );
+    Task_LogString( " max", 0 );
+    Task_Space();
+    Task_LogSmallNumber( stats.max_delay / ticks_per_us );
+  }
+  if (stats.completed != 0) {
+    Task_LogString( " service (us) mean", 0 );
+    Task_Space();
+    Task_LogSmallNumber( total_service / stats.completed / ticks_per_us );
+    Task_LogString( " max", 0 );
+    Task_Space();
+    Task_LogSmallNumber( stats.max_service / ticks_per_us );
+  }
+  Task_LogNewLine();
+}
+
+void __attribute__(( noinline, noreturn )) go( workspace *ws )
+{
+  core_info cores = Task_Cores();
+  uint32_t clients = cores.total < SERVERS ? cores.total : SERVERS;
+
+  for (int i = 0; i < clients; i++) {
+    start_task( client, 256, i, (uint32_t) ws );
+  }
+
+  uint32_t last[SERVERS] = { 0 };
+
+  for (;;) {
+    Task_Sleep( 1000 );
+
+    Task_LogString( "Queued SWIs per second:", 0 );
+    for (int i = 0; i < clients; i++) {
+      uint32_t now = ws->client[i].count;
+      Task_Space();
+      Task_LogSmallNumber( now - last[i] );
+      last[i] = now;
+    }
+    Task_LogNewLine();
+
+    for (int i = 0; i < QUEUES; i++) {
+      log_statistics( ws->queue[i] );
+    }
+  }
+}
+
+void __attribute__(( naked )) start()
+{
+  register workspace *ws asm ( "r12" );
+
+  // Running in usr32 mode, no stack
+  asm ( "mov r0, #0x9000"
+    "\n  svc %[settop]"
+    "\n  mov sp, r0"
+    :
+    : [settop] "i" (OSTask_AppMemoryTop)
+    : "r0" );
+
+  go( ws );
+
+  __builtin_unreachable();
+}
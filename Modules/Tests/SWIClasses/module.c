@@ -0,0 +1,196 @@
+/* Copyright 2025 Simon Willcocks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Null SWI round trip rate for each class of SWI that execute_swi
+// distinguishes:
+//   OSTask SWIs (OSTask_Yield, with nothing else to run on the core),
+//   OSTask SWIs that do a little work (Task_LogString of nothing),
+//   module SWIs with registered handlers (this module's null SWI),
+//   legacy SWIs, run on the legacy stack (OS_Byte 0, 1).
+// One client task per class, each on its own core (if there are enough),
+// calls its SWI as fast as it can.
+
+#include "CK_types.h"
+#include "ostaskops.h"
+
+typedef struct workspace workspace;
+
+#define MODULE_CHUNK "0x80c40"
+
+const unsigned module_flags = 1;
+// Bit 0: 32-bit compatible
+
+#include "module.h"
+
+//NO_start;
+//NO_init;
+NO_finalise;
+NO_service_call;
+//NO_title;
+//NO_help;
+NO_keywords;
+NO_swi_handler;
+NO_swi_names;
+NO_swi_decoder;
+NO_messages_file;
+
+const char title[] = "SWIClasses";
+const char help[] = "SWIClasses\t0.01 (" CREATION_DATE ")";
+
+enum { YIELD, LOG_STRING, MODULE_SWI, LEGACY_SWI, CLASSES };
+
+static char const *const class_name[CLASSES] = {
+  "OSTask_Yield", "Task_LogString", "Module SWI", "OS_Byte" };
+
+struct workspace {
+  // Each count in its own cache line
+  struct {
+    uint32_t volatile count;
+    uint32_t pad[15];
+  } client[CLASSES];
+};
+
+void null_swi( svc_registers *regs, void *ws, int core, uint32_t task )
+{
+}
+
+void client( uint32_t handle, uint32_t n, workspace *ws )
+{
+  core_info cores = Task_Cores();
+  Task_SwitchToCore( n % cores.total );
+
+  uint32_t volatile *count = &ws->client[n].count;
+
+  for (;;) {
+    switch (n) {
+    case YIELD:
+      Task_Yield();
+      break;
+    case LOG_STRING:
+      Task_LogString( "", 0 );
+      break;
+    case MODULE_SWI:
+      asm volatile ( "svc 0x80c40" : : : "lr", "cc", "memory" );
+      break;
+    case LEGACY_SWI:
+      {
+        register uint32_t reason asm ( "r0" ) = 0;
+        register uint32_t x asm ( "r1" ) = 1;
+        asm volatile ( "svc 0x20006" // XOS_Byte
+            : "=r" (reason)
+            , "=r" (x)
+            : "r" (reason)
+            , "r" (x)
+            : "r2", "lr", "cc", "memory" );
+      }
+      break;
+    }
+    (*count)++;
+  }
+}
+
+static void start_task( void *code, uint32_t stack_size,
+                        uint32_t r1, uint32_t r2 )
+{
+  uint8_t *stack = rma_claim( stack_size );
+
+  register void *start asm( "r0" ) = code;
+  register uint32_t sp asm( "r1" ) = aligned_stack( stack + stack_size );
+  register uint32_t a1 asm( "r2" ) = r1;
+  register uint32_t a2 asm( "r3" ) = r2;
+  register uint32_t handle asm( "r0" );
+  asm volatile (
+        "svc %[swi_create]"
+    "\n  mov r1, #0"
+    "\n  svc %[swi_release]"
+    : "=r" (sp)
+    , "=r" (handle)
+    : [swi_create] "i" (OSTask_Create)
+    , [swi_release] "i" (OSTask_ReleaseTask)
+    , "r" (start)
+    , "r" (sp)
+    , "r" (a1)
+    , "r" (a2)
+    : "lr", "cc" );
+}
+
+void __attribute__(( noinline )) c_init( workspace **private,
+                                         char const *env,
+                                         uint32_t instantiation )
+{
+  workspace *ws = rma_claim( sizeof( workspace ) );
+  memset( ws, 0, sizeof( workspace ) );
+  *private = ws;
+
+  swi_handlers handlers = { };
+  handlers.action[0].code = null_swi;
+
+  Task_RegisterSWIHandlers( &handlers );
+}
+
+void __attribute__(( naked )) init()
+{
+  register struct workspace **private asm ( "r12" );
+  register char const *env asm ( "r10" );
+  register uint32_t instantiation asm ( "r11" );
+
+  // Move r12 into argument register
+  asm volatile ( "push { lr }" );
+
+  c_init( private, env, instantiation );
+
+  asm ( "pop { pc }" );
+}
+
+void __attribute__(( noinline, noreturn )) go( workspace *ws )
+{
+  for (int i = 0; i < CLASSES; i++) {
+    start_task( client, 256, i, (uint32_t) ws );
+  }
+
+  uint32_t last[CLASSES] = { 0 };
+
+  for (;;) {
+    Task_Sleep( 1000 );
+
+    // One line per class, per second: "SWIs per second: <class> <count>"
+    for (int i = 0; i < CLASSES; i++) {
+      uint32_t now = ws->client[i].count;
+      Task_LogString( "SWIs per second: ", 0 );
+      Task_LogString( class_name[i], 0 );
+      Task_Space();
+      Task_LogSmallNumber( now - last[i] );
+      Task_LogNewLine();
+      last[i] = now;
+    }
+  }
+}
+
+void __attribute__(( naked )) start()
+{
+  register workspace *ws asm ( "r12" );
+
+  // Running in usr32 mode, no stack
+  asm ( "mov r0, #0x9000"
+    "\n  svc %[settop]"
+    "\n  mov sp, r0"
+    :
+    : [settop] "i" (OSTask_AppMemoryTop)
+    : "r0" );
+
+  go( ws );
+
+  __builtin_unreachable();
+}
@@ -0,0 +1,184 @@
+/* Copyright 2025 Simon Willcocks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Module SWI dispatch rate test.
+// The SWI does nothing, in SVC mode, so the rate is dominated by the
+// cost of finding the module that provides it. The test system loads
+// over a hundred modules before this one.
+// One client task per core calls the SWI as fast as it can.
+// Built with -DSERVICE_CALLS=<service number>, the clients issue that
+// service call instead. The modules loaded before this one are
+// instances of Listener, which only handles Service_ModeChange (0x46).
+
+#include "CK_types.h"
+#include "ostaskops.h"
+
+typedef struct workspace workspace;
+
+#define MODULE_CHUNK "0x80c0"
+
+const unsigned module_flags = 1;
+// Bit 0: 32-bit compatible
+
+#include "module.h"
+
+//NO_start;
+//NO_init;
+NO_finalise;
+NO_service_call;
+//NO_title;
+//NO_help;
+NO_keywords;
+NO_swi_handler;
+NO_swi_names;
+NO_swi_decoder;
+NO_messages_file;
+
+const char title[] = "SWIDispatch";
+const char help[] = "SWIDispatch\t0.01 (" CREATION_DATE ")";
+
+#define CLIENTS 4
+
+struct workspace {
+  // Each count in its own cache line
+  struct {
+    uint32_t volatile count;
+    uint32_t pad[15];
+  } client[CLIENTS];
+};
+
+void null_swi( svc_registers *regs, void *ws, int core, uint32_t task )
+{
+}
+
+void client( uint32_t handle, uint32_t n, workspace *ws )
+{
+  Task_SwitchToCore( n );
+
+  uint32_t volatile *count = &ws->client[n].count;
+
+  for (;;) {
+#ifdef SERVICE_CALLS
+    register uint32_t service asm ( "r1" ) = SERVICE_CALLS;
+    asm volatile ( "svc %[swi]"
+        : "=r" (service)
+        : [swi] "i" (OS_ServiceCall | Xbit)
+        , "r" (service)
+        : "lr", "cc", "memory" );
+#else
+    asm volatile ( "svc 0x80c0" : : : "lr", "cc", "memory" );
+#endif
+    (*count)++;
+  }
+}
+
+static void start_task( void *code, uint32_t stack_size,
+                        uint32_t r1, uint32_t r2 )
+{
+  uint8_t *stack = rma_claim( stack_size );
+
+  register void *start asm( "r0" ) = code;
+  register uint32_t sp asm( "r1" ) = aligned_stack( stack + stack_size );
+  register uint32_t a1 asm( "r2" ) = r1;
+  register uint32_t a2 asm( "r3" ) = r2;
+  register uint32_t handle asm( "r0" );
+  asm volatile (
+        "svc %[swi_create]"
+    "\n  mov r1, #0"
+    "\n  svc %[swi_release]"
+    : "=r" (sp)
+    , "=r" (handle)
+    : [swi_create] "i" (OSTask_Create)
+    , [swi_release] "i" (OSTask_ReleaseTask)
+    , "r" (start)
+    , "r" (sp)
+    , "r" (a1)
+    , "r" (a2)
+    : "lr", "cc" );
+}
+
+void __attribute__(( noinline )) c_init( workspace **private,
+                                         char const *env,
+                                         uint32_t instantiation )
+{
+  workspace *ws = rma_claim( sizeof( workspace ) );
+  memset( ws, 0, sizeof( workspace ) );
+  *private = ws;
+
+  swi_handlers handlers = { };
+  handlers.action[0].code = null_swi;
+
+  Task_RegisterSWIHandlers( &handlers );
+}
+
+void __attribute__(( naked )) init()
+{
+  register struct workspace **private asm ( "r12" );
+  register char const *env asm ( "r10" );
+  register uint32_t instantiation asm ( "r11" );
+
+  // Move r12 into argument register
+  asm volatile ( "push { lr }" );
+
+  c_init( private, env, instantiation );
+
+  asm ( "pop { pc }" );
+}
+
+void __attribute__(( noinline, noreturn )) go( workspace *ws )
+{
+  core_info cores = Task_Cores();
+  uint32_t clients = cores.total < CLIENTS ? cores.total : CLIENTS;
+
+  for (int i = 0; i < clients; i++) {
+    start_task( client, 256, i, (uint32_t) ws );
+  }
+
+  uint32_t last[CLIENTS] = { 0 };
+
+  for (;;) {
+    Task_Sleep( 1000 );
+
+#ifdef SERVICE_CALLS
+    Task_LogString( "Service calls per second:", 0 );
+#else
+    Task_LogString( "Module SWIs per second:", 0 );
+#endif
+    for (int i = 0; i < clients; i++) {
+      uint32_t now = ws->client[i].count;
+      Task_Space();
+      Task_LogSmallNumber( now - last[i] );
+      last[i] = now;
+    }
+    Task_LogNewLine();
+  }
+}
+
+void __attribute__(( naked )) start()
+{
+  register workspace *ws asm ( "r12" );
+
+  // Running in usr32 mode, no stack
+  asm ( "mov r0, #0x9000"
+    "\n  svc %[settop]"
+    "\n  mov sp, r0"
+    :
+    : [settop] "i" (OSTask_AppMemoryTop)
+    : "r0" );
+
+  go( ws );
+
+  __builtin_unreachable();
+}
@@ -0,0 +1,125 @@
+/* Copyright 2025 Simon Willcocks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// PL011UART test, see Tests/Serial.
+// Sends a block of text larger than the driver's output pipe (so the
+// sender has to wait for the transmit interrupts), then echoes anything
+// received, through the receive interrupts.
+
+#include "CK_types.h"
+#include "ostaskops.h"
+
+typedef struct workspace workspace;
+
+#define MODULE_CHUNK "0"
+
+const unsigned module_flags = 1;
+// Bit 0: 32-bit compatible
+
+#include "module.h"
+
+//NO_start;
+NO_init;
+NO_finalise;
+NO_service_call;
+//NO_title;
+//NO_help;
+NO_keywords;
+NO_swi_handler;
+NO_swi_names;
+NO_swi_decoder;
+NO_messages_file;
+
+const char title[] = "Serial";
+const char help[] = "Serial test\t0.01 (" CREATION_DATE ")";
+
+#define LINES 100
+
+static void send( uint32_t pipe, char const *text, uint32_t length )
+{
+  while (length != 0) {
+    PipeSpace space = PipeOp_WaitForSpace( pipe, 1 );
+
+    uint32_t n = (space.available < length) ? space.available : length;
+    char *dest = space.location;
+    for (int i = 0; i < n; i++) dest[i] = text[i];
+
+    PipeOp_SpaceFilled( pipe, n );
+    text += n;
+    length -= n;
+  }
+}
+
+void __attribute__(( noinline, noreturn )) go()
+{
+  register uint32_t output asm ( "r0" );
+  register uint32_t input asm ( "r1" );
+
+  // SWI PL011UART_Pipes
+  do {
+    Task_Sleep( 10 );
+    asm volatile ( "svc 0x10c0"
+      : "=r" (output)
+      , "=r" (input)
+      :
+      : "lr", "cc", "memory" );
+  } while (output == 0);
+
+  uint32_t out = output;
+  uint32_t in = input;
+
+  char const greeting[] = "PL011UART test\r\n";
+  send( out, greeting, sizeof( greeting ) - 1 );
+
+  // About 6KB, more than the output pipe holds
+  char line[] = "00 abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ\r\n";
+  for (int i = 0; i < LINES; i++) {
+    line[0] = '0' + (i / 10) % 10;
+    line[1] = '0' + i % 10;
+    send( out, line, sizeof( line ) - 1 );
+  }
+
+  char const prompt[] = "Type something, it should be echoed\r\n";
+  send( out, prompt, sizeof( prompt ) - 1 );
+
+  for (;;) {
+    PipeSpace data = PipeOp_WaitForData( in, 1 );
+    char const *received = data.location;
+
+    for (int i = 0; i < data.available; i++) {
+      if (received[i] == '\r')
+        send( out, "\r\n", 2 );
+      else
+        send( out, &received[i], 1 );
+    }
+
+    PipeOp_DataConsumed( in, data.available );
+  }
+}
+
+void __attribute__(( naked )) start()
+{
+  // Running in usr32 mode, no stack
+  asm ( "mov r0, #0x9000"
+    "\n  svc %[settop]"
+    "\n  mov sp, r0"
+    :
+    : [settop] "i" (OSTask_AppMemoryTop)
+    : "r0" );
+
+  go();
+
+  __builtin_unreachable();
+}
@@ -26,7 +26,7 @@
  * start (function)
  * init (function)
  * finalise (function)
- * service_call (function)
+ * service_call (function, or see SERVICE_TABLE)
  * title (const char [])
  * help (const char [])
  * keywords (has to be done in assembler, afaics)
@@ -119,6 +119,26 @@ asm ( "keywords:"
  "\n  .word 0"
 */
 
+// A module that is only interested in a few service calls can list them,
+// in ascending order, in a RISC OS 4 style service table instead of
+// providing a service_call function, and its handler will only be called
+// for those services. The handler is entered with the usual registers
+// (r1 = service number, r12 -> private word), and returns with bx lr.
+//   SERVICE_TABLE( mode_change_handler, "0x46, 0x4d" );
+#define SERVICE_TABLE( handler, services ) \
+asm ( ".pushsection .text" \
+  "\n  .align 2" \
+  "\nservice_table:" \
+  "\n  .word 0" \
+  "\n  .word " #handler "-header" \
+  "\n  .word " services \
+  "\n  .word 0" \
+  "\n  .word service_table-header" \
+  "\nservice_call:" \
+  "\n  mov r0, r0" \
+  "\n  b " #handler \
+  "\n.popsection" )
+
 #define C_SWI_HANDLER( cfn ) \
 typedef struct { \
   uint32_t r[10]; \
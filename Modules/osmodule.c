@@ -95,6 +95,9 @@ struct module {
   module *base;                 // Base instance of this module
   module *preferred;            // Preferred instance (=this, if none)
   swi_handlers *handlers;       // NULL for legacy modules
+  uint32_t number;              // Position in shared.module.modules
+  uint32_t init_task;           // Running the initialisation code, or 0
+  module *next_in_init;         // See shared.module.in_init
   char postfix[];
 };
 
@@ -110,7 +113,7 @@ module *new_module( module_header *header, char const *postfix )
     if (base == 0) PANIC; // Not sure what to do in this case
   }
 
-  module *result = system_heap_allocate( sizeof( *header ) + size + 1 );
+  module *result = system_heap_allocate( sizeof( module ) + size + 1 );
   if (result == (void*) 0xffffffff) PANIC;
 
   for (int i = 0; i < size; i++) result->postfix[i] = postfix[i];
@@ -122,6 +125,8 @@ module *new_module( module_header *header, char const *postfix )
   result->instances = 0;
   result->handlers = 0;
   result->preferred = 0;
+  result->init_task = 0;
+  result->next_in_init = 0;
 
   if (size == 0) { // No postfix
     result->base = 0;
@@ -142,9 +147,73 @@ module *new_module( module_header *header, char const *postfix )
   return result;
 }
 
+// SWI chunks occupy bits 6-19 of the SWI number, except bit 17 (the X
+// bit). Bits 18 and 19 select one of four tables of 2048 entries (bits
+// 6-16), which are allocated as needed. In practice, only the first.
+// Chunks with any other bits set are simply searched for.
+
+static inline bool chunk_indexable( uint32_t chunk )
+{
+  return chunk != 0 && (chunk & ~0x000dffc0) == 0;
+}
+
+static inline uint32_t chunk_table( uint32_t chunk )
+{
+  return (chunk >> 18) & 3;
+}
+
+static inline uint32_t chunk_entry( uint32_t chunk )
+{
+  return (chunk >> 6) & 0x7ff;
+}
+
+static void index_module_chunk( module *m )
+{
+  uint32_t chunk = m->header->swi_chunk;
+
+  if (!chunk_indexable( chunk )) return;
+
+  module **table = shared.module.chunks[chunk_table( chunk )];
+
+  if (table == 0) {
+    uint32_t size = 2048 * sizeof( module * );
+    table = system_heap_allocate( size );
+    if (table == 0) PANIC;
+    memset( table, 0, size );
+    // Other cores may be looking up SWIs
+    ensure_changes_observable();
+    shared.module.chunks[chunk_table( chunk )] = table;
+  }
+
+  // The first module to provide a chunk keeps it. Instances share the
+  // entry of their base module, the preferred instance is chosen when
+  // the SWI is called.
+  module **entry = &table[chunk_entry( chunk )];
+  if (*entry == 0) {
+    *entry = (m->base == 0) ? m : m->base;
+
+    // The module's initialisation code has already been run, so any
+    // handlers will have been registered by now.
+    if ((*entry)->handlers != 0) {
+      uint32_t e = chunk_entry( chunk );
+      shared.module.modern_chunks[chunk_table( chunk )][e / 32] |= 1 << (e % 32);
+    }
+    push_writes_to_cache();
+  }
+}
+
+static void index_module_services( module *m );
+static void index_module_commands( module *m );
+
 static inline
 void append_module_to_list( module *m )
 {
+  m->number = (shared.module.last == 0) ? 0 : shared.module.last->number + 1;
+
+  index_module_chunk( m );
+  index_module_services( m );
+  index_module_commands( m );
+
   if (shared.module.last != 0) {
     shared.module.last->next = m;
   }
@@ -199,6 +268,80 @@ static inline bool is_api_module( module_header const *h )
   return 0 != (4 & module_flags( h ));
 }
 
+// Bit 1 of the flags: the module's initialisation code is multi-processor
+// aware, it may run at the same time as that of other modules, on other
+// cores. Modules without it are initialised one at a time.
+static inline bool is_mp_safe_init( module_header const *h )
+{
+  return 0 != (2 & module_flags( h ));
+}
+
+// A task lock, rather than a core lock: a module's initialisation may
+// block (and resume on another core) while holding it, and the tasks
+// waiting for it must not stop their cores from running other tasks.
+// Returns true if the running task already holds the lock (i.e. a module
+// is being initialised by another module's initialisation code).
+static inline bool lock_modules()
+{
+  return Task_LockClaim( (uint32_t *) &shared.module.lock );
+}
+
+static inline void release_modules()
+{
+  Task_LockRelease( (uint32_t *) &shared.module.lock );
+}
+
+// The modules being initialised are recorded against the task running
+// the initialisation code, which may move between cores. Only held for
+// a few instructions.
+static void started_init( module *m )
+{
+  m->init_task = ostask_handle( workspace.ostask.running );
+
+  bool reclaimed = core_claim_lock( &shared.module.in_init_lock,
+                                    workspace.core + 1 );
+  assert( !reclaimed );
+
+  // In front of any module this task is already initialising
+  m->next_in_init = shared.module.in_init;
+  shared.module.in_init = m;
+
+  core_release_lock( &shared.module.in_init_lock );
+}
+
+static void finished_init( module *m )
+{
+  bool reclaimed = core_claim_lock( &shared.module.in_init_lock,
+                                    workspace.core + 1 );
+  assert( !reclaimed );
+
+  module *volatile *p = &shared.module.in_init;
+  while (*p != m) p = &(*p)->next_in_init;
+  *p = m->next_in_init;
+
+  core_release_lock( &shared.module.in_init_lock );
+
+  m->next_in_init = 0;
+  m->init_task = 0;
+}
+
+// The innermost module being initialised by the running task, or NULL
+static module *module_in_init()
+{
+  uint32_t handle = ostask_handle( workspace.ostask.running );
+
+  bool reclaimed = core_claim_lock( &shared.module.in_init_lock,
+                                    workspace.core + 1 );
+  assert( !reclaimed );
+
+  module *m = shared.module.in_init;
+  while (m != 0 && m->init_task != handle) m = m->next_in_init;
+
+  core_release_lock( &shared.module.in_init_lock );
+
+  return m;
+}
+
 // Case insensitive, nul, cr, lf, space, or % terminates.
 // So "abc" matches "abc def", "abc%ghi", etc.
 bool module_name_match( char const *left, char const *right )
@@ -227,9 +370,84 @@ bool module_name_match( char const *left, char const *right )
   return false;
 }
 
+// Case insensitive, terminated as in module_name_match.
+// Must match name_hash in Modules/rom_modules_index.
+static uint32_t module_name_hash( char const *name, uint32_t multiplier )
+{
+  uint32_t hash = 0;
+  char c;
+
+  while ((c = *name++) != 0 && c != 10 && c != 13 && c != ' ' && c != '%') {
+    if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+    hash = hash * multiplier + c;
+  }
+
+  return hash ^ (hash >> 16);
+}
+
+// Modules in a list (e.g. LegacyModulesList), indexed by title the first
+// time the list is searched. The list isn't known until the system is
+// running, so it can't be indexed at build time like the ROM modules.
+// Open addressing, the table is at least twice the number of modules.
+
+#define LIST_INDEX_MULTIPLIER 31
+
+static void index_module_list( uint32_t const *list )
+{
+  uint32_t count = 0;
+  for (uint32_t const *entry = list; *entry != 0; entry += (*entry / sizeof( uint32_t ))) {
+    count++;
+  }
+
+  uint32_t size = 16;
+  while (size < 2 * count) size = size * 2;
+
+  module_header **index = system_heap_allocate( size * sizeof( module_header * ) );
+  if (index == 0) return; // Searches will be slower, that's all
+
+  memset( index, 0, size * sizeof( module_header * ) );
+
+  for (uint32_t const *entry = list; *entry != 0; entry += (*entry / sizeof( uint32_t ))) {
+    module_header *header = (void*) (entry + 1);
+    char const *title = title_string( header );
+    if (title == 0) continue;
+    uint32_t slot = module_name_hash( title, LIST_INDEX_MULTIPLIER );
+    while (index[slot & (size - 1)] != 0) slot++;
+    index[slot & (size - 1)] = header;
+  }
+
+  shared.module.list_index_size = size;
+  shared.module.list_index = index;
+  push_writes_to_cache();
+  shared.module.indexed_list = list;
+}
+
+static module_header *find_module_in_list_index( char const *name )
+{
+  uint32_t size = shared.module.list_index_size;
+  module_header **index = shared.module.list_index;
+  uint32_t slot = module_name_hash( name, LIST_INDEX_MULTIPLIER );
+
+  module_header *header;
+  while (0 != (header = index[slot & (size - 1)])) {
+    if (module_name_match( title_string( header ), name )) return header;
+    slot++;
+  }
+
+  return 0;
+}
+
 //static 
 module_header *find_module_in_list( char const *name, uint32_t const *list )
 {
+  if (shared.module.indexed_list != list) {
+    index_module_list( list );
+  }
+
+  if (shared.module.indexed_list == list) {
+    return find_module_in_list_index( name );
+  }
+
 { char const text[] = "Looking for module ";
 Task_LogString( text, sizeof( text ) - 1 ); }
 Task_LogString( name, rostrlen( name ) );
@@ -257,11 +475,20 @@ Task_LogNewLine();
 
 module_header *find_module_in_rom( char const *name )
 {
+#ifdef ROM_MODULE_HASH_SIZE
+  // Perfect hash, see Modules/rom_modules_index
+  uint32_t hash = module_name_hash( name, ROM_MODULE_HASH_MULTIPLIER );
+  uint32_t i = rom_module_hash[hash & (ROM_MODULE_HASH_SIZE - 1)];
+  if (i != 0xffff && module_name_match( name, rom_modules[i].name )) {
+    return rom_modules[i].start;
+  }
+#else
   for (int i = 0; rom_modules[i].name != 0; i++) {
     if (module_name_match( name, rom_modules[i].name )) {
       return rom_modules[i].start;
     }
   }
+#endif
   return 0;
 }
 
@@ -274,6 +501,18 @@ static inline uint32_t bcd( char c )
 static
 int get_version( module_header const *m )
 {
+#ifdef ROM_MODULE_HASH_SIZE
+  // Versions of ROM modules are calculated at build time
+  char const *title = title_string( m );
+  if (title != 0) {
+    uint32_t hash = module_name_hash( title, ROM_MODULE_HASH_MULTIPLIER );
+    uint32_t i = rom_module_hash[hash & (ROM_MODULE_HASH_SIZE - 1)];
+    if (i != 0xffff && rom_modules[i].start == m) {
+      return rom_module_versions[i];
+    }
+  }
+#endif
+
   uint32_t bcd_version = 0;
   char const *help = help_string( m );
 
@@ -322,9 +561,11 @@ void Service_ModulePostInit( module *module )
       : "lr", "cc" );
 }
 
+// Called holding shared.module.lock, reclaimed is true if it was already
+// held when this initialisation started.
 static inline 
 error_block const *run_initialisation_code( const char *env, module *m,
-                                      uint32_t instance )
+                                      uint32_t instance, bool reclaimed )
 {
   uint32_t *code = init_code( m->header );
 
@@ -336,9 +577,15 @@ error_block const *run_initialisation_code( const char *env, module *m,
   }
 
   // Modules may initialise other modules during their initialisation.
-  module *old_in_init = shared.module.in_init;
+  started_init( m );
 
-  shared.module.in_init = m;
+  // A module initialised by another module's initialisation is run with
+  // the lock still held, so that the outer one finds it initialised.
+  bool parallel = !reclaimed && is_mp_safe_init( m->header );
+
+  if (parallel) release_modules();
+
+  boot_trace( "init", title_string( m->header ) );
 
 #ifdef DEBUG__SHOW_MODULES
   Task_LogString( "Init: ", 6 );
@@ -374,12 +621,14 @@ error_block const *run_initialisation_code( const char *env, module *m,
       , "r" (_instance)
       , "r" (environment)
       : "r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7", "r8", "r9", "memory" );
-      // Note, without "memory", the optimiser assumes shared.module.in_init
-      // cannot be changed by the code and doesn't bother updating it.
 
   // No changes to the registers by the module are of any interest,
   // so avoid corrupting any by simply not storing them
-  shared.module.in_init = old_in_init;
+  finished_init( m );
+
+  boot_trace( "initialised", title_string( m->header ) );
+
+  if (parallel) lock_modules();
 
 #ifdef DEBUG__SHOW_MODULES
   Task_LogString( "Returned from init", 0 );
@@ -413,27 +662,45 @@ error_block const *run_initialisation_code( const char *env, module *m,
 
 static module *find_module_by_chunk( uint32_t swi )
 {
-  // TODO: have a lookup table for up to 8192 modules (bits 6-16, 18, 19)?
-  // (Include a bit to indicate modernity?)
+  uint32_t chunk = swi & ~0xff00003f;
 
-  // TODO: Optimise: store the found module in workspace, but check
-  // the swi is in that chunk each time find_module_by_chunk is
-  // called. (This can all be done internal to find_module_by_chunk.)
+  module *found = workspace.module.last_chunk_module;
 
-  uint32_t chunk = swi & ~0xff00003f;
+  if (found != 0 && workspace.module.last_chunk == chunk) {
+    return found->preferred;
+  }
 
-  module *instance = shared.module.modules;
-  while (instance != 0 && instance->header->swi_chunk != chunk) {
-    instance = instance->next;
+  if (chunk_indexable( chunk )) {
+    module **table = shared.module.chunks[chunk_table( chunk )];
+    found = (table == 0) ? 0 : table[chunk_entry( chunk )];
+
+    if (found != 0) {
+      workspace.module.last_chunk = chunk;
+      workspace.module.last_chunk_module = found;
+    }
+  }
+  else {
+    found = shared.module.modules;
+    while (found != 0 && found->header->swi_chunk != chunk) {
+      found = found->next;
+    }
   }
 
-  return (instance == 0) ? 0 : instance->preferred;
+  return (found == 0) ? 0 : found->preferred;
 }
 
-// TODO: Cache these searches, you wouldn't be asking if you weren't
-// about to call it!
+// Called for every SWI outside the kernel's ranges, to decide whether it
+// needs the legacy stack. Indexed chunks are a single bit test.
 bool handler_available( uint32_t swi )
 {
+  uint32_t chunk = swi & ~0xff00003f;
+
+  if (chunk_indexable( chunk )) {
+    uint32_t e = chunk_entry( chunk );
+    uint32_t bits = shared.module.modern_chunks[chunk_table( chunk )][e / 32];
+    return 0 != (bits & (1 << (e % 32)));
+  }
+
   module *m = find_module_by_chunk( swi );
 
   return (m != 0) && (m->handlers != 0);
@@ -441,8 +708,8 @@ bool handler_available( uint32_t swi )
 
 OSTask *TaskOpRegisterSWIHandlers( svc_registers *regs )
 {
-  module *m = shared.module.in_init;
-  if (m->handlers != 0) PANIC;
+  module *m = module_in_init();
+  if (m == 0 || m->handlers != 0) PANIC;
 
   swi_handlers const *handlers = (void*) regs->r[0];
   m->handlers = system_heap_allocate( sizeof( swi_handlers ) );
@@ -648,8 +915,11 @@ error_block const *load_and_initialise( char const *name )
   Task_LogString( name, e - name );
   Task_LogNewLine();
 #endif
+  bool reclaimed = lock_modules();
+
   module_header *header = load_named_module( name );
   if (header == 0) {
+    if (!reclaimed) release_modules();
     svc_registers tmp;
     Error_ModuleNotFound( &tmp );
     return (error_block const *) tmp.r[0];
@@ -677,17 +947,125 @@ error_block const *load_and_initialise( char const *name )
     PANIC;
   }
 
-  return run_initialisation_code( name, m, number );
+  error_block const *error = run_initialisation_code( name, m, number, reclaimed );
+
+  if (!reclaimed) release_modules();
+
+  return error;
+}
+
+// Modules with a RISC OS 4 style service table are only called for the
+// services listed in it, the others are called for every service call.
+// The word before the service call entry is the offset to the table,
+// and the entry's first instruction is mov r0, r0.
+// The table consists of a flags word (zero), the offset to the handler
+// code following any rejection code, the service numbers in ascending
+// order, and a terminating zero.
+
+struct service_link {
+  module *m;
+  void *handler;
+  service_link *next;
+};
+
+struct service_entry {
+  uint32_t service;
+  service_entry *next;
+  service_link *first;
+  service_link *last;
+};
+
+static inline uint32_t service_hash( uint32_t service )
+{
+  return (service ^ (service >> 6) ^ (service >> 12)) & 63;
+}
+
+static service_entry *find_service_entry( uint32_t service, bool create )
+{
+  service_entry *volatile *entry = &shared.module.services[service_hash( service )];
+
+  while (*entry != 0 && (*entry)->service != service) {
+    entry = &(*entry)->next;
+  }
+
+  if (*entry == 0 && create) {
+    service_entry *new = system_heap_allocate( sizeof( service_entry ) );
+    if (new == 0) PANIC;
+    new->service = service;
+    new->next = 0;
+    new->first = 0;
+    new->last = 0;
+    push_writes_to_cache();
+    *entry = new;
+  }
+
+  return *entry;
+}
+
+// Modules are indexed as they are initialised, so the lists are in the
+// same order as shared.module.modules.
+static void add_service_link( service_link *volatile *first,
+                              service_link *volatile *last,
+                              module *m, void *handler )
+{
+  service_link *link = system_heap_allocate( sizeof( service_link ) );
+  if (link == 0) PANIC;
+
+  link->m = m;
+  link->handler = handler;
+  link->next = 0;
+  push_writes_to_cache();
+
+  if (*last == 0)
+    *first = link;
+  else
+    (*last)->next = link;
+  *last = link;
+}
+
+static uint32_t const *service_table( module_header const *h )
+{
+  uint32_t const *entry = service_call_handler( h );
+
+  if (entry == 0 || entry[0] != 0xe1a00000 || entry[-1] == 0) return 0;
+
+  uint32_t const *table = pointer_at_offset_from( h, entry[-1] );
+
+  // Unknown flags, treat as a module without a table
+  if (table[0] != 0) return 0;
+
+  return table;
 }
 
-static void __attribute__(( noinline )) run_service_call_handler_code( svc_registers *regs, module *m )
+static void index_module_services( module *m )
 {
   void *handler = service_call_handler( m->header );
+
   if (handler == 0) return;
 
+  uint32_t const *table = service_table( m->header );
+
+  if (table == 0) {
+    add_service_link( &shared.module.every_service,
+                      &shared.module.last_every_service,
+                      m, handler );
+  }
+  else {
+    // The service number is known to match, skip any rejection code
+    if (table[1] != 0) handler = pointer_at_offset_from( m->header, table[1] );
+
+    for (uint32_t const *service = &table[2]; *service != 0; service++) {
+      service_entry *entry = find_service_entry( *service, true );
+      add_service_link( &entry->first, &entry->last, m, handler );
+    }
+  }
+}
+
+static void __attribute__(( noinline )) run_service_call_handler_code( svc_registers *regs, void *handler, uint32_t *pw )
+{
   register void *non_kernel_code asm( "r14" ) = handler;
 
-  register uint32_t *private_word asm( "r12" ) = &m->private_word;
+  register uint32_t *private_word asm( "r12" ) = pw;
 
   // "the V set convention cannot be used" PRM 1-217
   // Ignoring the input flags and not storing the output flags.
@@ -707,25 +1085,28 @@ static void __attribute__(( noinline )) run_service_call_handler_code( svc_regis
       : "r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7", "r8" );
 }
 
-static inline void service_call( module *m, svc_registers *regs )
+static inline void service_call( service_link *link, svc_registers *regs )
 {
 #ifdef DEBUG__FOLLOW_SERVICE_CALLS
   Task_LogString( "  ", 2 );
-  Task_LogString( title_string( m->header ), 0 );
+  Task_LogString( title_string( link->m->header ), 0 );
 #endif
 
   uint32_t r12 = regs->r[12];
-  run_service_call_handler_code( regs, m );
+  run_service_call_handler_code( regs, link->handler, &link->m->private_word );
   regs->r[12] = r12;
 }
 
 OSTask *do_OS_ServiceCall( svc_registers *regs )
 {
-  module *m = shared.module.modules;
-  if (m == 0) return 0;
+  if (shared.module.modules == 0) return 0;
 
   uint32_t call = regs->r[1];
 
+  // Service_PostInit, issued by the HAL once the initial modules are
+  // initialised
+  if (call == 0x73) boot_trace_complete();
+
 #ifdef DEBUG__FOLLOW_SERVICE_CALLS
   Task_LogString( "Service call ", 13 );
   Task_LogHex( regs->r[1] );
@@ -737,23 +1118,29 @@ OSTask *do_OS_ServiceCall( svc_registers *regs )
   Task_LogNewLine();
 #endif
 
-  while (m != 0 && regs->r[1] != 0) {
-    if (0 != m->header->offset_to_service_call_handler) {
-      module *instance = m->instances;
-      if (instance == 0) {
-        service_call( m, regs );
-        assert( regs->r[1] == 0 || regs->r[1] == call );
-      }
-      else {
-        do {
-          module *next = instance->next;
-          service_call( instance, regs );
-          assert( regs->r[1] == 0 || regs->r[1] == call );
+  service_entry *entry = find_service_entry( call, false );
 
-          instance = next;
-        } while (instance != 0 && regs->r[1] != 0);
-      }
+  service_link *listed = (entry == 0) ? 0 : entry->first;
+  service_link *every = shared.module.every_service;
+
+  // Merge the two lists, so that the modules are called in the order
+  // they were initialised (each instance separately).
+  while ((listed != 0 || every != 0) && regs->r[1] != 0) {
+    service_link *link;
+
+    if (every == 0
+     || (listed != 0 && listed->m->number < every->m->number)) {
+      link = listed;
+      listed = listed->next;
+    }
+    else {
+      link = every;
+      every = every->next;
     }
+
+    service_call( link, regs );
+    assert( regs->r[1] == 0 || regs->r[1] == call );
+
 #ifdef DEBUG__FOLLOW_SERVICE_CALLS
     if (regs->r[1] == 0) {
       Task_LogString( " - Claimed\n", 11 );
@@ -764,7 +1151,6 @@ OSTask *do_OS_ServiceCall( svc_registers *regs )
       Task_LogNewLine();
     }
 #endif
-    m = m->next;
   }
 
 #ifdef DEBUG__FOLLOW_SERVICE_CALLS
@@ -905,49 +1291,166 @@ typedef struct {
   module_command *command;
 } module_code;
 
-static module_command *search_list( char const *command, const char *cmd )
+static inline char lower( char c )
 {
-  if (cmd != 0) {
-    while (cmd[0] != '\0') {
-      int len = strlen( cmd );
+  return (c >= 'A' && c <= 'Z') ? c + 'a' - 'A' : c;
+}
 
-      module_command *c = (void*) (((uint32_t) cmd + len + 4)&~3);
-      // +4 because len is strlen, not including terminator
+// Case insensitive, terminated like riscoscmp
+static uint32_t command_hash( char const *s )
+{
+  uint32_t hash = 5381;
 
-      if (riscoscmp( cmd, command ) && c->code_offset != 0) {
-        return c;
-      }
+  while (*s != 0 && *s != 10 && *s != 13 && *s != ' ') {
+    hash = hash * 33 + lower( *s++ );
+  }
 
-      cmd = (char const *) (c + 1);
-    }
+  return hash;
+}
+
+// Every command provided by an initialised module, hashed by name.
+// When more than one module provides a command, the first to be
+// initialised gets it, as when the modules' keyword tables were
+// searched in order.
+// Modules can't be removed yet; when they can, their commands will have
+// to be removed, and those of any module later in the list re-indexed.
+struct command_entry {
+  uint32_t hash;
+  char const *name;
+  module *m;
+  module_command *command;
+  command_entry *next;
+};
+
+static command_entry *find_command_entry( char const *command, uint32_t hash )
+{
+  command_entry *entry = shared.module.commands[hash & 255];
+
+  while (entry != 0
+      && (entry->hash != hash || !riscoscmp( entry->name, command ))) {
+    entry = entry->next;
   }
 
-  return 0;
+  return entry;
 }
 
-static module_code find_module_command( char const *command )
+static void index_module_commands( module *m )
 {
-  module *m = shared.module.modules;
+  char const *cmd = module_commands( m->header );
 
-  while (m != 0) {
-    module_header *header = m->header;
+  if (cmd == 0) return;
 
-    const char *cmd = module_commands( header );
+  while (cmd[0] != '\0') {
+    int len = strlen( cmd );
 
-    module_command *found = search_list( command, cmd );
+    module_command *c = (void*) (((uint32_t) cmd + len + 4)&~3);
 
-    if (found != 0) {
-      module_code result = { m, found };
-      return result;
+    uint32_t hash = command_hash( cmd );
+
+    if (c->code_offset != 0 && 0 == find_command_entry( cmd, hash )) {
+      command_entry *entry = system_heap_allocate( sizeof( command_entry ) );
+      if (entry == 0) PANIC;
+
+      entry->hash = hash;
+      entry->name = cmd;
+      entry->m = m;
+      entry->command = c;
+      entry->next = shared.module.commands[hash & 255];
+      push_writes_to_cache();
+      shared.module.commands[hash & 255] = entry;
     }
 
-    m = m->next;
+    cmd = (char const *) (c + 1);
+  }
+}
+
+static module_code find_module_command( char const *command )
+{
+  command_entry *entry = find_command_entry( command, command_hash( command ) );
+
+  if (entry != 0) {
+    module_code result = { entry->m, entry->command };
+    return result;
   }
 
   module_code no_match = { 0, 0 };
   return no_match;
 }
 
+// A small cache of command names that have been looked up and found
+// not to have an Alias$ variable. Rather than keep track of which
+// variable has been set, any change to any variable invalidates the
+// whole cache (see system_variable_changed).
+// Names too long to fit are not cached.
+struct no_alias_entry {
+  uint32_t generation;
+  char name[28];
+};
+
+#define NO_ALIAS_ENTRIES 64
+
+static no_alias_entry *no_alias_slot( char const *command )
+{
+  if (shared.module.no_alias == 0) {
+    uint32_t size = NO_ALIAS_ENTRIES * sizeof( no_alias_entry );
+    no_alias_entry *cache = system_heap_allocate( size );
+    if (cache == 0) return 0;
+    memset( cache, 0, size );
+    // Generation zero never matches
+    shared.module.variables_generation = 1;
+    shared.module.no_alias = cache;
+  }
+
+  return &shared.module.no_alias[command_hash( command ) % NO_ALIAS_ENTRIES];
+}
+
+static bool known_not_aliased( char const *command )
+{
+  no_alias_entry *entry = no_alias_slot( command );
+
+  return entry != 0
+      && entry->generation == shared.module.variables_generation
+      && riscoscmp( entry->name, command );
+}
+
+// generation is the value read before the variable was looked up, so
+// that a variable set in the meantime invalidates the new entry.
+static void remember_not_aliased( char const *command, uint32_t generation )
+{
+  no_alias_entry *entry = no_alias_slot( command );
+
+  if (entry == 0) return;
+
+  // Not valid while the name is being written
+  entry->generation = 0;
+  push_writes_to_cache();
+
+  int len = 0;
+  while (command[len] > ' ') {
+    if (len == sizeof( entry->name ) - 1) return; // Too long
+    entry->name[len] = lower( command[len] );
+    len++;
+  }
+  entry->name[len] = '\0';
+  push_writes_to_cache();
+  entry->generation = generation;
+}
+
+// Called by the legacy kernel when any system variable is set or removed,
+// on any core.
+void system_variable_changed()
+{
+  uint32_t volatile *generation = &shared.module.variables_generation;
+  uint32_t old;
+  uint32_t new;
+
+  do {
+    old = *generation;
+    new = old + 1;
+    if (new == 0) new = 1; // Generation zero never matches
+  } while (old != change_word_if_equal( generation, old, new ));
+}
+
 static inline bool terminator( char c )
 {
   return c == '\0' || c == '\r' || c == '\n';
@@ -1092,7 +1595,14 @@ handled run_aliased_command( uint32_t *regs )
 
   uint32_t space = 0;
 
-  if (cmd[0] != '%') {
+  if (cmd[0] != '%' && known_not_aliased( cmd0 )) {
+    // Not aliased, no need to ask
+  }
+  else if (cmd[0] != '%') {
+    // Before the lookup, see remember_not_aliased
+    uint32_t generation =
+        *(uint32_t volatile *) &shared.module.variables_generation;
+
     register char const *name asm ( "r0" ) = varname;
     // r1 ignored because r2 -ve
     register int32_t asksize asm ( "r2" ) = -1;
@@ -1109,11 +1619,14 @@ handled run_aliased_command( uint32_t *regs )
         , "r" (asksize)
         , "r" (context)
         , "r" (convert)
-        : "lr" );
+        : "lr", "memory" );
 
     if (size != 0) {
       space = !size;
     }
+    else {
+      remember_not_aliased( cmd0, generation );
+    }
   }
   else {
     // Skip preceding % characters and subsequent spaces
@@ -19,15 +19,60 @@
 
 // Legacy modules might enable interrupts while in SVC.
 
+typedef struct module module;
+typedef struct service_entry service_entry;
+typedef struct service_link service_link;
+typedef struct command_entry command_entry;
+typedef struct no_alias_entry no_alias_entry;
+
 typedef struct {
+  // The last chunk looked up on this core, and the module that provides
+  // it (the base instance). Entries in the chunk tables are never changed
+  // once set, so this can't get out of date.
+  uint32_t last_chunk;
+  module *last_chunk_module;
 } workspace_module;
 
-typedef struct module module;
-
 typedef struct {
   module *modules;
   module *last;
 
+  // Held while the list and indexes are changed, and for the whole
+  // initialisation of modules that aren't flagged as MP-safe. A task
+  // lock (Task_LockClaim).
+  uint32_t lock;
+
+  // The modules whose initialisation code is running, with the task
+  // running it (modules with bit 1 of their flags set may be initialised
+  // by several tasks at once). The lock is a core lock.
+  uint32_t in_init_lock;
   module *in_init;
+
+  // Modules indexed by SWI chunk, see find_module_by_chunk
+  module **chunks[4];
+  // One bit per indexed chunk, set if the module providing it has
+  // registered SWI handlers, see handler_available. Like the chunk
+  // table entries, never cleared (modules can't be deleted, yet).
+  uint32_t modern_chunks[4][64];
+
+  // Modules with service call handlers, by service number if they
+  // have a service table, see do_OS_ServiceCall
+  service_entry *services[64];
+  service_link *every_service;
+  service_link *last_every_service;
+
+  // Module commands by (case insensitive) name, see find_module_command
+  command_entry *commands[256];
+
+  // Commands recently found not to have an Alias$ variable, valid while
+  // no variables have been set, see run_aliased_command
+  no_alias_entry *no_alias;
+  uint32_t variables_generation;
+
+  // Index of modules in a list, e.g. LegacyModulesList, see
+  // find_module_in_list
+  uint32_t const *indexed_list;
+  struct module_header **list_index;
+  uint32_t list_index_size;
 } shared_module;
 
@@ -88,6 +88,7 @@ bool swi_is_legacy()
 // that provides
 OSTask *do_OS_Module( svc_registers *regs );
 OSTask *run_module_swi( svc_registers *regs, int swi );
+OSTask *do_OS_ServiceCall( svc_registers *regs );
 // bool needs_legacy_stack( uint32_t swi )
 
 void execute_swi( svc_registers *regs, int number )
@@ -125,7 +126,8 @@ void execute_swi( svc_registers *regs, int number )
     break;
 
     }
-  case OS_ServiceCall: // No-one is listening
+  case OS_ServiceCall:
+    do_OS_ServiceCall( regs );
     break;
 
   default:
@@ -154,7 +156,9 @@ void __attribute__(( noreturn )) startup()
   // Running with multi-tasking enabled. This routine gets called
   // just once.
 
+  boot_trace( "setup_system_heap", 0 );
   setup_system_heap(); // System heap
+  boot_trace( "setup_shared_heap", 0 );
   setup_shared_heap(); // RMA heap
 
   asm ( "mov sp, %[reset_sp]"
@@ -162,6 +166,8 @@ void __attribute__(( noreturn )) startup()
     :
     : [reset_sp] "r" ((&workspace.svc_stack)+1) );
 
+  boot_trace( "RMRun", "HAL" );
+
   // RMRun HAL
   register uint32_t run asm ( "r0" ) = 0; // RMRun
   register char const *module asm ( "r1" ) = "System:Modules.HAL";
@@ -0,0 +1,154 @@
+/* Copyright 2025 Simon Willcocks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// The host side of the simulator: one pthread per simulated core, the
+// generic timer, memory the kernel code expects to find mapped, and
+// the command line.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "simulator.h"
+
+sim_config sim = {
+  .workload = "locks",
+  .cores = 4,
+  .tasks = 16,
+  .locks = 2,
+  .servers = 2,
+  .work = 100,
+  .duration = 1000 };
+
+int volatile sim_stop = 0;
+
+// Memory the OSTask code expects to be there
+uint8_t system_heap_base[SIM_HEAP_SIZE] __attribute__(( aligned( 8 ) ));
+uint8_t shared_heap_base[SIM_HEAP_SIZE] __attribute__(( aligned( 8 ) ));
+uint8_t OSQueue_free_pool[0x10000] __attribute__(( aligned( 64 ) ));
+
+uint32_t claim_contiguous_memory( uint32_t pages )
+{
+  return 0; // Not used, see map_memory
+}
+
+void map_memory( void const *mapping )
+{
+  // The only mapping made is of OSQueue_free_pool, already in bss.
+}
+
+uint32_t number_of_cores()
+{
+  return sim.cores;
+}
+
+// Ticks at the rate of the Pi 3's generic timer, 19.2MHz, so that tick
+// counts (e.g. in queue_statistics) look like those from the hardware.
+uint64_t timer_count()
+{
+  struct timespec now;
+  clock_gettime( CLOCK_MONOTONIC, &now );
+  uint64_t ns = now.tv_sec * 1000000000ull + now.tv_nsec;
+  return ns * 24 / 1250;
+}
+
+void sim_panic( char const *file, int line )
+{
+  fprintf( stderr, "PANIC at %s:%d\n", file, line );
+  abort();
+}
+
+int sim_map_tasks()
+{
+  void *tasks = mmap( (void*) SIM_TASKS_VA, SIM_TASKS_SIZE,
+                      PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE,
+                      -1, 0 );
+  return tasks == (void*) SIM_TASKS_VA;
+}
+
+static void *core_thread( void *core )
+{
+  sim_core( (uintptr_t) core );
+  return 0;
+}
+
+static void usage( char const *name )
+{
+  fprintf( stderr,
+      "Usage: %s [-w yield|locks|nested|queue|swis|sleep] [-c cores] [-t tasks]\n"
+      "          [-l locks] [-s servers] [-W work] [-d ms]\n", name );
+  exit( 1 );
+}
+
+int main( int argc, char **argv )
+{
+  int opt;
+
+  while (-1 != (opt = getopt( argc, argv, "w:c:t:l:s:W:d:" ))) {
+    switch (opt) {
+    case 'w': sim.workload = optarg; break;
+    case 'c': sim.cores = atoi( optarg ); break;
+    case 't': sim.tasks = atoi( optarg ); break;
+    case 'l': sim.locks = atoi( optarg ); break;
+    case 's': sim.servers = atoi( optarg ); break;
+    case 'W': sim.work = atoi( optarg ); break;
+    case 'd': sim.duration = atoi( optarg ); break;
+    default: usage( argv[0] );
+    }
+  }
+
+  if (sim.cores < 1 || sim.cores > SIM_MAX_CORES
+   || sim.tasks < 1 || sim.tasks > SIM_MAX_TASKS
+   || sim.locks < 1 || sim.servers < 1 || sim.servers >= sim.tasks)
+    usage( argv[0] );
+
+  if (!sim_map_tasks()) {
+    fprintf( stderr, "Cannot map task memory at 0x%x\n", SIM_TASKS_VA );
+    return 1;
+  }
+
+  if (!sim_setup()) usage( argv[0] );
+
+  pthread_t threads[SIM_MAX_CORES];
+
+  uint64_t start = timer_count();
+
+  for (uintptr_t i = 0; i < sim.cores; i++) {
+    pthread_create( &threads[i], 0, core_thread, (void*) i );
+  }
+
+  usleep( sim.duration * 1000 );
+  sim_stop = 1;
+
+  for (int i = 0; i < sim.cores; i++) {
+    pthread_join( threads[i], 0 );
+  }
+
+  sim_report( timer_count() - start );
+
+  int stranded = sim_stranded();
+  if (stranded != 0) {
+    printf( "\nERROR: %d tasks blocked on free locks\n", stranded );
+    return 2;
+  }
+
+  return 0;
+}
@@ -0,0 +1,129 @@
+/* Copyright 2025 Simon Willcocks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host replacement for Processor/processor.h, for the simulator.
+// Each simulated core is a pthread, the multi-processing primitives
+// use the gcc atomic builtins, the generic timer is CLOCK_MONOTONIC
+// (see host.c).
+
+#ifndef SIMULATOR_PROCESSOR_H
+#define SIMULATOR_PROCESSOR_H
+
+#include "CK_types.h"
+
+// The assert macro in ostask.h uses the ARM bkpt instruction.
+asm ( ".macro bkpt line\n  ud2\n.endm" );
+
+void abort();
+
+#define PANIC do { sim_panic( __FILE__, __LINE__ ); } while (true)
+
+void __attribute__(( noreturn )) sim_panic( char const *file, int line );
+
+static inline void push_writes_to_device()
+{
+  __atomic_thread_fence( __ATOMIC_SEQ_CST );
+}
+
+static inline void ensure_changes_observable()
+{
+  __atomic_thread_fence( __ATOMIC_SEQ_CST );
+}
+
+static inline void push_writes_to_cache()
+{
+  __atomic_thread_fence( __ATOMIC_SEQ_CST );
+}
+
+static inline void signal_event()
+{
+}
+
+int sched_yield();
+
+static inline void wait_for_event()
+{
+  sched_yield();
+}
+
+uint32_t number_of_cores();
+
+uint64_t timer_count();
+
+static inline uint32_t timer_frequency()
+{
+  return 19200000;
+}
+
+static inline
+uint32_t change_word_if_equal( uint32_t volatile *word, uint32_t from, uint32_t to )
+{
+  uint32_t value = from;
+  __atomic_compare_exchange_n( word, &value, to, false,
+                               __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST );
+  return value;
+}
+
+// Unlike the ldrex/strex version, a compare and swap can't see that the
+// head has changed and changed back (the ABA problem). The simulator
+// only pops from these stacks (the queue pool) while setting up, on a
+// single core, so that can't happen here.
+static inline
+uint32_t detach_first_linked_word( uint32_t volatile *head, uint32_t link )
+{
+  uint32_t value = *head;
+
+  while (value != 0) {
+    uint32_t next = *(uint32_t volatile *) (value + link);
+    if (__atomic_compare_exchange_n( head, &value, next, false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST ))
+      break;
+  }
+
+  return value;
+}
+
+// Counted for each simulated core: attempts to claim a core lock that
+// found it held by another core.
+extern __thread uint32_t sim_lock_spins;
+
+static inline
+bool core_claim_lock( uint32_t volatile *lock, uint32_t value )
+{
+  for (;;) {
+    uint32_t core = value;
+    uint32_t old = change_word_if_equal( lock, 0, core );
+    if (old == 0) return false;
+    if (old == core) return true;
+    sim_lock_spins++;
+    wait_for_event();
+  }
+}
+
+static inline
+void core_release_lock( uint32_t volatile *lock )
+{
+  ensure_changes_observable();
+  *lock = 0;
+  push_writes_to_cache();
+  signal_event();
+}
+
+void *memset(void *s, int c, size_t n);
+
+// Declarations only, includes system_workspaces.h
+#include "mmu.h"
+
+#endif
@@ -0,0 +1,553 @@
+/* Copyright 2025 Simon Willcocks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Runs the unmodified locks.c, queues.c and sleep.c on the host, with
+// each simulated core a pthread, so that the scheduling and IPC code
+// can be exercised (and measured) without hardware.
+//
+// ostask.c is ARM code through and through, so the parts of it these
+// files rely on are re-written here in C, following ostask.c as closely
+// as possible:
+//   save_task_state, without the banked usr registers,
+//   the idle task's search for work (IdleTaskYield),
+//   TaskOpYield, TaskOpSleep, TaskOpReleaseTask (not locked to a core).
+// Keep them in step with ostask.c!
+//
+// Each simulated task runs a little program of operations, in a loop.
+// A task stops running when an operation returns another task to run,
+// exactly as it would in the kernel, and continues with its next
+// operation when a core next picks it up.
+
+#include "ostask.h"
+#include "simulator.h"
+
+int printf( char const *fmt, ... );
+int strcmp( char const *s1, char const *s2 );
+
+shared_workspace volatile shared = { 0 };
+__thread core_workspace volatile workspace = { 0 };
+
+__thread uint32_t sim_lock_spins = 0;
+
+enum { YIELD, SLEEP, CLAIM, RELEASE, QUEUE_SWI, QUEUE_WAIT,
+       RELEASE_CALLER, WORK, OPERATIONS };
+
+static char const *const op_name[OPERATIONS] = {
+  "Yield", "Sleep", "LockClaim", "LockRelease", "Queued SWI",
+  "QueueWait", "ReleaseTask", "Work" };
+
+// Why a task was not running, for the wakeup latency
+enum { RAN, YIELDED, LOCK, RELEASED, SLEPT, CAUSES };
+
+static char const *const cause_name[CAUSES] = {
+  "", "Yield", "Lock", "ReleaseTask", "Sleep (overshoot)" };
+
+typedef struct {
+  uint8_t op;
+  uint8_t arg;
+} operation;
+
+typedef struct {
+  operation const *program;
+  uint32_t length;
+  uint32_t pc;
+
+  uint32_t cause;       // Why the task is not running
+  uint32_t lock;        // Being claimed
+  uint64_t ready_at;    // When it became runnable (or should)
+} sim_task;
+
+// Each core only writes its own statistics
+typedef struct __attribute__(( aligned( 64 ) )) {
+  uint32_t ops[OPERATIONS];
+  uint32_t switches;
+  uint32_t lock_spins;
+  uint32_t claims_blocked;
+  uint32_t idle;
+  struct {
+    uint32_t count;
+    uint64_t total;
+    uint64_t max;
+  } latency[CAUSES];
+} core_stats;
+
+static core_stats stats[SIM_MAX_CORES];
+
+static OSTask *tasks;
+static sim_task state[SIM_MAX_TASKS + SIM_MAX_CORES];
+static uint32_t locks[64] __attribute__(( aligned( 64 ) ));
+static uint32_t queue;
+
+// The time each lock was last released; the new owner can't run before
+// it, and nothing else can release the lock until the new owner does.
+static uint64_t released_at[number_of( locks )];
+
+static operation const yielder[] = {
+  { YIELD }, { WORK } };
+
+static operation const sleeper[] = {
+  { SLEEP }, { WORK } };
+
+static operation const server[] = {
+  { QUEUE_WAIT }, { WORK }, { RELEASE_CALLER } };
+
+static operation const client[] = {
+  { QUEUE_SWI }, { WORK } };
+
+// The first server waits for callers from core 0 (argument core + 1)
+// every other time, so the queue is indexed, with callers for several
+// SWIs (each client calls SWI i % 8).
+static operation const core_server[] = {
+  { QUEUE_WAIT, 1 }, { WORK }, { RELEASE_CALLER },
+  { QUEUE_WAIT }, { WORK }, { RELEASE_CALLER } };
+
+static operation swi_clients[SIM_MAX_TASKS][2];
+
+// Each locker gets its own copy, with its lock numbers filled in
+static operation lockers[SIM_MAX_TASKS][6];
+
+static inline sim_task *state_of( OSTask *task )
+{
+  return &state[task - tasks];
+}
+
+// Replaces the ostask.c version, which also stores sp_usr and lr_usr;
+// the simulated tasks don't have any.
+void __attribute__(( aligned( 4 ) )) save_task_state( svc_registers const *regs )
+{
+  OSTask *running = workspace.ostask.running;
+
+  if (!running->running) PANIC;
+  running->saved = save_task_state; // Clears running flag
+  if (running->running) PANIC;
+
+  account_kernel_time( running );
+
+  running->regs = *regs;
+
+  if (running->regs.lr == 0) PANIC;
+}
+
+DEFINE_ERROR( InvalidQueue, 0x888, "Invalid OSTask Queue handle" );
+
+static void set_program( OSTask *task, operation const *program,
+                         uint32_t length )
+{
+  sim_task *s = state_of( task );
+  s->program = program;
+  s->length = length;
+  s->pc = 0;
+  s->cause = RAN;
+}
+
+int sim_setup()
+{
+  extern uint8_t system_heap_base;
+  extern uint8_t shared_heap_base;
+
+  heap_initialise( &system_heap_base, SIM_HEAP_SIZE );
+  heap_initialise( &shared_heap_base, SIM_HEAP_SIZE );
+
+  shared.ostask.number_of_cores = sim.cores;
+
+  setup_queue_pool();
+
+  tasks = (void*) SIM_TASKS_VA;
+  if (sizeof( OSTask ) * (sim.tasks + sim.cores) > SIM_TASKS_SIZE) PANIC;
+
+  for (int i = 0; i < sim.tasks + sim.cores; i++) {
+    OSTask *task = &tasks[i];
+    dll_new_OSTask( task );
+    task->regs.lr = 0x8000;     // Anything but zero
+    task->regs.spsr = 0x10;     // usr32
+  }
+
+  for (int i = 0; i < sim.tasks; i++) {
+    OSTask *task = &tasks[i];
+
+    if (0 == strcmp( sim.workload, "yield" )) {
+      set_program( task, yielder, number_of( yielder ) );
+    }
+    else if (0 == strcmp( sim.workload, "sleep" )) {
+      set_program( task, sleeper, number_of( sleeper ) );
+    }
+    else if (0 == strcmp( sim.workload, "locks" )) {
+      uint8_t lock = i % sim.locks;
+      operation *program = lockers[i];
+      program[0] = (operation) { CLAIM, lock };
+      program[1] = (operation) { WORK };
+      program[2] = (operation) { RELEASE, lock };
+      program[3] = (operation) { WORK };
+      set_program( task, program, 4 );
+    }
+    else if (0 == strcmp( sim.workload, "nested" )) {
+      // Each task holds two locks at once (claimed in order), so the
+      // blocked list mixes tasks waiting for different locks.
+      if (sim.locks < 2) return 0;
+      uint8_t first = i % sim.locks;
+      uint8_t second = (i + 1) % sim.locks;
+      if (second < first) { uint8_t t = first; first = second; second = t; }
+      operation *program = lockers[i];
+      program[0] = (operation) { CLAIM, first };
+      program[1] = (operation) { CLAIM, second };
+      program[2] = (operation) { WORK };
+      program[3] = (operation) { RELEASE, second };
+      program[4] = (operation) { RELEASE, first };
+      program[5] = (operation) { WORK };
+      set_program( task, program, 6 );
+    }
+    else if (0 == strcmp( sim.workload, "queue" )) {
+      if (i < sim.servers)
+        set_program( task, server, number_of( server ) );
+      else
+        set_program( task, client, number_of( client ) );
+    }
+    else if (0 == strcmp( sim.workload, "swis" )) {
+      if (i == 0)
+        set_program( task, core_server, number_of( core_server ) );
+      else if (i < sim.servers)
+        set_program( task, server, number_of( server ) );
+      else {
+        operation *program = swi_clients[i];
+        program[0] = (operation) { QUEUE_SWI, i % 8 };
+        program[1] = (operation) { WORK };
+        set_program( task, program, 2 );
+      }
+    }
+    else {
+      return 0;
+    }
+
+    mpsafe_enqueue_OSTask( &shared.ostask.runnable, task );
+  }
+
+  if (sim.locks > number_of( locks )) return 0;
+
+  svc_registers regs = { };
+  QueueCreate( &regs );
+  queue = regs.r[0];
+
+  return 1;
+}
+
+static void work()
+{
+  for (int i = 0; i < sim.work; i++) {
+    asm volatile ( "" : : "r" (i) );
+  }
+}
+
+// As TaskOpReleaseTask, for a task that isn't locked to a core
+static void release_task( OSTask *running, OSTask *release )
+{
+  if (current_controller( release ) != running) PANIC;
+
+  pop_controller( release );
+
+  if (release->queued_on != 0) queued_swi_completed( release );
+
+  make_runnable( release );
+}
+
+// Perform the running task's next operation, returning the task to
+// resume, if the running task is no longer running (as a SWI would).
+static OSTask *step( OSTask *running, core_stats *core )
+{
+  sim_task *s = state_of( running );
+  operation op = s->program[s->pc];
+  s->pc = (s->pc + 1) % s->length;
+
+  // As execute_svc (even for WORK, which would be usr code)
+  account_user_time( running );
+
+  // A copy, as if on the svc stack
+  svc_registers regs = running->regs;
+  regs.spsr &= ~VF;
+
+  OSTask *resume = 0;
+
+  switch (op.op) {
+  case YIELD:
+    // TaskOpYield
+    s->cause = YIELDED;
+    s->ready_at = timer_count();
+    resume = stop_running_task( &regs );
+    make_runnable( running );
+    break;
+  case SLEEP:
+    {
+    // TaskOpSleep
+    uint32_t ms = 1 + (running - tasks) % 4;
+    regs.r[0] = ms;
+    s->cause = SLEPT;
+    s->ready_at = timer_count() + ms * (timer_frequency() / 1000);
+    resume = stop_running_task( &regs );
+    sleeping_tasks_add( running );
+    }
+    break;
+  case CLAIM:
+    regs.r[0] = (uint32_t) &locks[op.arg];
+    s->cause = LOCK;
+    s->lock = op.arg;
+    resume = TaskOpLockClaim( &regs );
+    if (resume != 0) core->claims_blocked++;
+    break;
+  case RELEASE:
+    regs.r[0] = (uint32_t) &locks[op.arg];
+    released_at[op.arg] = timer_count();
+    resume = TaskOpLockRelease( &regs );
+    if (resume != 0) PANIC;
+    break;
+  case QUEUE_SWI:
+    s->cause = RELEASED;
+    resume = queue_running_OSTask( &regs, queue, op.arg );
+    break;
+  case QUEUE_WAIT:
+    // The caller's handle will be in r0, whether the task blocks or not
+    regs.r[2] = op.arg - 1;
+    resume = QueueWait( &regs, queue_from_handle( queue ),
+                        false, op.arg != 0 );
+    break;
+  case RELEASE_CALLER:
+    {
+    OSTask *caller = ostask_from_handle( regs.r[0] );
+    sim_task *c = state_of( caller );
+    c->ready_at = timer_count();
+    release_task( running, caller );
+    }
+    break;
+  case WORK:
+    work();
+    break;
+  }
+
+  if (0 != (regs.spsr & VF)) PANIC; // Error returned
+
+  core->ops[op.op]++;
+
+  if (resume == 0) {
+    // Running task continues
+    running->regs = regs;
+    s->cause = RAN;
+    account_kernel_time( running );
+  }
+
+  return resume;
+}
+
+// Like return_to_swi_caller, without returning
+static void resuming( OSTask *task, core_stats *core )
+{
+  assert( task == workspace.ostask.running );
+  assert( !task->running );
+  task->running = 1;
+
+  account_kernel_time( task );
+  account_resumed( task );
+
+  core->switches++;
+
+  if (task == workspace.ostask.idle) return;
+
+  sim_task *s = state_of( task );
+
+  if (s->cause == LOCK) {
+    s->ready_at = released_at[s->lock];
+  }
+
+  if (s->cause != RAN) {
+    uint64_t now = timer_count();
+    uint64_t latency = now > s->ready_at ? now - s->ready_at : 0;
+    core->latency[s->cause].count++;
+    core->latency[s->cause].total += latency;
+    if (latency > core->latency[s->cause].max)
+      core->latency[s->cause].max = latency;
+    s->cause = RAN;
+  }
+}
+
+// As IdleTaskYield: tasks already on this core first, then any task
+// from the shared runnable list.
+static OSTask *find_work()
+{
+  OSTask *idle = workspace.ostask.idle;
+  OSTask *next = idle->next;
+  OSTask *resume = 0;
+
+  if (next != idle) {
+    resume = next;
+  }
+  else if (!mpsafe_OSTask_queue_empty( &shared.ostask.runnable )) {
+    resume = mpsafe_dequeue_OSTask( &shared.ostask.runnable );
+  }
+
+  if (resume != 0) {
+    svc_registers regs = idle->regs;
+    save_task_state( &regs );
+    if (resume != next)
+      dll_attach_OSTask( resume, (OSTask **) &workspace.ostask.running );
+    else
+      workspace.ostask.running = next;
+  }
+
+  return resume;
+}
+
+void sim_core( unsigned number )
+{
+  workspace.core = number;
+  workspace.ostask.accounted = timer_count();
+
+  OSTask *idle = &tasks[sim.tasks + number];
+  idle->regs.spsr = 0x13;       // svc32
+  idle->running = 1;
+  workspace.ostask.idle = idle;
+  workspace.ostask.running = idle;
+
+  core_stats *core = &stats[number];
+
+  uint64_t next_tick = timer_count();
+  uint32_t const tick = timer_frequency() / 1000;
+
+  while (!sim_stop) {
+    if (number == 0 && timer_count() >= next_tick) {
+      // The ms ticker, OSTask_Tick
+      sleeping_tasks_tick();
+      next_tick += tick;
+    }
+
+    OSTask *running = workspace.ostask.running;
+    OSTask *resume;
+
+    if (running == idle) {
+      // The idle task calls Yield
+      account_user_time( idle );
+      resume = find_work();
+      if (resume == 0) {
+        core->idle++;
+        wait_for_event();
+      }
+    }
+    else {
+      resume = step( running, core );
+    }
+
+    if (resume != 0) resuming( resume, core );
+  }
+
+  core->lock_spins = sim_lock_spins;
+}
+
+static uint32_t per_second( uint64_t count, uint64_t ticks )
+{
+  return count * timer_frequency() / ticks;
+}
+
+static uint32_t microseconds( uint64_t ticks )
+{
+  return ticks * 1000000 / timer_frequency();
+}
+
+// Tasks still blocked on a lock that nobody owns will never run again
+int sim_stranded()
+{
+  int stranded = 0;
+  OSTask *head = shared.ostask.blocked;
+  OSTask *t = head;
+
+  if (t != 0) do {
+    uint32_t *lock = (void*) t->regs.r[0];
+    if (*lock == 0) stranded++;
+    t = t->next;
+  } while (t != head);
+
+  return stranded;
+}
+
+void sim_report( unsigned long long elapsed )
+{
+  core_stats total = { };
+
+  for (int c = 0; c < sim.cores; c++) {
+    core_stats *core = &stats[c];
+    for (int i = 0; i < OPERATIONS; i++) total.ops[i] += core->ops[i];
+    total.switches += core->switches;
+    total.lock_spins += core->lock_spins;
+    total.claims_blocked += core->claims_blocked;
+    for (int i = 0; i < CAUSES; i++) {
+      total.latency[i].count += core->latency[i].count;
+      total.latency[i].total += core->latency[i].total;
+      if (core->latency[i].max > total.latency[i].max)
+        total.latency[i].max = core->latency[i].max;
+    }
+  }
+
+  printf( "Workload %s: %u cores, %u tasks, %u ms\n",
+          sim.workload, sim.cores, sim.tasks, microseconds( elapsed ) / 1000 );
+
+  printf( "\nOperations per second\n" );
+  for (int i = 0; i < OPERATIONS; i++) {
+    if (total.ops[i] != 0)
+      printf( "  %-12s %10u\n", op_name[i], per_second( total.ops[i], elapsed ) );
+  }
+  printf( "  %-12s %10u\n", "Task switch", per_second( total.switches, elapsed ) );
+
+  printf( "\nWakeup latency, us      count       mean        max\n" );
+  for (int i = RAN + 1; i < CAUSES; i++) {
+    if (total.latency[i].count != 0)
+      printf( "  %-18s %10u %10u %10u\n", cause_name[i],
+              total.latency[i].count,
+              microseconds( total.latency[i].total / total.latency[i].count ),
+              microseconds( total.latency[i].max ) );
+  }
+
+  printf( "\nLock contention\n" );
+  printf( "  Core lock spins     %10u\n", total.lock_spins );
+  if (total.ops[CLAIM] != 0)
+    printf( "  Claims blocked      %10u of %u\n",
+            total.claims_blocked, total.ops[CLAIM] );
+
+  uint64_t waiting = 0;
+  uint32_t switches = 0;
+  for (int i = 0; i < sim.tasks; i++) {
+    waiting += tasks[i].times.waiting;
+    switches += tasks[i].times.switches;
+  }
+  if (switches != 0)
+    printf( "\nMean run queue wait  %10u us\n",
+            microseconds( waiting / switches ) );
+
+  printf( "\nIdle per core, ms (loops)\n" );
+  for (int c = 0; c < sim.cores; c++) {
+    OSTask *idle = &tasks[sim.tasks + c];
+    printf( "  %u: %u (%u)\n", c,
+            microseconds( idle->times.user + idle->times.kernel ) / 1000,
+            stats[c].idle );
+  }
+
+  if (total.ops[QUEUE_SWI] != 0) {
+    static queue_statistics qs;
+    svc_registers regs = { .r = { [1] = (uint32_t) &qs } };
+    QueueStatistics( &regs, queue_from_handle( queue ) );
+    printf( "\nQueue           handled    blocked  completed\n" );
+    printf( "  %16u %10u %10u\n", qs.handled, qs.blocked, qs.completed );
+    printf( "  us         mean delay  max delay mean service  max service\n" );
+    printf( "  %19u %10u %12u %12u\n",
+            qs.completed ? microseconds( qs.total_delay / qs.completed ) : 0,
+            microseconds( qs.max_delay ),
+            qs.completed ? microseconds( qs.total_service / qs.completed ) : 0,
+            microseconds( qs.max_service ) );
+  }
+}
@@ -0,0 +1,49 @@
+/* Copyright 2025 Simon Willcocks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Interface between host.c (pthreads, clocks, memory, main) and
+// simulator.c (which includes the OSTask headers).
+// Only plain C types here; CK_types.h and the host headers don't mix.
+
+#define SIM_MAX_CORES 16
+#define SIM_MAX_TASKS 512
+#define SIM_HEAP_SIZE (1 << 20)
+
+// Simulated OSTask objects have to be at 0xff1xxxxx, see
+// queue_running_OSTask.
+#define SIM_TASKS_VA 0xff100000
+#define SIM_TASKS_SIZE (1 << 20)
+
+typedef struct {
+  char const *workload;
+  unsigned cores;
+  unsigned tasks;
+  unsigned locks;
+  unsigned servers;
+  unsigned work;        // Loop iterations between operations
+  unsigned duration;    // ms
+} sim_config;
+
+extern sim_config sim;
+extern int volatile sim_stop;
+
+// simulator.c
+int sim_setup();        // Returns 0 for an unknown workload
+void sim_core( unsigned core );
+void sim_report( unsigned long long elapsed_ticks );
+int sim_stranded();     // Blocked tasks waiting for a free lock
+
+// host.c
+int sim_map_tasks();    // Returns 0 on failure
@@ -0,0 +1,31 @@
+/* Copyright 2025 Simon Willcocks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Only the OSTask workspaces; each simulated core (pthread) has its
+// own core workspace.
+
+#include "workspace_ostask.h"
+
+typedef struct {
+  shared_ostask ostask;
+} shared_workspace;
+
+typedef struct {
+  uint32_t core;
+  workspace_ostask ostask;
+} core_workspace;
+
+extern shared_workspace volatile shared;
+extern __thread core_workspace volatile workspace;
@@ -49,15 +49,18 @@ struct OSTask {
   OSTask *next;
 };
 
+MPSC_QUEUE_TYPE( OSTask );
+
 struct shared {
   struct {
-    OSTask *runnable;
+    OSTask_mpsc_queue runnable;
     OSTask *sleeping;
   } ostask;
 } shared;
 
 
 MPSAFE_DLL_TYPE( OSTask );
+MPSAFE_MPSC_TYPE( OSTask );
 
 void sleeping_tasks_add( OSTask *tired );
 void sleeping_tasks_tick();
@@ -18,7 +18,7 @@
 
 #include "ostask.h"
 
-struct shared shared = { .ostask = { 0, 0 } };
+struct shared shared = { .ostask = { { 0 }, 0 } };
 
 int main()
 {
@@ -37,7 +37,7 @@ int main()
   for (int i = 0;;i++) {
     printf( "Tick %d\n", i );
 
-    if (shared.ostask.runnable != 0) {
+    if (!mpsafe_OSTask_queue_empty( &shared.ostask.runnable )) {
       OSTask *t = shared.ostask.sleeping;
 
       if (t != 0) do {
@@ -46,10 +46,10 @@ int main()
       } while (t != shared.ostask.sleeping);
     }
 
-    if (shared.ostask.runnable != 0) printf( "\n" );
+    if (!mpsafe_OSTask_queue_empty( &shared.ostask.runnable )) printf( "\n" );
 
-    while (shared.ostask.runnable != 0) {
-      OSTask *t = mpsafe_detach_OSTask_at_head( &shared.ostask.runnable );
+    while (!mpsafe_OSTask_queue_empty( &shared.ostask.runnable )) {
+      OSTask *t = mpsafe_dequeue_OSTask( &shared.ostask.runnable );
       printf( "%d ", t - task );
       t->regs.r[0] = t->sleep_time;
       sleeping_tasks_add( t );
@@ -0,0 +1,154 @@
+/* Copyright 2025 Simon Willcocks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Interrupt sources bound to tasks.
+// The interrupt controller module tells the kernel where each core's
+// interrupt source register is (OSTask_InterruptSources). A task may then
+// bind itself to one of the sources on its core (OSTask_BindInterrupt),
+// and irq_handler resumes it directly when the source is pending, rather
+// than resuming the module's interrupt task, which would then have to
+// release it with another SWI. The module's task is only resumed for the
+// sources that are not bound (passed to it in r0).
+// Each core maps the source register page when it is first needed,
+// since the top MiB of the kernel's memory map is per core.
+
+#include "ostask.h"
+
+#define IRQ_SOURCES_VA 0xffffe000
+
+DEFINE_ERROR( InterruptSourcesRegistered, 0x888, "Interrupt sources already registered" );
+DEFINE_ERROR( InterruptSourcesUnknown, 0x888, "Interrupt sources not registered" );
+DEFINE_ERROR( InvalidInterruptSource, 0x888, "Invalid interrupt source" );
+DEFINE_ERROR( InterruptSourceBound, 0x888, "Interrupt source bound to another task" );
+
+// Maps this core's source register, if it's been registered
+bool interrupt_sources_mapped()
+{
+  if (workspace.ostask.irq_sources != 0) return true;
+
+  uint32_t phys = shared.ostask.irq_sources;
+  if (phys == 0) return false;
+
+  memory_mapping map = {
+    .base_page = phys >> 12,
+    .pages = 1,
+    .va = IRQ_SOURCES_VA,
+    .type = CK_Device,
+    .map_specific = 0,
+    .all_cores = 0,
+    .usr32_access = 0 };
+  map_memory( &map );
+
+  uint32_t offset = (phys & 0xfff)
+                  + workspace.core * shared.ostask.irq_sources_stride;
+
+  workspace.ostask.irq_sources = (void*) (IRQ_SOURCES_VA + offset);
+
+  return true;
+}
+
+// r0 = physical address of core 0's source register, r1 = bytes between
+// cores' registers. All the registers must be in the same page.
+// r2 = the source routed from each core's physical timer (which the
+// kernel uses, see timers.c), or 32 if it isn't routed.
+OSTask *TaskOpInterruptSources( svc_registers *regs )
+{
+  uint32_t phys = regs->r[0];
+  uint32_t stride = regs->r[1];
+  uint32_t timer = (regs->r[2] < 32) ? (1 << regs->r[2]) : 0;
+
+  uint32_t last = (phys & 0xfff) + (shared.ostask.number_of_cores - 1) * stride;
+  if (phys == 0 || 0 != (phys & 3) || last > 0xffc) {
+    return Error_InvalidInterruptSource( regs );
+  }
+
+  bool reclaimed = lock_ostask();
+
+  OSTask *resume = 0;
+
+  if (shared.ostask.irq_sources == 0) {
+    shared.ostask.irq_sources_stride = stride;
+    shared.ostask.timer_source = timer;
+    shared.ostask.irq_sources = phys;
+  }
+  else if (shared.ostask.irq_sources != phys
+        || shared.ostask.irq_sources_stride != stride
+        || shared.ostask.timer_source != timer) {
+    resume = Error_InterruptSourcesRegistered( regs );
+  }
+
+  if (!reclaimed) release_ostask();
+
+  if (resume == 0) interrupt_sources_mapped();
+
+  return resume;
+}
+
+// r0 = source (bit number), r1 = 1 to bind the calling task to it on
+// this core, 0 to release the binding.
+OSTask *TaskOpBindInterrupt( svc_registers *regs )
+{
+  OSTask *running = workspace.ostask.running;
+  uint32_t source = regs->r[0];
+
+  if (source >= 32) {
+    return Error_InvalidInterruptSource( regs );
+  }
+
+  uint32_t bit = 1 << source;
+
+  if (bit == shared.ostask.timer_source) {
+    return Error_InvalidInterruptSource( regs );
+  }
+
+  if (!interrupt_sources_mapped()) {
+    return Error_InterruptSourcesUnknown( regs );
+  }
+
+  OSTask *bound = workspace.ostask.bound_task[source];
+
+  if (bound != 0 && bound != running) {
+    return Error_InterruptSourceBound( regs );
+  }
+
+  if (regs->r[1] != 0) {
+    // As for OSTask_WaitForInterrupt
+    if (0 == (regs->spsr & 0x80)) PANIC;
+
+    workspace.ostask.bound_task[source] = running;
+    workspace.ostask.bound |= bit;
+  }
+  else {
+    workspace.ostask.bound_task[source] = 0;
+    workspace.ostask.bound &= ~bit;
+    workspace.ostask.bound_waiting &= ~bit;
+  }
+
+  return 0;
+}
+
+// The source the task is bound to on this core, or -1
+int bound_interrupt_source( OSTask *task )
+{
+  uint32_t bound = workspace.ostask.bound;
+
+  while (bound != 0) {
+    int source = 31 - __builtin_clz( bound );
+    if (workspace.ostask.bound_task[source] == task) return source;
+    bound &= ~(1 << source);
+  }
+
+  return -1;
+}
@@ -67,6 +67,8 @@ OSTask *TaskOpLockClaim( svc_registers *regs )
     regs->r[0] = 1;
   }
   else {
+    trace( TraceEvent_LockBlock, running, (uint32_t) lock, old.raw );
+
     next = stop_running_task( regs );
 
     assert( running->regs.r[0] == (uint32_t) lock );
@@ -102,49 +104,55 @@ OSTask *TaskOpLockRelease( svc_registers *regs )
   assert( !reclaimed );
 
   OSTask *resume = 0;
-  OSTask *t = shared.ostask.blocked;
-  if (t == 0) {
+  OSTask *head = shared.ostask.blocked;
+  OSTask *t = head;
+
+  // The first task waiting for this lock, anywhere in the list (the
+  // blocked list holds the tasks waiting for every lock)
+  if (t != 0) {
+    do {
+      if (t->regs.r[0] == r0) resume = t;
+      else t = t->next;
+    } while (resume == 0 && t != head);
+  }
+
+  if (resume == 0) {
+    // No task is waiting for this lock
     *lock = 0;
   }
   else {
-    while (t->regs.r[0] != r0 && t != shared.ostask.blocked) {
-      t = t->next;
-    }
+    t = resume->next;
 
-    if (t->regs.r[0] == r0) {
-      resume = t;
-
-      t = resume->next;
-
-      // Move resume away the the head of the list, if necessary
-      if (resume == shared.ostask.blocked) {
-        if (t == shared.ostask.blocked) {
-          shared.ostask.blocked = 0;
-          t = 0;
-        }
-        else {
-          shared.ostask.blocked = t;
-        }
+    // Move resume away the the head of the list, if necessary
+    if (resume == shared.ostask.blocked) {
+      if (t == shared.ostask.blocked) {
+        shared.ostask.blocked = 0;
+        t = 0;
+      }
+      else {
+        shared.ostask.blocked = t;
       }
+    }
 
-      dll_detach_OSTask( resume );
+    dll_detach_OSTask( resume );
 
-      OSTaskLock new_owner = { .raw = resume->regs.r[1] };
+    OSTaskLock new_owner = { .raw = ostask_handle( resume ) };
 
-      if (t != 0) {
-        do {
-          if (t->regs.r[0] == r0) new_owner.wanted = 1;
-          t = t->next;
-        } while (t != shared.ostask.blocked && new_owner.wanted == 0);
-      }
+    if (t != 0) {
+      do {
+        if (t->regs.r[0] == r0) new_owner.wanted = 1;
+        t = t->next;
+      } while (t != shared.ostask.blocked && new_owner.wanted == 0);
+    }
 
-      *lock = new_owner.raw;
+    *lock = new_owner.raw;
 
-      resume->regs.r[0] = 0; // boolean result - not already owner.
-      push_writes_to_cache();
+    resume->regs.r[0] = 0; // boolean result - not already owner.
+    push_writes_to_cache();
 
-      mpsafe_insert_OSTask_at_tail( &shared.ostask.runnable, resume );
-    }
+    trace( TraceEvent_LockWake, resume, r0, 0 );
+
+    make_runnable( resume );
   }
 
   release_ostask();
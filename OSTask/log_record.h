@@ -0,0 +1,157 @@
+/* Copyright 2025 Simon Willcocks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// For the readers of the log pipes: the data is text, interspersed with
+// binary records from Task_LogF (see ostaskops.h), which are formatted
+// here.
+//
+// Format conversions:
+//   %x  eight hex digits (as Task_LogHex)
+//   %d  unsigned decimal (as Task_LogSmallNumber)
+//   %c  character
+//   %s  nul terminated string (constant, see Task_LogF)
+//   %%  %
+// Anything else is copied as is.
+//
+// Typical use:
+//
+//   char const *p = data.location;
+//   uint32_t left = data.available;
+//   while (left != 0) {
+//     char line[LOG_RECORD_LINE];
+//     log_piece piece = log_next_piece( p, left, line, sizeof( line ) );
+//     output( piece.text, piece.length );
+//     p += piece.consumed;
+//     left -= piece.consumed;
+//   }
+
+#define LOG_RECORD_LINE 160
+
+typedef struct {
+  char const *text;     // To output
+  uint32_t length;
+  uint32_t consumed;    // Bytes of pipe data
+} log_piece;
+
+static inline uint32_t log_record_word( char const *p )
+{
+  uint8_t const *b = (void*) p;
+  return b[0] | (b[1] << 8) | (b[2] << 16) | (b[3] << 24);
+}
+
+static inline uint32_t log_record_decimal( char *out, uint32_t number )
+{
+  char digits[10];
+  int n = 0;
+  do {
+    digits[n++] = '0' + (number % 10);
+    number = number / 10;
+  } while (number != 0);
+
+  for (int i = 0; i < n; i++) out[i] = digits[n-1-i];
+
+  return n;
+}
+
+static inline uint32_t log_record_format( char *out, uint32_t size,
+                                          char const *format,
+                                          uint32_t count,
+                                          char const *args )
+{
+  char const hex[] = "0123456789abcdef";
+  uint32_t len = 0;
+  uint32_t arg = 0;
+
+  // Leave room for the longest conversion (%x, %d)
+  while (*format != '\0' && len + 10 < size) {
+    char c = *format++;
+
+    if (c != '%' || *format == '\0') {
+      out[len++] = c;
+      continue;
+    }
+
+    c = *format++;
+
+    if (c == '%') {
+      out[len++] = '%';
+      continue;
+    }
+
+    uint32_t value = 0;
+    if (arg < count) value = log_record_word( args + 4 * arg );
+    arg++;
+
+    switch (c) {
+    case 'x':
+      for (int i = 0; i < 8; i++) {
+        out[len++] = hex[(value >> (28 - 4 * i)) & 0xf];
+      }
+      break;
+    case 'd':
+      len += log_record_decimal( out + len, value );
+      break;
+    case 'c':
+      out[len++] = value;
+      break;
+    case 's':
+      {
+        char const *s = (void*) value;
+        if (s == 0) s = "(null)";
+        while (*s != '\0' && len < size) out[len++] = *s++;
+      }
+      break;
+    default:
+      out[len++] = '%';
+      out[len++] = c;
+      break;
+    }
+  }
+
+  return len;
+}
+
+// The next piece of the pipe data: a run of text, or a record, formatted
+// into line (of size bytes).
+static inline log_piece log_next_piece( char const *data, uint32_t available,
+                                        char *line, uint32_t size )
+{
+  log_piece result = { .text = data, .length = 0, .consumed = 0 };
+
+  if (data[0] != LOG_RECORD_MARKER) {
+    uint32_t n = 1;
+    while (n < available && data[n] != LOG_RECORD_MARKER) n++;
+    result.length = result.consumed = n;
+    return result;
+  }
+
+  uint32_t count = (available > 1) ? (uint8_t) data[1] : 0xff;
+  uint32_t length = LOG_RECORD_HEADER + 4 * count;
+
+  if (count > LOG_RECORD_MAX_ARGS || length > available) {
+    // The kernel writes whole records, so this is not a record; skip the
+    // marker byte.
+    result.consumed = 1;
+    return result;
+  }
+
+  char const *format = (void*) log_record_word( data + 2 );
+
+  result.text = line;
+  result.length = log_record_format( line, size, format, count, data + 6 );
+  result.consumed = length;
+
+  return result;
+}
@@ -295,6 +295,9 @@ void map_slot( OSTaskSlot *new )
   // TLB miss); could do that here, and only update the map if the ASID
   // has changed since the last time it was enabled.
   if (current != new) {
+    trace( TraceEvent_MapSlot, workspace.ostask.running,
+           (uint32_t) current, (uint32_t) new );
+
     clear_app_virtual_memory_area( current );
     mmu_switch_map( new->mmu_map );
     workspace.ostask.currently_mapped = new;
@@ -17,9 +17,12 @@
 
 // OK, to start with, temporarily, 1MiB sections
 extern OSTask OSTask_free_pool[];
+#define NUMBER_OF_TASKS 100 // FIXME How many in a MiB?
 extern OSTaskSlot OSTaskSlot_free_pool[];
+#define NUMBER_OF_SLOTS 100 // FIXME How many in a MiB?
 
 MPSAFE_DLL_TYPE( OSTaskSlot );
+MPSAFE_STACK_TYPE( OSTaskSlot );
 
 #ifdef DEBUG__EMERGENCY_UART_ACCESS
 #include "bcm_uart.h"
@@ -73,12 +76,11 @@ void setup_pools()
   }
 #endif
 
-  for (int i = 0; i < 100; i++) { // FIXME How many in a MiB?
+  // Pushed in reverse order, so the first in the array is the first used
+  for (int i = NUMBER_OF_TASKS - 1; i >= 0; i--) {
     OSTask *t = &OSTask_free_pool[i];
     memset( t, 0, sizeof( OSTask ) );
-    dll_new_OSTask( t );
-    dll_attach_OSTask( t, &shared.ostask.task_pool );
-    shared.ostask.task_pool = shared.ostask.task_pool->next;
+    mpsafe_push_OSTask( &shared.ostask.task_pool, t );
   }
 
   memory_mapping slots = {
@@ -91,19 +93,131 @@ void setup_pools()
     .usr32_access = 0 };
   if (slots.base_page == 0xffffffff) PANIC;
   map_memory( &slots );
-  for (int i = 0; i < 100; i++) { // FIXME How many in a MiB?
+  for (int i = NUMBER_OF_SLOTS - 1; i >= 0; i--) {
     OSTaskSlot *s = &OSTaskSlot_free_pool[i];
     memset( s, 0, sizeof( OSTaskSlot ) );
-    dll_new_OSTaskSlot( s );
     s->mmu_map = i; // FIXME: Will run out of values at 65536
-    dll_attach_OSTaskSlot( s, &shared.ostask.slot_pool );
-    shared.ostask.slot_pool = shared.ostask.slot_pool->next;
+    mpsafe_push_OSTaskSlot( &shared.ostask.slot_pool, s );
   }
 
   setup_pipe_pool();
   setup_queue_pool();
 }
 
+#ifdef DEBUG__BOOT_TRACE
+#define BOOT_TRACE_ENTRIES (sizeof( shared.ostask.boot_trace ) / sizeof( shared.ostask.boot_trace[0] ))
+#define BOOT_TRACE_COMPLETE 0xffffffff
+
+void boot_trace_record( char const *stage, char const *detail )
+{
+  uint32_t volatile *count = &shared.ostask.boot_trace_count;
+  uint32_t i;
+
+  do {
+    i = *count;
+    if (i >= BOOT_TRACE_ENTRIES) return; // Full, or boot complete
+  } while (i != change_word_if_equal( count, i, i + 1 ));
+
+  shared.ostask.boot_trace[i].time = (uint32_t) timer_count();
+  shared.ostask.boot_trace[i].core = workspace.core;
+  shared.ostask.boot_trace[i].stage = stage;
+  shared.ostask.boot_trace[i].detail = detail;
+}
+
+// Stops the recording, the entries can then be read with boot_trace_line
+void boot_trace_stop()
+{
+  uint32_t volatile *count = &shared.ostask.boot_trace_count;
+  uint32_t entries;
+
+  do {
+    entries = *count;
+    if (entries == BOOT_TRACE_COMPLETE) return;
+  } while (entries != change_word_if_equal( count, entries, BOOT_TRACE_COMPLETE ));
+
+  if (entries > BOOT_TRACE_ENTRIES) entries = BOOT_TRACE_ENTRIES;
+  shared.ostask.boot_trace_entries = entries;
+  push_writes_to_cache();
+}
+
+// No 64-bit division available, and the frequency is not necessarily
+// a multiple of 1MHz (it's 62.5MHz in qemu).
+static uint32_t ticks_to_us( uint32_t ticks, uint32_t khz )
+{
+  return (ticks / khz) * 1000 + ((ticks % khz) * 1000) / khz;
+}
+
+typedef struct {
+  char *p;
+  char *end;
+} line_buffer;
+
+static void add_string( line_buffer *l, char const *s )
+{
+  while (*s != '\0' && l->p < l->end) *l->p++ = *s++;
+}
+
+static void add_number( line_buffer *l, uint32_t n )
+{
+  char digits[10];
+  int i = 0;
+  do {
+    digits[i++] = '0' + (n % 10);
+    n = n / 10;
+  } while (n != 0);
+  while (i > 0 && l->p < l->end) *l->p++ = digits[--i];
+}
+
+// Formats line number `line' of the boot trace into buffer (of size
+// bytes), ending with a newline. Line 0 is the time from reset to the
+// kernel being entered, then there's one line per entry.
+// Returns the length of the line, or zero if there are no more lines
+// (or the boot is not complete).
+uint32_t boot_trace_line( uint32_t line, char *buffer, uint32_t size )
+{
+  if (shared.ostask.boot_trace_count != BOOT_TRACE_COMPLETE) return 0;
+
+  uint32_t entries = shared.ostask.boot_trace_entries;
+  bool full = (entries == BOOT_TRACE_ENTRIES);
+
+  if (size < 2 || entries == 0 || line > entries + (full ? 1 : 0)) return 0;
+
+  uint32_t khz = timer_frequency() / 1000;
+  if (khz == 0) khz = 1;
+
+  uint32_t start = shared.ostask.boot_trace[0].time;
+
+  // Leave room for the newline
+  line_buffer l = { .p = buffer, .end = buffer + size - 1 };
+
+  if (line == 0) {
+    add_string( &l, "Boot trace, kernel entered " );
+    add_number( &l, ticks_to_us( start, khz ) );
+    add_string( &l, "us after reset" );
+  }
+  else if (line <= entries) {
+    uint32_t i = line - 1;
+    add_string( &l, "+" );
+    add_number( &l, ticks_to_us( shared.ostask.boot_trace[i].time - start, khz ) );
+    add_string( &l, "us core " );
+    add_number( &l, shared.ostask.boot_trace[i].core );
+    add_string( &l, " " );
+    add_string( &l, shared.ostask.boot_trace[i].stage );
+    if (shared.ostask.boot_trace[i].detail != 0) {
+      add_string( &l, " " );
+      add_string( &l, shared.ostask.boot_trace[i].detail );
+    }
+  }
+  else {
+    add_string( &l, "Boot trace full" );
+  }
+
+  *l.p++ = '\n';
+
+  return l.p - buffer;
+}
+#endif
+
 static void setup_processor_vectors();
 
 void __attribute__(( naked, noreturn )) idle_task();
@@ -126,6 +240,9 @@ void __attribute__(( noreturn )) boot_with_stack( uint32_t core )
   bool first = (shared.ostask.first == 0);
 
   workspace.core = core;
+  workspace.ostask.accounted = timer_count();
+
+  boot_trace( "boot_with_stack", 0 );
 
   if (first)
   {
@@ -138,25 +255,31 @@ void __attribute__(( noreturn )) boot_with_stack( uint32_t core )
     free_contiguous_memory( ((uint32_t) &top_of_boot_RAM) >> 12,
                             (&top_of_minimum_RAM - &top_of_boot_RAM) >> 12 );
 
+    boot_trace( "setup_pools", 0 );
+
     setup_pools();
 
-    shared.ostask.first = mpsafe_detach_OSTaskSlot_at_head( &shared.ostask.slot_pool );
+    shared.ostask.first = mpsafe_pop_OSTaskSlot( &shared.ostask.slot_pool );
   }
 
   setup_processor_vectors();
 
   release_ostask();
 
+  boot_trace( "create_log_pipe", 0 );
+
   create_log_pipe();
 
   // Make this running code into an OSTask
-  workspace.ostask.running = mpsafe_detach_OSTask_at_head( &shared.ostask.task_pool );
+  workspace.ostask.running = mpsafe_pop_OSTask( &shared.ostask.task_pool );
 
   workspace.ostask.running->saved = boot_with_stack;
   workspace.ostask.running->running = 1; // Already running
   workspace.ostask.running->slot = shared.ostask.first;
   map_first_slot();
 
+  boot_trace( "mmu_establish_resources", 0 );
+
   mmu_establish_resources();
 
 #ifdef DEBUG__ENABLE_EVENT_STREAM
@@ -168,7 +291,7 @@ void __attribute__(( noreturn )) boot_with_stack( uint32_t core )
 
   if (first) {
     // Create a separate idle OSTask
-    OSTask *idle = mpsafe_detach_OSTask_at_head( &shared.ostask.task_pool );
+    OSTask *idle = mpsafe_pop_OSTask( &shared.ostask.task_pool );
     idle->regs.lr = (uint32_t) idle_task;
 
     // usr32, interrupts enabled
@@ -176,6 +299,7 @@ void __attribute__(( noreturn )) boot_with_stack( uint32_t core )
     idle->slot = shared.ostask.first;
 
     idle->saved = boot_with_stack;
+    idle->times.idle_core = core + 1;
 
     workspace.ostask.idle = idle;
 
@@ -188,12 +312,15 @@ Task_LogHexP( workspace.ostask.idle );
 Task_LogNewLine();
 #endif
 
+    boot_trace( "startup", 0 );
+
     startup();
   }
   else {
     // Become the idle OSTask
     workspace.ostask.idle = workspace.ostask.running;
     workspace.ostask.idle->slot = shared.ostask.first;
+    workspace.ostask.idle->times.idle_core = core + 1;
 
     // Before we start scheduling tasks from other cores, ensure the shared
     // memory areas that memory_fault_handlers might use are mapped into this
@@ -208,6 +335,8 @@ Task_LogNewLine();
       :
       : [reset_sp] "r" ((&workspace.svc_stack)+1) );
 
+    boot_trace( "idle_task", 0 );
+
     idle_task();
   }
 
@@ -263,6 +392,10 @@ void save_task_state( svc_registers const *regs )
   running->saved = save_task_state; // Clears running flag
   if (running->running) PANIC;
 
+  account_kernel_time( running );
+
+  pmu_task_stopped( running );
+
   running->regs = *regs;
 
   if (running->regs.lr == 0) PANIC;
@@ -296,6 +429,7 @@ DEFINE_ERROR( UnknownPipeSWI, 0x888, "Unknown Pipe operation" );
 DEFINE_ERROR( InvalidPipeHandle, 0x888, "Invalid Pipe handle" );
 DEFINE_ERROR( InvalidQueue, 0x888, "Invalid OSTask Queue handle" );
 DEFINE_ERROR( UnknownQueueSWI, 0x888, "Unknown Queue operation" );
+DEFINE_ERROR( UnknownTraceReason, 0x888, "Unknown Trace reason" );
 
 DEFINE_ERROR( NotATask, 0x666, "Programmer error: Not a task" );
 DEFINE_ERROR( NotYourTask, 0x667, "Programmer error: Not your task" );
@@ -388,6 +522,8 @@ OSTask *TaskOpReleaseTask( svc_registers *regs )
   // Giving up control over the given task
   pop_controller( release );
 
+  if (release->queued_on != 0) queued_swi_completed( release );
+
   if (context != 0) {
     release->regs = *context;
   }
@@ -418,7 +554,7 @@ OSTask *TaskOpReleaseTask( svc_registers *regs )
     // pick up the resumed task.
     //   TODO When should FP context be stored? Tasks put into runnable
     //   must not own the FP for the current core.
-    mpsafe_insert_OSTask_at_tail( &shared.ostask.runnable, release );
+    make_runnable( release );
   }
 
   return 0;
@@ -692,12 +828,12 @@ OSTask *IdleTaskYield( svc_registers *regs )
     assert( resume->regs.r[0] == workspace.core );
   }
 
-  if (resume == 0 && shared.ostask.runnable != 0) {
+  if (resume == 0 && !mpsafe_OSTask_queue_empty( &shared.ostask.runnable )) {
     // Pull from general runnable list, if anything in it.
     // The above check is mp-safe, because word reads are atomic.
-    // You can't use the value, though, because it may already
+    // You can't rely on the result, though, because it may already
     // have changed.
-    resume = mpsafe_detach_OSTask_at_head( &shared.ostask.runnable );
+    resume = mpsafe_dequeue_OSTask( &shared.ostask.runnable );
 
 #ifdef DEBUG__FOLLOW_TASKS_A_LOT
     if (resume != 0) {
@@ -768,7 +904,7 @@ Task_LogNewLine();
     Task_LogHex( ostask_handle( running ) );
     Task_LogNewLine();
 #endif
-    mpsafe_insert_OSTask_at_tail( &shared.ostask.runnable, running );
+    make_runnable( running );
   }
 
   return resume;
@@ -806,7 +942,7 @@ OSTask *TaskOpCreate( svc_registers *regs, bool spawn )
     return Error_InvalidInitialStack( regs );
 
   OSTask *running = workspace.ostask.running;
-  OSTask *task = mpsafe_detach_OSTask_at_head( &shared.ostask.task_pool );
+  OSTask *task = mpsafe_pop_OSTask( &shared.ostask.task_pool );
 
   assert( task->next == task || task->prev == task );
   for (int i = 0; i < sizeof( *task ) / 4; i++) {
@@ -816,7 +952,7 @@ OSTask *TaskOpCreate( svc_registers *regs, bool spawn )
   task->prev = task;
 
   if (spawn) {
-    task->slot = mpsafe_detach_OSTaskSlot_at_head( &shared.ostask.slot_pool );
+    task->slot = mpsafe_pop_OSTaskSlot( &shared.ostask.slot_pool );
     memset( task->slot, 0, sizeof( *task->slot ) );
     task->slot->number_of_tasks = 1;
     task->slot->command = 0;
@@ -917,8 +1053,30 @@ OSTask *TaskOpWaitForInterrupt( svc_registers *regs )
   OSTask *running = workspace.ostask.running;
 
   if (0 == (regs->spsr & 0x80)) PANIC; // Must always have interrupts disabled
+
+  int source = bound_interrupt_source( running );
+
+  if (source >= 0) {
+    // Raised again before the task was waiting for it; irq_handler
+    // doesn't pass bound sources to the controller module's task, so
+    // there's nothing to wait for.
+    if (0 != (interrupt_sources_pending() & (1 << source))) return 0;
+
+    // Resumed directly by irq_handler, see interrupts.c
+    OSTask *resume = stop_running_task( regs );
+
+    workspace.ostask.bound_waiting |= (1 << source);
+
+    return resume;
+  }
+
   if (workspace.ostask.irq_task != 0) PANIC; // TODO Sin bin, both of these
 
+  // The interrupt controller module's task. If it has registered the
+  // interrupt sources, this core's register is mapped before the
+  // next interrupt.
+  interrupt_sources_mapped();
+
   OSTask *resume = stop_running_task( regs );
 
   workspace.ostask.irq_task = running;
@@ -1085,6 +1243,107 @@ OSTask *TaskOpMapFrameBuffer( svc_registers *regs )
   return 0;
 }
 
+// Tasks are never returned to the pool (yet, see TaskOpEndTask), and
+// every task taken from it has a saved state (or is running).
+// The times are read without a lock; they may be a little out of date.
+static inline
+OSTask *TaskOpTaskTimes( svc_registers *regs )
+{
+  uint32_t index = regs->r[0];
+  task_times *times = (void*) regs->r[1];
+
+  while (index < NUMBER_OF_TASKS && OSTask_free_pool[index].saved == 0)
+    index++;
+
+  if (index >= NUMBER_OF_TASKS) {
+    regs->r[0] = 0;
+    return 0;
+  }
+
+  OSTask *task = &OSTask_free_pool[index];
+
+  task_times copy = {
+    .ticks_per_second = timer_frequency(),
+    .handle = ostask_handle( task ),
+    .idle_core = task->times.idle_core,
+    .switches = task->times.switches,
+    .user = task->times.user,
+    .kernel = task->times.kernel,
+    .waiting = task->times.waiting };
+
+  *times = copy;
+
+  regs->r[0] = index + 1;
+
+  return 0;
+}
+
+// Reason 0: Set the trace mask, r1 = new mask
+//   Returns r0 = old mask, r1 = ticks per second
+// Reason 1: Read a core's trace records, oldest first
+//   r1 = core, r2 = first record number, r3 -> buffer, r4 = max records
+//   Returns r0 = records copied, r2 = next record number
+// Reason 2: Read a line of the boot trace (see boot_trace, in ostask.h)
+//   r1 = line number (from 0), r2 -> buffer, r3 = buffer size
+//   Returns r0 = length of the line, including its newline, or 0 if
+//   there are no more lines
+// The records are read without a lock; any being written by the core at
+// the time may be incomplete.
+static inline
+OSTask *TaskOpTrace( svc_registers *regs )
+{
+  switch (regs->r[0]) {
+  case 0:
+    regs->r[0] = shared.ostask.trace_mask;
+    shared.ostask.trace_mask = regs->r[1];
+    regs->r[1] = timer_frequency();
+    push_writes_to_cache();
+    break;
+  case 1:
+    {
+      uint32_t core = regs->r[1];
+      uint32_t sequence = regs->r[2];
+      trace_record *buffer = (void*) regs->r[3];
+      uint32_t max = regs->r[4];
+      uint32_t copied = 0;
+
+      if (core < OSTASK_TRACE_CORES && core < shared.ostask.number_of_cores) {
+        uint32_t count = shared.ostask.trace[core].count;
+
+        if (count - sequence > OSTASK_TRACE_ENTRIES)
+          sequence = count - OSTASK_TRACE_ENTRIES;
+
+        while (copied < max && sequence != count) {
+          uint32_t index = sequence & (OSTASK_TRACE_ENTRIES - 1);
+          trace_record record = {
+            .time = shared.ostask.trace[core].record[index].time,
+            .event = shared.ostask.trace[core].record[index].event,
+            .task = shared.ostask.trace[core].record[index].task,
+            .a = shared.ostask.trace[core].record[index].a,
+            .b = shared.ostask.trace[core].record[index].b };
+          buffer[copied++] = record;
+          sequence++;
+        }
+      }
+
+      regs->r[0] = copied;
+      regs->r[2] = sequence;
+    }
+    break;
+  case 2:
+#ifdef DEBUG__BOOT_TRACE
+    regs->r[0] = boot_trace_line( regs->r[1], (void*) regs->r[2], regs->r[3] );
+#else
+    regs->r[0] = 0;
+#endif
+    break;
+  default:
+    return Error_UnknownTraceReason( regs );
+  }
+
+  return 0;
+}
+
 static inline
 OSTask *TaskOpAppMemoryTop( svc_registers *regs )
 {
@@ -1194,7 +1453,35 @@ OSTask *ostask_svc( svc_registers *regs, int number )
     assert( resume == 0 );
     assert( 0 == (regs->spsr & VF) );
     break;
-  case OSTask_PipeCreate ... OSTask_PipeCreate + 15:
+  case OSTask_LogRecord:
+    resume = TaskOpLogRecord( regs );
+    assert( resume == 0 );
+    assert( 0 == (regs->spsr & VF) );
+    break;
+  case OSTask_TaskTimes:
+    resume = TaskOpTaskTimes( regs );
+    break;
+  case OSTask_Trace:
+    resume = TaskOpTrace( regs );
+    break;
+  case OSTask_Profile:
+    resume = TaskOpProfile( regs );
+    break;
+  case OSTask_PerformanceCounters:
+    resume = TaskOpPerformanceCounters( regs );
+    break;
+  case OSTask_LogStringWait:
+    {
+      bool reclaimed = core_claim_lock( &shared.ostask.pipes_lock,
+                                        workspace.core+1 );
+      assert( !reclaimed );
+
+      resume = TaskOpLogStringWait( regs );
+
+      if (!reclaimed) core_release_lock( &shared.ostask.pipes_lock );
+    }
+    break;
+  case OSTask_PipeCreate ... OSTask_PipeCreate + 13:
     {
       bool reclaimed = core_claim_lock( &shared.ostask.pipes_lock,
                                         workspace.core+1 );
@@ -1240,7 +1527,22 @@ OSTask *ostask_svc( svc_registers *regs, int number )
       if (!reclaimed) core_release_lock( &shared.ostask.pipes_lock );
     }
     break;
-  case OSTask_QueueCreate ... OSTask_QueueCreate + 16:
+  case OSTask_InterruptSources:
+    resume = TaskOpInterruptSources( regs );
+    break;
+  case OSTask_BindInterrupt:
+    resume = TaskOpBindInterrupt( regs );
+    break;
+  case OSTask_Time:
+    resume = TaskOpTime( regs );
+    break;
+  case OSTask_SleepUntil:
+    resume = TaskOpSleepUntil( regs );
+    break;
+  case OSTask_SleepMicroseconds:
+    resume = TaskOpSleepMicroseconds( regs );
+    break;
+  case OSTask_QueueCreate ... OSTask_QueueStatistics:
     {
       OSQueue *queue = 0;
 
@@ -1268,6 +1570,9 @@ OSTask *ostask_svc( svc_registers *regs, int number )
           case OSTask_QueueWaitCoreAndSWI:
             resume = QueueWait( regs, queue, true, true );
             break;
+          case OSTask_QueueStatistics:
+            resume = QueueStatistics( regs, queue );
+            break;
           default:
             {
             resume = Error_UnknownQueueSWI( regs );
@@ -1294,10 +1599,14 @@ OSTask *ostask_svc( svc_registers *regs, int number )
 
 void __attribute__(( noreturn )) execute_svc( svc_registers *regs )
 {
+  account_user_time( workspace.ostask.running );
+
   regs->spsr &= ~VF;
 
   uint32_t number = get_svc_number( regs->lr );
 
+  trace( TraceEvent_SWIEntry, workspace.ostask.running, number, regs->r[0] );
+
   execute_swi( regs, number );
 
   __builtin_unreachable();
@@ -1369,10 +1678,40 @@ void __attribute__(( naked, noreturn )) irq_handler()
     interrupted_mode = mode & 0x1f;
   }
 
+  uint32_t taken = timer_count();
+
   assert( interrupted_task->running );
   interrupted_task->saved = irq_handler;
   assert( !interrupted_task->running );
 
+  if (interrupted_mode == 0x10)
+    account_user_time( interrupted_task );
+  else
+    account_kernel_time( interrupted_task );
+
+  pmu_task_stopped( interrupted_task );
+
+  trace( TraceEvent_IRQ, interrupted_task,
+         interrupted_mode, interrupted_task->regs.lr );
+
+  if (workspace.ostask.profile.interval != 0)
+    profile_interrupt( interrupted_task, interrupted_mode );
+
+  if (workspace.ostask.timers != 0)
+    timers_expired();
+
+  // Tasks bound to pending sources are resumed directly (interrupts.c),
+  // the interrupt controller module's task is resumed for any other
+  // sources (or if the sources aren't known).
+  uint32_t pending = interrupt_sources_pending();
+
+  if (pending == 0 && workspace.ostask.irq_sources != 0) {
+    // Only the kernel's timer, or the profiler's; nothing for the
+    // interrupt tasks, so the interrupted task continues.
+    void *stack_top = ((&workspace.ostask.irq_stack)+1);
+    return_to_swi_caller( interrupted_task, &interrupted_task->regs, stack_top );
+  }
+
   if (interrupted_mode != 0x10) {
     // Legacy RISC OS code allows for SWIs to be interrupted, this is
     // a Bad Thing. (IMO.)
@@ -1384,12 +1723,24 @@ void __attribute__(( naked, noreturn )) irq_handler()
 
   assert( workspace.ostask.interrupted_tasks == 0 );
 
-  OSTask *irq_task = workspace.ostask.irq_task;
-  workspace.ostask.irq_task = 0;
+  // Bound sources whose task isn't waiting are left pending for the
+  // task's next OSTask_WaitForInterrupt; the controller module would
+  // mask them.
+  uint32_t wake = pending & workspace.ostask.bound_waiting;
+  uint32_t unbound = pending & ~workspace.ostask.bound;
 
-  // The interrupted task stays on this core, this shouldn't take long!
+  OSTask *irq_task = 0;
+
+  if (wake == 0 || unbound != 0) {
+    irq_task = workspace.ostask.irq_task;
+    workspace.ostask.irq_task = 0;
+
+    if (irq_task == 0) PANIC;
+  }
 
-  if (irq_task == 0) PANIC;
+  workspace.ostask.bound_waiting &= ~wake;
+
+  // The interrupted task stays on this core, this shouldn't take long!
 
   // Sideline the interruptable tasks running on this core until the
   // interrupt tasks are done and the idle task runs (calls yield) again.
@@ -1425,13 +1776,28 @@ void __attribute__(( naked, noreturn )) irq_handler()
   // task that may not sleep or yield much.
   workspace.ostask.running = workspace.ostask.idle;
 
-  // New head of core's running list
-  dll_attach_OSTask( irq_task, &workspace.ostask.running );
+  // New head of core's running list. The bound tasks go in front of the
+  // interrupt controller module's task.
+  OSTask *resume = irq_task;
+
+  if (irq_task != 0) {
+    irq_task->regs.r[0] = unbound;
+    irq_task->regs.r[1] = taken;
+    dll_attach_OSTask( irq_task, &workspace.ostask.running );
+  }
+
+  while (wake != 0) {
+    int source = 31 - __builtin_clz( wake );
+    wake &= ~(1 << source);
+
+    resume = workspace.ostask.bound_task[source];
+    dll_attach_OSTask( resume, &workspace.ostask.running );
+  }
 
-  // The interrupt task is always in OSTask_WaitForInterrupt
+  // The interrupt tasks are always in OSTask_WaitForInterrupt
 
   void *stack_top = ((&workspace.ostask.irq_stack)+1);
-  return_to_swi_caller( irq_task, &irq_task->regs, stack_top );
+  return_to_swi_caller( resume, &resume->regs, stack_top );
 
   __builtin_unreachable();
 }
@@ -34,6 +34,34 @@ void execute_swi( svc_registers *regs, int number );
 // SWIs in the range OSTask_Yield ... OSTask_Yield + 63
 OSTask *ostask_svc( svc_registers *regs, int number );
 
+// Boot trace: with DEBUG__BOOT_TRACE, records the generic timer count
+// at each stage of booting (and each module initialisation) in
+// shared.ostask, until the boot is complete (Service_PostInit). The
+// HAL's boot task then reads it a line at a time (OSTask_Trace reason 2)
+// and writes it to the log, at a pace the log pipe can take. The detail,
+// if not NULL, follows the stage name in the log. Both strings must
+// remain valid until then.
+// Without DEBUG__BOOT_TRACE, these do nothing (and there are no lines).
+#ifdef DEBUG__BOOT_TRACE
+void boot_trace_record( char const *stage, char const *detail );
+void boot_trace_stop();
+uint32_t boot_trace_line( uint32_t line, char *buffer, uint32_t size );
+#endif
+
+static inline void boot_trace( char const *stage, char const *detail )
+{
+#ifdef DEBUG__BOOT_TRACE
+  boot_trace_record( stage, detail );
+#endif
+}
+
+static inline void boot_trace_complete()
+{
+#ifdef DEBUG__BOOT_TRACE
+  boot_trace_stop();
+#endif
+}
+
 static inline
 void __attribute__(( noreturn )) return_to_swi_caller( 
                         OSTask *task,
@@ -172,11 +200,38 @@ struct __attribute__(( packed, aligned( 4 ) )) OSTask {
     uint32_t running:1;
   };
 
+  // For queue statistics: the queue this task called a SWI through,
+  // and when it was queued, or handed to a handler (see queues.c)
+  OSQueue *queued_on;
+  uint32_t queue_timestamp;
+  uint32_t queue_arrival;       // Order of arrival on an indexed queue
+
+  // CPU time accounting, in generic timer ticks (see make_runnable, etc.)
+  struct {
+    uint64_t user;
+    uint64_t kernel;
+    uint64_t waiting;
+    uint32_t switches;
+    uint32_t runnable;  // Low word of the count when made runnable, or 0
+    uint32_t idle_core; // Core number + 1 for an idle task, or 0
+  } times;
+
+  // Performance counters, see pmu.c
+  struct {
+    uint32_t enabled;   // As PMCNTENSET, 0 if the task doesn't use the PMU
+    uint32_t user_read;
+    uint32_t event[4];
+    uint32_t counter[4];
+    uint32_t cycles;
+  } pmu;
+
   OSTask *next;
   OSTask *prev;
 };
 
 MPSAFE_DLL_TYPE( OSTask );
+MPSAFE_STACK_TYPE( OSTask );
+MPSAFE_MPSC_TYPE( OSTask );
 
 // Application memory management (memory.c)
 uint32_t map_device_pages( uint32_t va,
@@ -232,6 +287,8 @@ static inline uint32_t pipe_handle( OSPipe *pipe )
 void setup_pipe_pool();
 
 OSTask *TaskOpLogString( svc_registers *regs );
+OSTask *TaskOpLogStringWait( svc_registers *regs );
+OSTask *TaskOpLogRecord( svc_registers *regs );
 OSTask *PipeCreate( svc_registers *regs );
 OSTask *PipeWaitForSpace( svc_registers *regs, OSPipe *pipe );
 OSTask *PipeSpaceFilled( svc_registers *regs, OSPipe *pipe );
@@ -252,6 +309,9 @@ void setup_queue_pool();
 OSTask *QueueCreate( svc_registers *regs );
 OSTask *QueueWait( svc_registers *regs, OSQueue *queue,
                    bool swi, bool core );
+OSTask *QueueStatistics( svc_registers *regs, OSQueue *queue );
+// The handler of a queued SWI has released the caller
+void queued_swi_completed( OSTask *caller );
 
 OSTask *TaskOpLockClaim( svc_registers *regs );
 OSTask *TaskOpLockRelease( svc_registers *regs );
@@ -261,6 +321,45 @@ void sanity_check();
 void sleeping_tasks_add( OSTask *tired );
 void sleeping_tasks_tick();
 
+// Performance counters (pmu.c)
+OSTask *TaskOpPerformanceCounters( svc_registers *regs );
+// The task's counters are live on this core from pmu_load until pmu_save
+void pmu_save( OSTask *task );
+void pmu_load( OSTask *task );
+
+static inline void pmu_task_stopped( OSTask *task )
+{
+  if (task->pmu.enabled != 0) pmu_save( task );
+}
+
+// Sampling profiler (profile.c)
+OSTask *TaskOpProfile( svc_registers *regs );
+// Called on every interrupt while this core is sampling
+void profile_interrupt( OSTask *interrupted, uint32_t mode );
+
+// Interrupt sources bound to tasks (interrupts.c)
+OSTask *TaskOpInterruptSources( svc_registers *regs );
+OSTask *TaskOpBindInterrupt( svc_registers *regs );
+// Maps this core's source register, false if not registered
+bool interrupt_sources_mapped();
+// The source the task is bound to on this core, or -1
+int bound_interrupt_source( OSTask *task );
+
+// The sources pending on this core, 0 if the register isn't mapped. The
+// timer's interrupt is the kernel's, see timers_expired.
+static inline uint32_t interrupt_sources_pending()
+{
+  uint32_t volatile *sources = workspace.ostask.irq_sources;
+  return (sources == 0) ? 0 : *sources & ~shared.ostask.timer_source;
+}
+
+// Per-core timers (timers.c)
+OSTask *TaskOpTime( svc_registers *regs );
+OSTask *TaskOpSleepUntil( svc_registers *regs );
+OSTask *TaskOpSleepMicroseconds( svc_registers *regs );
+// Called on every interrupt, releases the tasks whose time has come
+void timers_expired();
+
 static inline bool push_controller( OSTask *task, OSTask *controller )
 {
 #ifdef DEBUG__FOLLOW_CONTROLLERS
@@ -418,6 +517,70 @@ void get_usr_registers( OSTask *task )
       , [lr] "=r" (task->banked_lr_usr) );
 }
 
+// Kernel event trace: always compiled in, but only the events enabled by
+// OSTask_Trace are recorded, in this core's ring in shared.ostask.
+// Should an interrupt record an event while this is running, the later
+// record may be lost; this is a diagnostic tool.
+static inline void trace( uint32_t event, OSTask *task, uint32_t a, uint32_t b )
+{
+  if (0 == (shared.ostask.trace_mask & (1 << event))) return;
+
+  uint32_t core = workspace.core;
+  if (core >= OSTASK_TRACE_CORES) return;
+
+  uint32_t index = shared.ostask.trace[core].count++;
+  index = index & (OSTASK_TRACE_ENTRIES - 1);
+
+  shared.ostask.trace[core].record[index].time = timer_count();
+  shared.ostask.trace[core].record[index].event = event;
+  shared.ostask.trace[core].record[index].task = ostask_handle( task );
+  shared.ostask.trace[core].record[index].a = a;
+  shared.ostask.trace[core].record[index].b = b;
+}
+
+// CPU time accounting: each event (entering the kernel, a task stopping
+// or being resumed) reads the generic timer once and charges the time
+// since the previous event on this core to a task. The time a task
+// spends waiting for a core is measured from make_runnable.
+// A core's idle time is the time charged to its idle task.
+
+static inline uint32_t time_since_last_accounted()
+{
+  uint32_t now = timer_count();
+  uint32_t time = now - workspace.ostask.accounted;
+  workspace.ostask.accounted = now;
+  return time;
+}
+
+// The task has been running its own code (in any mode) until now
+static inline void account_user_time( OSTask *task )
+{
+  task->times.user += time_since_last_accounted();
+}
+
+// The kernel has been doing work for the task until now
+static inline void account_kernel_time( OSTask *task )
+{
+  task->times.kernel += time_since_last_accounted();
+}
+
+// Call after account_kernel_time, for a task about to be resumed
+static inline void account_resumed( OSTask *task )
+{
+  task->times.switches++;
+  if (task->times.runnable != 0) {
+    task->times.waiting += workspace.ostask.accounted - task->times.runnable;
+    task->times.runnable = 0;
+  }
+}
+
+// Put the task on the shared runnable list, for any core to pick up.
+static inline void make_runnable( OSTask *task )
+{
+  task->times.runnable = timer_count();
+  mpsafe_enqueue_OSTask( &shared.ostask.runnable, task );
+}
+
 static inline
 OSTask *stop_running_task( svc_registers const *regs )
 {
@@ -452,11 +615,23 @@ void __attribute__(( noreturn )) return_to_swi_caller(
 
     assert( !task->running );
     task->running = 1;
+
+    account_kernel_time( task );
+    account_resumed( task );
+
+    if (task->pmu.enabled != 0) pmu_load( task );
+
+    trace( TraceEvent_Switch, task, 0, 0 );
   }
   else {
     assert( workspace.ostask.running->running );
+
+    account_kernel_time( workspace.ostask.running );
   }
 
+  trace( TraceEvent_SWIExit, workspace.ostask.running,
+         regs->r[0], (regs->spsr & VF) != 0 );
+
   assert( task == 0 || task == workspace.ostask.running );
 
   if (task != 0) map_slot( task->slot );
@@ -64,6 +64,10 @@ enum {
 
   , OSTask_GetLogPipe           // 0x2da For the current core, to read.
   , OSTask_LogString            // 0x2db to the log pipe (any task).
+  , OSTask_TaskTimes            // 0x2dc r0 = index, r1 -> task_times
+  , OSTask_Trace                // 0x2dd Kernel event trace, r0 = reason
+  , OSTask_Profile              // 0x2de Sampling profiler, r0 = reason
+  , OSTask_PerformanceCounters  // 0x2df PMU counters, r0 = reason
 
   , OSTask_PipeCreate = OSTask_Yield + 32 // 0x2e0
   , OSTask_PipeWaitForSpace
@@ -77,14 +81,30 @@ enum {
   , OSTask_PipeNotListening
   , OSTask_PipeWaitUntilEmpty
 
+  , OSTask_LogStringWait = OSTask_PipeCreate + 14 // 0x2ee to the log pipe,
+                                // blocking while it's full (any task).
+  , OSTask_LogRecord = OSTask_PipeCreate + 15 // 0x2ef to the log pipe,
+                                // formatted by the reader (any task).
+
   , OSTask_QueueCreate = OSTask_PipeCreate + 16 // 0x2f0
   , OSTask_QueueDelete
   , OSTask_QueueWait
-  , OSTask_QueueWaitCore        // No implementation
-  , OSTask_QueueWaitSWI         // No implementation
-  , OSTask_QueueWaitCoreAndSWI  // No implementation
+  , OSTask_QueueWaitCore        // r2 = core
+  , OSTask_QueueWaitSWI         // r1 = SWI offset in module chunk (0-63)
+  , OSTask_QueueWaitCoreAndSWI  // r1 = SWI offset, r2 = core
 
   , OSTask_QueueR12             // For modules to route SWIs to providers
+  , OSTask_QueueStatistics      // r1 -> queue_statistics, r2 = reset
+
+  // Interrupt handling, continued
+  , OSTask_InterruptSources = OSTask_QueueCreate + 8 // 0x2f8 For the
+                                // interrupt controller module.
+  , OSTask_BindInterrupt        // 0x2f9 Wake me directly for a source
+
+  // Per-core timers, in ticks of the generic timer's physical count
+  , OSTask_Time                 // 0x2fa r0,r1 = count, r2 = ticks/second
+  , OSTask_SleepUntil           // r0,r1 = deadline
+  , OSTask_SleepMicroseconds    // r0 = us, returns r0,r1 = deadline
 };
 
 // "memory" clobber, because the task might have moved cores by
@@ -104,6 +124,75 @@ void Task_Sleep( uint32_t ms )
     : "lr", "cc", "memory" );
 }
 
+// Per-core timers: the generic timer's physical count, which is the same
+// on every core and never goes backwards, and its frequency.
+static inline
+uint64_t Task_Time()
+{
+  register uint32_t lo asm ( "r0" );
+  register uint32_t hi asm ( "r1" );
+  asm volatile ( "svc %[swi]"
+    : "=r" (lo)
+    , "=r" (hi)
+    : [swi] "i" (OSTask_Time)
+    : "lr", "cc", "r2" );
+  return (((uint64_t) hi) << 32) | lo;
+}
+
+static inline
+uint32_t Task_TimeFrequency()
+{
+  register uint32_t hz asm ( "r2" );
+  asm volatile ( "svc %[swi]"
+    : "=r" (hz)
+    : [swi] "i" (OSTask_Time)
+    : "lr", "cc", "r0", "r1" );
+  return hz;
+}
+
+// Sleeps until the count reaches deadline (returns immediately if it
+// already has), woken by the timer of the core it was running on. Unlike
+// Task_Sleep, not limited to the ticker's resolution. The tasks woken go
+// into the runnable list.
+static inline
+error_block *Task_SleepUntil( uint64_t deadline )
+{
+  register uint32_t lo asm ( "r0" ) = (uint32_t) deadline;
+  register uint32_t hi asm ( "r1" ) = (uint32_t) (deadline >> 32);
+  register error_block *error asm ( "r0" );
+  asm volatile ( "subs r0, r0, #0\n  svc %[swi]"
+             "\n  movvc r0, #0"
+    : "=r" (error)
+    , "+r" (hi)
+    : [swi] "i" (OSTask_SleepUntil)
+    , "r" (lo)
+    : "lr", "cc", "memory" );
+  return error;
+}
+
+// As Task_SleepUntil, for the number of microseconds from now. Stores the
+// deadline in *deadline, if not NULL, so that periodic tasks can continue
+// with Task_SleepUntil without drifting.
+static inline
+error_block *Task_SleepMicroseconds( uint32_t us, uint64_t *deadline )
+{
+  register uint32_t lo asm ( "r0" ) = us;
+  register uint32_t hi asm ( "r1" );
+  register uint32_t failed asm ( "r2" );
+  asm volatile ( "subs r0, r0, #0\n  svc %[swi]"
+             "\n  movvs r2, #1"
+             "\n  movvc r2, #0"
+    : "=r" (lo)
+    , "=r" (hi)
+    , "=r" (failed)
+    : [swi] "i" (OSTask_SleepMicroseconds)
+    , "r" (lo)
+    : "lr", "cc", "memory" );
+  if (failed) return (void*) lo;
+  if (deadline != 0) *deadline = (((uint64_t) hi) << 32) | lo;
+  return 0;
+}
+
 static inline
 void Task_Yield()
 {
@@ -216,13 +305,112 @@ void Task_EnablingInterrupts()
     : "lr", "cc", "memory" );
 }
 
+// Returns, for the interrupt controller module's task, the interrupt
+// sources pending on this core that are not bound to a task (see
+// Task_BindInterrupt), or 0 if the sources have not been registered.
 static inline
-void Task_WaitForInterrupt()
+uint32_t Task_WaitForInterrupt()
 {
-  asm ( "subs r0, r0, #0\n  svc %[swi]"
-    :
+  register uint32_t sources asm ( "r0" );
+
+  asm volatile ( "subs r0, r0, #0\n  svc %[swi]"
+    : "=r" (sources)
+    : [swi] "i" (OSTask_WaitForInterrupt)
+    : "lr", "cc", "memory" );
+
+  return sources;
+}
+
+// As Task_WaitForInterrupt, also setting *taken to the low word of the
+// generic timer's virtual count when the interrupt was taken.
+static inline
+uint32_t Task_WaitForInterruptTaken( uint32_t *taken )
+{
+  register uint32_t sources asm ( "r0" );
+  register uint32_t when asm ( "r1" );
+
+  asm volatile ( "subs r0, r0, #0\n  svc %[swi]"
+    : "=r" (sources)
+    , "=r" (when)
     : [swi] "i" (OSTask_WaitForInterrupt)
     : "lr", "cc", "memory" );
+
+  *taken = when;
+
+  return sources;
+}
+
+// For the interrupt controller module: the physical address of core 0's
+// interrupt source register (one bit per source, read-only), and the
+// distance in bytes to the next core's. The kernel reads the register
+// when an interrupt occurs, to wake bound tasks directly.
+// timer_source is the source the module routes each core's generic
+// physical timer interrupt to, for the kernel's per-core timers (see
+// Task_SleepUntil), or 32 if it doesn't; that source is never reported to
+// the module's tasks.
+static inline
+error_block *Task_InterruptSources( uint32_t physical, uint32_t stride,
+                                    uint32_t timer_source )
+{
+  register uint32_t p asm ( "r0" ) = physical;
+  register uint32_t s asm ( "r1" ) = stride;
+  register uint32_t t asm ( "r2" ) = timer_source;
+  register error_block *error asm ( "r0" );
+
+  asm volatile ( "subs r0, r0, #0\n  svc %[swi]"
+             "\n  movvc r0, #0"
+      : "=r" (error)
+      : [swi] "i" (OSTask_InterruptSources)
+      , "r" (p)
+      , "r" (s)
+      , "r" (t)
+      : "lr", "cc", "memory" );
+
+  return error;
+}
+
+// Binds the calling task to an interrupt source (a bit number in the
+// core's source register) on the current core. Call after
+// Task_EnablingInterrupts and before enabling the interrupt. Then each
+// Task_WaitForInterrupt returns as soon as the source is pending, resumed
+// by the kernel's interrupt handler rather than by the interrupt
+// controller module's task. The task must clear the interrupt at source
+// before waiting again, stay on this core, and call Task_UnbindInterrupt
+// before it ends.
+static inline
+error_block *Task_BindInterrupt( uint32_t source )
+{
+  register uint32_t s asm ( "r0" ) = source;
+  register uint32_t bind asm ( "r1" ) = 1;
+  register error_block *error asm ( "r0" );
+
+  asm volatile ( "subs r0, r0, #0\n  svc %[swi]"
+             "\n  movvc r0, #0"
+      : "=r" (error)
+      : [swi] "i" (OSTask_BindInterrupt)
+      , "r" (s)
+      , "r" (bind)
+      : "lr", "cc", "memory" );
+
+  return error;
+}
+
+static inline
+error_block *Task_UnbindInterrupt( uint32_t source )
+{
+  register uint32_t s asm ( "r0" ) = source;
+  register uint32_t bind asm ( "r1" ) = 0;
+  register error_block *error asm ( "r0" );
+
+  asm volatile ( "subs r0, r0, #0\n  svc %[swi]"
+             "\n  movvc r0, #0"
+      : "=r" (error)
+      : [swi] "i" (OSTask_BindInterrupt)
+      , "r" (s)
+      , "r" (bind)
+      : "lr", "cc", "memory" );
+
+  return error;
 }
 
 static inline
@@ -294,6 +482,31 @@ void Task_LogString( char const *string, uint32_t length )
     : "lr", "cc", "memory" );
 }
 
+// As Task_LogString, but waits for space in the log pipe rather than
+// dropping the string. For tasks with a lot to log, not for the kernel.
+static inline
+void Task_LogStringWait( char const *string, uint32_t length )
+{
+#ifdef DEBUG__QUIET
+  return;
+#endif
+  uint32_t written;
+
+  do {
+    register char const *s asm ( "r0" ) = string;
+    register uint32_t l asm ( "r1" ) = length;
+    register uint32_t w asm ( "r0" );
+
+    asm volatile ( "subs r0, r0, #0\n  svc %[swi]"
+      : "=r" (w), "+r" (l)
+      : [swi] "i" (OSTask_LogStringWait)
+      , "r" (s)
+      : "r2", "lr", "cc", "memory" );
+
+    written = w;
+  } while (written == 0);
+}
+
 static inline __attribute__(( optimize( "Os" ) ))
 void Task_LogSmallNumber( uint32_t number )
 {
@@ -428,6 +641,63 @@ void Task_Space()
   Task_LogString( " ", 1 );
 }
 
+// Binary log records, an alternative to formatting text in the caller.
+// One SWI appends the address of a printf-like format string and up to
+// LOG_RECORD_MAX_ARGS word arguments to the core's log pipe; the task
+// reading the pipe does the formatting (see log_record.h).
+// The format string (and any %s argument) must still be readable when
+// the record is read, by another task, so use constant strings in the
+// kernel or a ROM module, not application memory.
+//   Task_LogF( "RectFill %d,%d %d,%d\n", left, bottom, right, top );
+// In the pipe, a record is a LOG_RECORD_MARKER byte, the number of
+// arguments (one byte), the format address and the arguments (each four
+// bytes, little-endian, unaligned). The kernel writes the whole record
+// or nothing.
+
+#define LOG_RECORD_MARKER 0
+#define LOG_RECORD_MAX_ARGS 6
+#define LOG_RECORD_HEADER 6
+
+static inline
+void Task_LogFormat( char const *format, uint32_t count,
+                     uint32_t a0, uint32_t a1, uint32_t a2,
+                     uint32_t a3, uint32_t a4, uint32_t a5 )
+{
+#ifdef DEBUG__QUIET
+  return;
+#endif
+  register char const *f asm ( "r0" ) = format;
+  register uint32_t n asm ( "r1" ) = count;
+  register uint32_t r2 asm ( "r2" ) = a0;
+  register uint32_t r3 asm ( "r3" ) = a1;
+  register uint32_t r4 asm ( "r4" ) = a2;
+  register uint32_t r5 asm ( "r5" ) = a3;
+  register uint32_t r6 asm ( "r6" ) = a4;
+  register uint32_t r7 asm ( "r7" ) = a5;
+
+  asm volatile ( "subs r0, r0, #0\n  svc %[swi]"
+    :
+    : [swi] "i" (OSTask_LogRecord)
+    , "r" (f)
+    , "r" (n)
+    , "r" (r2)
+    , "r" (r3)
+    , "r" (r4)
+    , "r" (r5)
+    , "r" (r6)
+    , "r" (r7)
+    : "lr", "cc", "memory" );
+}
+
+// Task_LogF( format, up to six uint32_t compatible arguments )
+#define LOG_RECORD_ARGS( format, n, a0, a1, a2, a3, a4, a5, ... ) \
+  Task_LogFormat( format, n, a0, a1, a2, a3, a4, a5 )
+#define LOG_RECORD_COUNT( _0, _1, _2, _3, _4, _5, _6, n, ... ) n
+#define Task_LogF( format, ... ) \
+  LOG_RECORD_ARGS( format, \
+    LOG_RECORD_COUNT( 0, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0 ), \
+    ##__VA_ARGS__, 0, 0, 0, 0, 0, 0 )
+
 typedef struct {
   error_block *error;
   void *location;
@@ -1060,6 +1330,20 @@ typedef struct {
   error_block *error;
 } queued_task;
 
+// Times are in generic timer ticks. The delay is from the SWI being
+// called to a handler being given the caller, the service time from
+// then until the handler releases the caller.
+typedef struct {
+  uint32_t ticks_per_second;
+  uint32_t handled;             // SWIs passed to a handler
+  uint32_t blocked;             // ... of which, callers that had to wait
+  uint32_t completed;           // Callers released by a handler
+  uint64_t total_delay;
+  uint64_t total_service;
+  uint32_t max_delay;
+  uint32_t max_service;
+} queue_statistics;
+
 static inline
 uint32_t Task_QueueCreate()
 {
@@ -1106,6 +1390,407 @@ queued_task Task_QueueWait( uint32_t queue_handle )
   return result;
 }
 
+// Wait for a caller of a specific SWI, from any core.
+static inline
+queued_task Task_QueueWaitSWI( uint32_t queue_handle, uint32_t swi_offset )
+{
+  queued_task result = { 0, 0 };
+
+  register uint32_t handle asm ( "r0" ) = queue_handle;
+  register uint32_t offset asm ( "r1" ) = swi_offset;
+  register uint32_t task_handle asm ( "r0" );
+  register uint32_t swi asm ( "r1" );
+  register uint32_t core asm ( "r2" );
+  register error_block *error asm ( "r3" );
+
+  asm volatile ( "subs r0, r0, #0\n  svc %[swi]"
+             "\n  movvc r3, #0"
+             "\n  movvs r3, r0"
+             "\n  movvs r0, #0"
+      : "=r" (task_handle)
+      , "=r" (swi)
+      , "=r" (core)
+      , "=r" (error)
+      : [swi] "i" (OSTask_QueueWaitSWI)
+      , "r" (handle)
+      , "r" (offset)
+      : "lr", "cc", "memory" );
+
+  result.task_handle = task_handle;
+  result.swi = swi;
+  result.core = core;
+  result.error = error;
+
+  return result;
+}
+
+// Wait for a caller of any SWI, running on a specific core.
+static inline
+queued_task Task_QueueWaitCore( uint32_t queue_handle, uint32_t on_core )
+{
+  queued_task result = { 0, 0 };
+
+  register uint32_t handle asm ( "r0" ) = queue_handle;
+  register uint32_t from asm ( "r2" ) = on_core;
+  register uint32_t task_handle asm ( "r0" );
+  register uint32_t swi asm ( "r1" );
+  register uint32_t core asm ( "r2" );
+  register error_block *error asm ( "r3" );
+
+  asm volatile ( "subs r0, r0, #0\n  svc %[swi]"
+             "\n  movvc r3, #0"
+             "\n  movvs r3, r0"
+             "\n  movvs r0, #0"
+      : "=r" (task_handle)
+      , "=r" (swi)
+      , "=r" (core)
+      , "=r" (error)
+      : [swi] "i" (OSTask_QueueWaitCore)
+      , "r" (handle)
+      , "r" (from)
+      : "lr", "cc", "memory" );
+
+  result.task_handle = task_handle;
+  result.swi = swi;
+  result.core = core;
+  result.error = error;
+
+  return result;
+}
+
+static inline
+queued_task Task_QueueWaitCoreAndSWI( uint32_t queue_handle,
+                                      uint32_t on_core,
+                                      uint32_t swi_offset )
+{
+  queued_task result = { 0, 0 };
+
+  register uint32_t handle asm ( "r0" ) = queue_handle;
+  register uint32_t offset asm ( "r1" ) = swi_offset;
+  register uint32_t from asm ( "r2" ) = on_core;
+  register uint32_t task_handle asm ( "r0" );
+  register uint32_t swi asm ( "r1" );
+  register uint32_t core asm ( "r2" );
+  register error_block *error asm ( "r3" );
+
+  asm volatile ( "subs r0, r0, #0\n  svc %[swi]"
+             "\n  movvc r3, #0"
+             "\n  movvs r3, r0"
+             "\n  movvs r0, #0"
+      : "=r" (task_handle)
+      , "=r" (swi)
+      , "=r" (core)
+      , "=r" (error)
+      : [swi] "i" (OSTask_QueueWaitCoreAndSWI)
+      , "r" (handle)
+      , "r" (offset)
+      , "r" (from)
+      : "lr", "cc", "memory" );
+
+  result.task_handle = task_handle;
+  result.swi = swi;
+  result.core = core;
+  result.error = error;
+
+  return result;
+}
+
+// CPU time accounting for one task, in generic timer ticks.
+// A core's idle time is the time its idle task has used.
+typedef struct {
+  uint32_t ticks_per_second;
+  uint32_t handle;
+  uint32_t idle_core;           // Core number + 1 for an idle task, or 0
+  uint32_t switches;            // Times the task has been resumed
+  uint64_t user;                // Running the task's own code
+  uint64_t kernel;              // Running SWIs for the task
+  uint64_t waiting;             // Runnable, waiting for a core
+} task_times;
+
+// Fills in *times for the first task at or after index (start at 0).
+// Returns the index for the next call, or 0 if there are no more tasks
+// (in which case *times is unchanged).
+static inline
+uint32_t Task_TaskTimes( uint32_t index, task_times *times )
+{
+  register uint32_t i asm ( "r0" ) = index;
+  register task_times *t asm ( "r1" ) = times;
+  register uint32_t next asm ( "r0" );
+
+  asm volatile ( "subs r0, r0, #0\n  svc %[swi]"
+      : "=r" (next)
+      : [swi] "i" (OSTask_TaskTimes)
+      , "r" (i)
+      , "r" (t)
+      : "lr", "cc", "memory" );
+
+  return next;
+}
+
+// Kernel event trace. Each core records the events enabled in the trace
+// mask in its own ring of the last OSTASK_TRACE_ENTRIES records.
+// Bit n of the mask enables event n. Nothing is recorded until a mask is
+// set; see Modules/System/KernelTrace.
+enum {
+    TraceEvent_Switch = 1       // task resumed on this core
+  , TraceEvent_SWIEntry         // a = SWI number, b = r0
+  , TraceEvent_SWIExit          // a = r0, b = V flag (error)
+  , TraceEvent_PipeBlock        // a = pipe, b = 0 waiting for data, 1 space
+  , TraceEvent_PipeWake         // task = woken task, a = pipe, b = available
+  , TraceEvent_LockBlock        // a = lock address, b = lock value
+  , TraceEvent_LockWake         // task = new owner, a = lock address
+  , TraceEvent_IRQ              // task = interrupted, a = mode, b = pc
+  , TraceEvent_MapSlot          // a = old slot, b = new slot
+};
+
+typedef struct {
+  uint32_t time;                // Low word of the generic timer count
+  uint32_t event;
+  uint32_t task;                // Handle
+  uint32_t a;
+  uint32_t b;
+} trace_record;
+
+// Sets the trace mask, returning the old one. If ticks_per_second is not
+// NULL, it is set to the frequency of the timer used for trace_record.time.
+static inline
+uint32_t Task_TraceMask( uint32_t mask, uint32_t *ticks_per_second )
+{
+  register uint32_t reason asm ( "r0" ) = 0;
+  register uint32_t m asm ( "r1" ) = mask;
+  register uint32_t old asm ( "r0" );
+  register uint32_t frequency asm ( "r1" );
+
+  asm volatile ( "subs r0, r0, #0\n  svc %[swi]"
+      : "=r" (old)
+      , "=r" (frequency)
+      : [swi] "i" (OSTask_Trace)
+      , "r" (reason)
+      , "r" (m)
+      : "lr", "cc", "memory" );
+
+  if (ticks_per_second != 0) *ticks_per_second = frequency;
+
+  return old;
+}
+
+// Copies up to max of the given core's records, oldest first, starting
+// with record number *sequence (start at 0), into buffer.
+// Records that have already been overwritten are skipped.
+// Returns the number of records copied; *sequence is updated to the number
+// of the next record to read.
+static inline
+uint32_t Task_TraceRead( uint32_t core, uint32_t *sequence,
+                         trace_record *buffer, uint32_t max )
+{
+  register uint32_t reason asm ( "r0" ) = 1;
+  register uint32_t c asm ( "r1" ) = core;
+  register uint32_t seq asm ( "r2" ) = *sequence;
+  register trace_record *b asm ( "r3" ) = buffer;
+  register uint32_t m asm ( "r4" ) = max;
+  register uint32_t copied asm ( "r0" );
+
+  asm volatile ( "subs r0, r0, #0\n  svc %[swi]"
+      : "=r" (copied)
+      , "+r" (seq)
+      : [swi] "i" (OSTask_Trace)
+      , "r" (reason)
+      , "r" (c)
+      , "r" (b)
+      , "r" (m)
+      : "lr", "cc", "memory" );
+
+  *sequence = seq;
+
+  return copied;
+}
+
+// Copies line number `line' (start at 0) of the boot trace into buffer,
+// ending with a newline, once the boot is complete (Service_PostInit).
+// Returns the length of the line, or 0 if there are no more lines (or
+// the kernel wasn't built with DEBUG__BOOT_TRACE).
+static inline
+uint32_t Task_BootTraceLine( uint32_t line, char *buffer, uint32_t size )
+{
+  register uint32_t reason asm ( "r0" ) = 2;
+  register uint32_t l asm ( "r1" ) = line;
+  register char *b asm ( "r2" ) = buffer;
+  register uint32_t s asm ( "r3" ) = size;
+  register uint32_t length asm ( "r0" );
+
+  asm volatile ( "subs r0, r0, #0\n  svc %[swi]"
+      : "=r" (length)
+      : [swi] "i" (OSTask_Trace)
+      , "r" (reason)
+      , "r" (l)
+      , "r" (b)
+      , "r" (s)
+      : "lr", "cc", "memory" );
+
+  return length;
+}
+
+// Sampling profiler. Each core samples the interrupted code at the rate
+// set on that core, using the generic timer's virtual timer interrupt.
+// The interrupt has to be routed to the core by the interrupt controller;
+// see Modules/System/Pi/Profiler.
+// Code running with interrupts disabled (most of the kernel) is only
+// sampled once it enables them.
+typedef struct {
+  uint32_t pc;
+  uint32_t task;                // Handle
+  uint32_t mode;                // Processor mode of the interrupted code
+} profile_sample;
+
+// Starts sampling on the current core, rate times a second, or stops
+// it if rate is zero. Samples not yet read are discarded.
+static inline
+void Task_ProfileStart( uint32_t rate )
+{
+  register uint32_t reason asm ( "r0" ) = 0;
+  register uint32_t r asm ( "r1" ) = rate;
+
+  asm volatile ( "subs r0, r0, #0\n  svc %[swi]"
+      :
+      : [swi] "i" (OSTask_Profile)
+      , "r" (reason)
+      , "r" (r)
+      : "lr", "cc", "memory" );
+}
+
+// Copies up to max of the current core's samples, oldest first, into
+// buffer. Returns the number copied. If lost is not NULL, it is set to
+// the number of samples dropped because the core's buffer was full since
+// the last call.
+static inline
+uint32_t Task_ProfileRead( profile_sample *buffer, uint32_t max,
+                           uint32_t *lost )
+{
+  register uint32_t reason asm ( "r0" ) = 1;
+  register profile_sample *b asm ( "r1" ) = buffer;
+  register uint32_t m asm ( "r2" ) = max;
+  register uint32_t copied asm ( "r0" );
+  register uint32_t dropped asm ( "r1" );
+
+  asm volatile ( "subs r0, r0, #0\n  svc %[swi]"
+      : "=r" (copied)
+      , "=r" (dropped)
+      : [swi] "i" (OSTask_Profile)
+      , "r" (reason)
+      , "r" (b)
+      , "r" (m)
+      : "lr", "cc", "memory" );
+
+  if (lost != 0) *lost = dropped;
+
+  return copied;
+}
+
+// Performance counters (the PMU), counting for the calling task only:
+// the kernel saves and restores them when the task stops and resumes.
+// Up to four event counters, and the cycle counter, may be enabled.
+enum {
+    PMU_L1I_CACHE_REFILL = 0x01
+  , PMU_L1I_TLB_REFILL = 0x02
+  , PMU_L1D_CACHE_REFILL = 0x03
+  , PMU_L1D_CACHE = 0x04
+  , PMU_L1D_TLB_REFILL = 0x05
+  , PMU_INST_RETIRED = 0x08
+  , PMU_EXC_TAKEN = 0x09
+  , PMU_BR_MIS_PRED = 0x10
+  , PMU_CPU_CYCLES = 0x11
+  , PMU_BR_PRED = 0x12
+  , PMU_L2D_CACHE = 0x16
+  , PMU_L2D_CACHE_REFILL = 0x17
+};
+
+// Bits in the enable mask, as in PMCNTENSET
+#define PMU_COUNTER( n ) (1 << (n))
+#define PMU_CYCLES (1u << 31)
+
+// Allow the task to read the counters directly, see Task_CycleCount
+#define PMU_USER_READ 1
+
+typedef struct {
+  uint32_t cycles;
+  uint32_t event[4];
+} pmu_counts;
+
+// Sets the counters the calling task uses (all reset to zero), or stops
+// them if enable is zero. events[n] is the event for PMU_COUNTER( n ).
+// Returns an error if the processor doesn't have enough event counters.
+static inline
+error_block *Task_PMUConfigure( uint32_t enable, uint32_t const *events,
+                                uint32_t flags )
+{
+  register uint32_t reason asm ( "r0" ) = 0;
+  register uint32_t e asm ( "r1" ) = enable;
+  register uint32_t const *ev asm ( "r2" ) = events;
+  register uint32_t f asm ( "r3" ) = flags;
+  register error_block *error asm ( "r0" );
+
+  asm volatile ( "subs r0, r0, #0\n  svc %[swi]"
+             "\n  movvc r0, #0"
+      : "=r" (error)
+      : [swi] "i" (OSTask_PerformanceCounters)
+      , "r" (reason)
+      , "r" (e)
+      , "r" (ev)
+      , "r" (f)
+      : "lr", "cc", "memory" );
+
+  return error;
+}
+
+// The calling task's current counts (32 bits, wrapping).
+static inline
+void Task_PMURead( pmu_counts *counts )
+{
+  register uint32_t reason asm ( "r0" ) = 1;
+  register pmu_counts *c asm ( "r1" ) = counts;
+
+  asm volatile ( "subs r0, r0, #0\n  svc %[swi]"
+      :
+      : [swi] "i" (OSTask_PerformanceCounters)
+      , "r" (reason)
+      , "r" (c)
+      : "lr", "cc", "memory" );
+}
+
+// Reads the task's cycle counter without a SWI. Only for tasks that
+// configured PMU_CYCLES with PMU_USER_READ (on ARMv8 processors).
+static inline
+uint32_t Task_CycleCount()
+{
+  uint32_t cycles;
+  asm volatile ( "mrc p15, 0, %[c], c9, c13, 0" : [c] "=r" (cycles) );
+  return cycles;
+}
+
+// Copies the queue's statistics into *stats, then zeroes them if reset
+// is true.
+static inline
+error_block *Task_QueueStatistics( uint32_t queue_handle,
+                                   queue_statistics *stats,
+                                   bool reset )
+{
+  register uint32_t handle asm ( "r0" ) = queue_handle;
+  register queue_statistics *s asm ( "r1" ) = stats;
+  register uint32_t r asm ( "r2" ) = reset;
+  register error_block *error asm ( "r0" );
+
+  asm volatile ( "subs r0, r0, #0\n  svc %[swi]"
+             "\n  movvc r0, #0"
+      : "=r" (error)
+      : [swi] "i" (OSTask_QueueStatistics)
+      , "r" (handle)
+      , "r" (s)
+      , "r" (r)
+      : "lr", "cc", "memory" );
+
+  return error;
+}
+
 // This function is for information only, to allow a task that
 // owns a lock to wrap up what it's doing and release the lock
 // if it detects another task waiting.
@@ -60,6 +60,7 @@ struct OSPipe {
 };
 
 MPSAFE_DLL_TYPE( OSPipe );
+MPSAFE_STACK_TYPE( OSPipe );
 
 extern OSPipe OSPipe_free_pool[];
 
@@ -79,9 +80,7 @@ void setup_pipe_pool()
   for (int i = 0; i < 0x10000 / sizeof( OSPipe ); i++) {
     OSPipe *p = &OSPipe_free_pool[i];
     memset( p, 0, sizeof( OSPipe ) );
-    dll_new_OSPipe( p );
-    dll_attach_OSPipe( p, &shared.ostask.pipe_pool );
-    shared.ostask.pipe_pool = shared.ostask.pipe_pool->next;
+    mpsafe_push_OSPipe( &shared.ostask.pipe_pool, p );
   }
 
 }
@@ -113,7 +112,7 @@ static inline void free_pipe( OSPipe* pipe )
   if (shared.ostask.pipes == pipe) PANIC;
 
   dll_detach_OSPipe( pipe );
-  mpsafe_insert_OSPipe_at_tail( &shared.ostask.pipe_pool, pipe );
+  mpsafe_push_OSPipe( &shared.ostask.pipe_pool, pipe );
 }
 
 DECLARE_ERROR( NotATask );
@@ -134,7 +133,7 @@ OSTask *PipeCreate( svc_registers *regs )
     return Error_PipeCreationError( regs );
   }
 
-  OSPipe *pipe = mpsafe_detach_OSPipe_at_head( &shared.ostask.pipe_pool );
+  OSPipe *pipe = mpsafe_pop_OSPipe( &shared.ostask.pipe_pool );
 
   if (pipe == 0) {
     return Error_PipeCreationProblem( regs );
@@ -188,7 +187,7 @@ void create_log_pipe()
 
   if (&log_pipe_top == &log_pipe) return; // No log pipe
 
-  OSPipe *pipe = mpsafe_detach_OSPipe_at_head( &shared.ostask.pipe_pool );
+  OSPipe *pipe = mpsafe_pop_OSPipe( &shared.ostask.pipe_pool );
 
   if (pipe == 0) PANIC;
 
@@ -472,6 +471,8 @@ OSTask *PipeWaitForSpace( svc_registers *regs, OSPipe *pipe )
   else {
     pipe->sender_waiting_for = amount;
 
+    trace( TraceEvent_PipeBlock, running, pipe_handle( pipe ), 1 );
+
     // Blocked, waiting for space.
     return stop_running_task( regs );
   }
@@ -528,9 +529,12 @@ OSTask *PipeSpaceFilled( svc_registers *regs, OSPipe *pipe )
     Task_LogHex( ostask_handle( running ) );
     Task_LogNewLine();
 #endif
+    trace( TraceEvent_PipeWake, receiver,
+           pipe_handle( pipe ), receiver->regs.r[1] );
+
     // Make the receiver ready to run; this could be taken up instantly,
     // this core has no more control over this task.
-    mpsafe_insert_OSTask_at_tail( &shared.ostask.runnable, receiver );
+    make_runnable( receiver );
   }
 
   return 0;
@@ -649,6 +653,8 @@ OSTask *PipeWaitForData( svc_registers *regs, OSPipe *pipe )
   else {
     pipe->receiver_waiting_for = amount;
 
+    trace( TraceEvent_PipeBlock, running, pipe_handle( pipe ), 0 );
+
     // Blocked, waiting for data.
     return stop_running_task( regs );
   }
@@ -695,9 +701,12 @@ OSTask *PipeDataConsumed( svc_registers *regs, OSPipe *pipe )
     Task_LogHex( ostask_handle( running ) );
     Task_LogNewLine();
 #endif
+    trace( TraceEvent_PipeWake, sender,
+           pipe_handle( pipe ), sender->regs.r[1] );
+
     // Make the sender ready to run; this could be taken up instantly,
     // this core has no more control over this task.
-    mpsafe_insert_OSTask_at_tail( &shared.ostask.runnable, sender );
+    make_runnable( sender );
   }
 
   return 0;
@@ -837,3 +846,83 @@ OSTask *TaskOpLogString( svc_registers *regs )
 
   return resume;
 }
+
+// As TaskOpLogString, but if the core's log pipe is too full for the
+// string, the task blocks until the reader makes space, instead of the
+// string being dropped. Returns r0 = 1 if the string was written, r0 = 0
+// after blocking; the task may then be running on another core, with a
+// different log pipe, so the caller tries again.
+// Only one task per core can wait; others are treated as LogString.
+// Called with the pipes lock held, as PipeDataConsumed is.
+OSTask *TaskOpLogStringWait( svc_registers *regs )
+{
+  OSPipe *pipe = workspace.ostask.log_pipe;
+  uint32_t needed = regs->r[1];
+
+#ifdef DEBUG__SEQUENCE_LOG_ENTRIES
+  needed += 5;
+#endif
+
+  if (pipe == 0
+   || needed <= space_in_pipe( pipe )
+   || needed > pipe->max_block_size
+   || pipe->sender_waiting_for != 0) {
+    TaskOpLogString( regs );
+    regs->r[0] = 1;
+    return 0;
+  }
+
+  OSTask *running = workspace.ostask.running;
+
+  // The log pipe has no sender of its own; PipeDataConsumed resumes
+  // whichever task is recorded here while sender_waiting_for is set.
+  pipe->sender = running;
+  pipe->sender_waiting_for = needed;
+
+  regs->r[0] = 0;
+
+  trace( TraceEvent_PipeBlock, running, pipe_handle( pipe ), 1 );
+
+  return stop_running_task( regs );
+}
+
+// r0 -> format, r1 = number of arguments, r2-r7 = arguments
+OSTask *TaskOpLogRecord( svc_registers *regs )
+{
+  uint32_t count = regs->r[1];
+  if (count > LOG_RECORD_MAX_ARGS) count = LOG_RECORD_MAX_ARGS;
+
+  uint32_t length = LOG_RECORD_HEADER + 4 * count;
+
+  OSPipe *pipe = workspace.ostask.log_pipe;
+
+  // Never blocks, drops the whole record if there isn't room for it
+  if (pipe == 0) return 0;
+
+  uint32_t available = space_in_pipe( pipe );
+  if (available < length) return 0;
+
+  uint8_t *dest = (void*) write_location( pipe );
+
+  dest[0] = LOG_RECORD_MARKER;
+  dest[1] = count;
+  dest += 2;
+
+  // The format, then the arguments, r0, r2, r3, ...
+  for (int i = 0; i <= count; i++) {
+    uint32_t word = regs->r[i == 0 ? 0 : i + 1];
+    dest[0] = word;
+    dest[1] = word >> 8;
+    dest[2] = word >> 16;
+    dest[3] = word >> 24;
+    dest += 4;
+  }
+
+  svc_registers tmp;    // Note: don't initialise here, or memset gets called
+  tmp.r[1] = length;
+  OSTask *resume = PipeSpaceFilled( &tmp, pipe );
+
+  assert( resume == 0 );
+
+  return resume;
+}
@@ -0,0 +1,195 @@
+/* Copyright 2025 Simon Willcocks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Performance counters, virtualised per task.
+// A task that configures the PMU has its counters loaded into the
+// core's PMU when it is resumed (return_to_swi_caller), and saved and
+// stopped whenever it stops running (save_task_state, irq_handler).
+// Tasks that don't use the PMU cost one test each way.
+
+#include "ostask.h"
+
+#define PMU_EVENT_COUNTERS 4
+
+static inline uint32_t read_pmcr()
+{
+  uint32_t v;
+  asm volatile ( "mrc p15, 0, %[v], c9, c12, 0" : [v] "=r" (v) );
+  return v;
+}
+
+static inline void write_pmcr( uint32_t v )
+{
+  asm volatile ( "mcr p15, 0, %[v], c9, c12, 0" : : [v] "r" (v) );
+}
+
+static inline void enable_counters( uint32_t mask )
+{
+  asm volatile ( "mcr p15, 0, %[v], c9, c12, 1" : : [v] "r" (mask) );
+}
+
+static inline void disable_counters( uint32_t mask )
+{
+  asm volatile ( "mcr p15, 0, %[v], c9, c12, 2" : : [v] "r" (mask) );
+}
+
+static inline void select_counter( uint32_t n )
+{
+  asm volatile ( "mcr p15, 0, %[v], c9, c12, 5" : : [v] "r" (n) );
+  asm volatile ( "isb" );
+}
+
+static inline uint32_t read_cycles()
+{
+  uint32_t v;
+  asm volatile ( "mrc p15, 0, %[v], c9, c13, 0" : [v] "=r" (v) );
+  return v;
+}
+
+static inline void write_cycles( uint32_t v )
+{
+  asm volatile ( "mcr p15, 0, %[v], c9, c13, 0" : : [v] "r" (v) );
+}
+
+static inline void write_event_type( uint32_t v )
+{
+  asm volatile ( "mcr p15, 0, %[v], c9, c13, 1" : : [v] "r" (v) );
+}
+
+static inline uint32_t read_event_count()
+{
+  uint32_t v;
+  asm volatile ( "mrc p15, 0, %[v], c9, c13, 2" : [v] "=r" (v) );
+  return v;
+}
+
+static inline void write_event_count( uint32_t v )
+{
+  asm volatile ( "mcr p15, 0, %[v], c9, c13, 2" : : [v] "r" (v) );
+}
+
+// PMUSERENR: ARMv8 has separate read-only enables for the cycle counter
+// (CR) and the event counters (ER). The EN bit (ARMv7's only one) would
+// also let the task reconfigure the PMU, so it is never set.
+static inline void allow_usr_reads( bool allow )
+{
+  uint32_t v = allow ? (1 << 2) | (1 << 3) : 0;
+  asm volatile ( "mcr p15, 0, %[v], c9, c14, 0" : : [v] "r" (v) );
+}
+
+// Read the counts without stopping the counters
+static void pmu_read( OSTask *task )
+{
+  for (int i = 0; i < PMU_EVENT_COUNTERS; i++) {
+    if (0 != (task->pmu.enabled & PMU_COUNTER( i ))) {
+      select_counter( i );
+      task->pmu.counter[i] = read_event_count();
+    }
+  }
+
+  if (0 != (task->pmu.enabled & PMU_CYCLES)) {
+    task->pmu.cycles = read_cycles();
+  }
+}
+
+void pmu_save( OSTask *task )
+{
+  disable_counters( task->pmu.enabled );
+
+  pmu_read( task );
+
+  if (task->pmu.user_read) allow_usr_reads( false );
+}
+
+void pmu_load( OSTask *task )
+{
+  write_pmcr( read_pmcr() | 1 ); // Enable (all counters)
+
+  for (int i = 0; i < PMU_EVENT_COUNTERS; i++) {
+    if (0 != (task->pmu.enabled & PMU_COUNTER( i ))) {
+      select_counter( i );
+      write_event_type( task->pmu.event[i] );
+      write_event_count( task->pmu.counter[i] );
+    }
+  }
+
+  if (0 != (task->pmu.enabled & PMU_CYCLES)) {
+    write_cycles( task->pmu.cycles );
+  }
+
+  if (task->pmu.user_read) allow_usr_reads( true );
+
+  enable_counters( task->pmu.enabled );
+}
+
+DEFINE_ERROR( UnknownPMUReason, 0x888, "Unknown PerformanceCounters reason" );
+DEFINE_ERROR( NoSuchCounter, 0x888, "Performance counter not available" );
+
+// Reason 0: Configure the calling task's counters
+//   r1 = enable mask (PMU_COUNTER( n ), PMU_CYCLES), r2 -> event numbers,
+//   r3 = flags (PMU_USER_READ)
+// Reason 1: Read the calling task's counts, r1 -> pmu_counts
+OSTask *TaskOpPerformanceCounters( svc_registers *regs )
+{
+  OSTask *running = workspace.ostask.running;
+
+  switch (regs->r[0]) {
+  case 0:
+    {
+      uint32_t enable = regs->r[1];
+      uint32_t const *events = (void*) regs->r[2];
+
+      uint32_t available = (read_pmcr() >> 11) & 0x1f;
+      if (available > PMU_EVENT_COUNTERS) available = PMU_EVENT_COUNTERS;
+
+      uint32_t allowed = PMU_CYCLES | ((1 << available) - 1);
+      if (0 != (enable & ~allowed)) {
+        return Error_NoSuchCounter( regs );
+      }
+
+      pmu_task_stopped( running );
+
+      running->pmu.enabled = enable;
+      running->pmu.user_read = (0 != (regs->r[3] & PMU_USER_READ));
+      running->pmu.cycles = 0;
+      for (int i = 0; i < PMU_EVENT_COUNTERS; i++) {
+        bool used = (0 != (enable & PMU_COUNTER( i )));
+        running->pmu.event[i] = used ? events[i] : 0;
+        running->pmu.counter[i] = 0;
+      }
+
+      if (enable != 0) pmu_load( running );
+    }
+    break;
+  case 1:
+    {
+      pmu_counts *counts = (void*) regs->r[1];
+
+      if (running->pmu.enabled != 0) pmu_read( running );
+
+      pmu_counts result = {
+        .cycles = running->pmu.cycles,
+        .event = { running->pmu.counter[0], running->pmu.counter[1],
+                   running->pmu.counter[2], running->pmu.counter[3] } };
+
+      *counts = result;
+    }
+    break;
+  default:
+    return Error_UnknownPMUReason( regs );
+  }
+
+  return 0;
+}
@@ -0,0 +1,128 @@
+/* Copyright 2025 Simon Willcocks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Sampling profiler
+// Each core that is sampling runs the generic timer's virtual timer
+// (the physical one may be in use as a ticker). When an interrupt
+// arrives with the timer's condition met, the interrupted pc, mode and
+// task are recorded in the core's workspace and the timer restarted,
+// which also clears the interrupt before the core's interrupt task
+// looks for its source.
+// The samples are read by a task on the same core, OSTask_Profile.
+
+#include "ostask.h"
+
+static inline void virtual_timer_start( uint32_t ticks )
+{
+  // CNTV_TVAL, then CNTV_CTL: enabled, not masked
+  asm volatile ( "mcr p15, 0, %[t], c14, c3, 0" : : [t] "r" (ticks) );
+  asm volatile ( "mcr p15, 0, %[c], c14, c3, 1" : : [c] "r" (1) );
+}
+
+static inline void virtual_timer_stop()
+{
+  asm volatile ( "mcr p15, 0, %[c], c14, c3, 1" : : [c] "r" (0) );
+}
+
+static inline bool virtual_timer_fired()
+{
+  uint32_t ctl;
+  asm volatile ( "mrc p15, 0, %[c], c14, c3, 1" : [c] "=r" (ctl) );
+  return 0 != (ctl & 4); // ISTATUS
+}
+
+void profile_interrupt( OSTask *interrupted, uint32_t mode )
+{
+  if (!virtual_timer_fired()) return;
+
+  virtual_timer_start( workspace.ostask.profile.interval );
+
+  uint32_t written = workspace.ostask.profile.written;
+
+  if (written - workspace.ostask.profile.read >= OSTASK_PROFILE_SAMPLES) {
+    workspace.ostask.profile.lost++;
+    return;
+  }
+
+  uint32_t index = written & (OSTASK_PROFILE_SAMPLES - 1);
+
+  workspace.ostask.profile.sample[index].pc = interrupted->regs.lr;
+  workspace.ostask.profile.sample[index].task = ostask_handle( interrupted );
+  workspace.ostask.profile.sample[index].mode = mode;
+
+  workspace.ostask.profile.written = written + 1;
+}
+
+DEFINE_ERROR( UnknownProfileReason, 0x888, "Unknown Profile reason" );
+
+// Reason 0: Start sampling on this core, r1 = samples per second, or 0
+//   to stop
+// Reason 1: Read this core's samples, r1 -> buffer, r2 = max samples
+//   Returns r0 = samples copied, r1 = samples lost since the last read
+OSTask *TaskOpProfile( svc_registers *regs )
+{
+  switch (regs->r[0]) {
+  case 0:
+    {
+      uint32_t rate = regs->r[1];
+
+      workspace.ostask.profile.read = 0;
+      workspace.ostask.profile.written = 0;
+      workspace.ostask.profile.lost = 0;
+
+      if (rate == 0) {
+        workspace.ostask.profile.interval = 0;
+        virtual_timer_stop();
+      }
+      else {
+        uint32_t interval = timer_frequency() / rate;
+        if (interval == 0) interval = 1;
+        workspace.ostask.profile.interval = interval;
+        virtual_timer_start( interval );
+      }
+    }
+    break;
+  case 1:
+    {
+      profile_sample *buffer = (void*) regs->r[1];
+      uint32_t max = regs->r[2];
+      uint32_t copied = 0;
+
+      uint32_t read = workspace.ostask.profile.read;
+      uint32_t written = workspace.ostask.profile.written;
+
+      while (copied < max && read != written) {
+        uint32_t index = read & (OSTASK_PROFILE_SAMPLES - 1);
+        profile_sample sample = {
+          .pc = workspace.ostask.profile.sample[index].pc,
+          .task = workspace.ostask.profile.sample[index].task,
+          .mode = workspace.ostask.profile.sample[index].mode };
+        buffer[copied++] = sample;
+        read++;
+      }
+
+      workspace.ostask.profile.read = read;
+
+      regs->r[0] = copied;
+      regs->r[1] = workspace.ostask.profile.lost;
+      workspace.ostask.profile.lost = 0;
+    }
+    break;
+  default:
+    return Error_UnknownProfileReason( regs );
+  }
+
+  return 0;
+}
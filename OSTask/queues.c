@@ -17,11 +17,19 @@
 #include "raw_memory_manager.h"
 
 typedef union OSQueue OSQueue;
+typedef struct OSQueueIndex OSQueueIndex;
 
-union __attribute__(( packed, aligned( 4 ) )) OSQueue {
+// Each queue occupies a cache line of its own, so that cores using
+// unrelated queues don't fight over the lock words.
+// The statistics are only updated with the lock held, so they share
+// the line.
+union __attribute__(( packed, aligned( 64 ) )) OSQueue {
   struct {
     OSTask *queue;
     OSTask *handlers;
+    OSQueueIndex *index;
+    uint32_t lock;
+    queue_statistics stats;
   };
   struct {
     OSQueue *next;
@@ -29,9 +37,252 @@ union __attribute__(( packed, aligned( 4 ) )) OSQueue {
   };
 };
 
+// Queues that have never had a task wait for a specific SWI or core
+// use only the queue and handlers lists above.
+// The first time a handler task waits for a specific SWI (offset into
+// the module's chunk of 64) or core, the queue gets an index, and from
+// then on callers are kept in lists by SWI offset and core, and handlers
+// in lists by what they match, so that matching a handler to a new
+// caller is O(1) (well, O(cores) at worst).
+// Callers are numbered as they arrive, and a handler waiting for more
+// than one list takes the longest waiting caller of their heads, so the
+// queue stays first come, first served (O(waiting lists)).
+struct OSQueueIndex {
+  uint32_t cores;
+  uint32_t arrivals;            // Number given to the next caller
+  OSTask **by_swi;              // [64]         Handlers waiting for a SWI
+  OSTask **by_core;             // [cores]      ... for a core
+  OSTask **by_swi_and_core;     // [64 * cores] ... for both
+  OSTask **callers;             // [64 * cores] Waiting callers
+  uint32_t *waiting;            // [2 * cores]  Bitmap of non-empty callers
+};
+
+static inline uint32_t index_size( uint32_t cores )
+{
+  return sizeof( OSQueueIndex )
+       + sizeof( OSTask * ) * (64 + cores + 2 * 64 * cores)
+       + sizeof( uint32_t ) * 2 * cores;
+}
+
+static OSQueueIndex *new_index()
+{
+  uint32_t cores = shared.ostask.number_of_cores;
+  uint32_t size = index_size( cores );
+  OSQueueIndex *index = system_heap_allocate( size );
+  if (index == 0) return 0;
+
+  memset( index, 0, size );
+
+  OSTask **lists = (void*) (index + 1);
+  index->cores = cores;
+  index->by_swi = lists;
+  index->by_core = index->by_swi + 64;
+  index->by_swi_and_core = index->by_core + cores;
+  index->callers = index->by_swi_and_core + 64 * cores;
+  index->waiting = (void*) (index->callers + 64 * cores);
+
+  return index;
+}
+
+static inline OSTask *detach_head( OSTask **list )
+{
+  OSTask *head = *list;
+
+  if (head != 0) {
+    *list = head->next;
+    if (*list == head) {
+      // Single item list
+      *list = 0;
+    }
+    else {
+      dll_detach_OSTask( head );
+    }
+  }
+
+  return head;
+}
+
+static inline void attach_at_tail( OSTask *task, OSTask **list )
+{
+  dll_attach_OSTask( task, list );
+  *list = task->next;
+}
+
+// Several handler tasks may wait on the same queue (a pool of servers).
+// A handler is run on the caller's core, so prefer one that last ran
+// on that core; its stack and data are more likely to be in the cache.
+// Otherwise, the longest waiting.
+static inline OSTask *detach_preferred( OSTask **list, uint32_t core )
+{
+  OSTask *head = *list;
+
+  if (head == 0) return 0;
+
+  OSTask *handler = head;
+  do {
+    if (handler->handler.core == core) {
+      if (handler == head) return detach_head( list );
+      dll_detach_OSTask( handler );
+      return handler;
+    }
+    handler = handler->next;
+  } while (handler != head);
+
+  return detach_head( list );
+}
+
+static inline void add_caller( OSQueueIndex *index, OSTask *caller )
+{
+  uint32_t swi = caller->swi.offset & 63;
+  uint32_t core = caller->swi.core;
+
+  caller->queue_arrival = index->arrivals++;
+
+  attach_at_tail( caller, &index->callers[swi * index->cores + core] );
+  index->waiting[core * 2 + (swi >> 5)] |= (1 << (swi & 31));
+}
+
+static inline OSTask *take_caller( OSQueueIndex *index,
+                                   uint32_t swi, uint32_t core )
+{
+  OSTask **list = &index->callers[swi * index->cores + core];
+  OSTask *caller = detach_head( list );
+
+  if (*list == 0) {
+    index->waiting[core * 2 + (swi >> 5)] &= ~(1 << (swi & 31));
+  }
+
+  return caller;
+}
+
+static inline OSTask *first_caller( OSQueueIndex *index,
+                                    uint32_t swi, uint32_t core )
+{
+  return index->callers[swi * index->cores + core];
+}
+
+// True if caller a arrived before caller b
+static inline bool earlier( OSTask *a, OSTask *b )
+{
+  return (int32_t) (a->queue_arrival - b->queue_arrival) < 0;
+}
+
+// Returns the SWI offset of the longest waiting caller from the core,
+// or -1
+static int oldest_swi( OSQueueIndex *index, uint32_t core )
+{
+  int oldest = -1;
+
+  for (int w = 0; w < 2; w++) {
+    uint32_t waiting = index->waiting[core * 2 + w];
+    while (waiting != 0) {
+      int s = 32 * w + __builtin_ctz( waiting );
+      waiting &= waiting - 1;
+      if (oldest < 0
+       || earlier( first_caller( index, s, core ),
+                   first_caller( index, oldest, core ) ))
+        oldest = s;
+    }
+  }
+
+  return oldest;
+}
+
+static OSTask *find_caller( OSQueueIndex *index,
+                            bool match_swi, uint32_t swi,
+                            bool match_core, uint32_t core )
+{
+  if (match_swi && match_core) {
+    return take_caller( index, swi, core );
+  }
+
+  if (match_swi) {
+    int oldest = -1;
+    for (int c = 0; c < index->cores; c++) {
+      OSTask *caller = first_caller( index, swi, c );
+      if (caller != 0
+       && (oldest < 0 || earlier( caller, first_caller( index, swi, oldest ) )))
+        oldest = c;
+    }
+    if (oldest < 0) return 0;
+    return take_caller( index, swi, oldest );
+  }
+
+  if (match_core) {
+    int s = oldest_swi( index, core );
+    if (s < 0) return 0;
+    return take_caller( index, s, core );
+  }
+
+  int oldest_core = -1;
+  int oldest = -1;
+  for (int c = 0; c < index->cores; c++) {
+    int s = oldest_swi( index, c );
+    if (s >= 0
+     && (oldest < 0 || earlier( first_caller( index, s, c ),
+                                first_caller( index, oldest, oldest_core ) ))) {
+      oldest = s;
+      oldest_core = c;
+    }
+  }
+  if (oldest < 0) return 0;
+  return take_caller( index, oldest, oldest_core );
+}
+
+static OSTask **handler_list( OSQueue *queue,
+                              bool match_swi, uint32_t swi,
+                              bool match_core, uint32_t core )
+{
+  OSQueueIndex *index = queue->index;
+
+  if (match_swi && match_core)
+    return &index->by_swi_and_core[swi * index->cores + core];
+  if (match_swi)
+    return &index->by_swi[swi];
+  if (match_core)
+    return &index->by_core[core];
+  return &queue->handlers;
+}
+
+// Most specific first
+static OSTask *find_handler( OSQueue *queue, uint32_t swi, uint32_t core )
+{
+  OSQueueIndex *index = queue->index;
+  OSTask *handler = 0;
+
+  if (index != 0) {
+    swi = swi & 63;
+
+    handler = detach_head( &index->by_swi_and_core[swi * index->cores + core] );
+    if (handler == 0)
+      handler = detach_preferred( &index->by_swi[swi], core );
+    if (handler == 0)
+      handler = detach_head( &index->by_core[core] );
+  }
+
+  if (handler == 0)
+    handler = detach_preferred( &queue->handlers, core );
+
+  return handler;
+}
+
+static inline void record_delay( OSQueue *queue, OSTask *caller )
+{
+  uint32_t now = timer_count();
+  uint32_t delay = now - caller->queue_timestamp;
+
+  queue->stats.handled++;
+  queue->stats.total_delay += delay;
+  if (delay > queue->stats.max_delay) queue->stats.max_delay = delay;
+
+  // Service starts now
+  caller->queue_timestamp = now;
+}
+
 // Only queue items while in the free pool; remember to do new_OSQueue
 // before returning to the pool.
 MPSAFE_DLL_TYPE( OSQueue );
+MPSAFE_STACK_TYPE( OSQueue );
 
 DEFINE_ERROR( QueueCreationProblem, 0x888, "OSTask Queue creation problem" );
 
@@ -53,15 +304,13 @@ void setup_queue_pool()
   for (int i = 0; i < 0x10000 / sizeof( OSQueue ); i++) {
     OSQueue *q = &OSQueue_free_pool[i];
     memset( q, 0, sizeof( OSQueue ) );
-    dll_new_OSQueue( q );
-    dll_attach_OSQueue( q, &shared.ostask.queue_pool );
-    shared.ostask.queue_pool = shared.ostask.queue_pool->next;
+    mpsafe_push_OSQueue( &shared.ostask.queue_pool, q );
   }
 }
 
 uint32_t new_queue()
 {
-  OSQueue *queue = mpsafe_detach_OSQueue_at_head( &shared.ostask.queue_pool );
+  OSQueue *queue = mpsafe_pop_OSQueue( &shared.ostask.queue_pool );
 
   if (queue == 0) {
     return 0;
@@ -69,6 +318,9 @@ uint32_t new_queue()
 
   queue->handlers = 0;
   queue->queue = 0;
+  queue->index = 0;
+  queue->lock = 0;
+  memset( &queue->stats, 0, sizeof( queue->stats ) );
 
   return queue_handle( queue );
 }
@@ -92,13 +344,20 @@ OSTask *QueueCreate( svc_registers *regs )
   return 0;
 }
 
+DEFINE_ERROR( InvalidQueueFilter, 0x888, "Invalid OSTask Queue SWI or core" );
+
 OSTask *QueueWait( svc_registers *regs, OSQueue *queue,
-                   bool swi, bool core )
+                   bool match_swi, bool match_core )
 {
-  // Wait for any queued OSTask
+  // Wait for any queued OSTask, or one calling a specific SWI (offset in
+  // r1), or from a specific core (r2).
 
-  // TODO validation, scan
-  if (swi || core) PANIC;
+  uint32_t swi = match_swi ? regs->r[1] : 0;
+  uint32_t core = match_core ? regs->r[2] : 0;
+
+  if (swi >= 64 || core >= shared.ostask.number_of_cores) {
+    return Error_InvalidQueueFilter( regs );
+  }
 
   OSTask *running = workspace.ostask.running;
   OSTask *next = running->next;
@@ -106,13 +365,41 @@ OSTask *QueueWait( svc_registers *regs, OSQueue *queue,
 
   if (next == running) PANIC;
 
-  // TODO: lock per queue?
-  bool reclaimed = core_claim_lock( &shared.ostask.queues_lock,
-                                    workspace.core + 1 );
+  OSQueueIndex *index = 0;
+
+  if ((match_swi || match_core) && queue->index == 0) {
+    // Allocate before claiming the lock; it will be freed if another
+    // core gets there first.
+    index = new_index();
+    if (index == 0) return Error_QueueCreationProblem( regs );
+  }
+
+  // Each queue has its own lock; unrelated queues don't hold each
+  // other up.
+  bool reclaimed = core_claim_lock( &queue->lock, workspace.core + 1 );
 
   if (reclaimed) PANIC;
 
-  if (queue->queue == 0) {
+  if (index != 0 && queue->index == 0) {
+    // Index any callers already waiting
+    OSTask *caller;
+    while (0 != (caller = detach_head( &queue->queue ))) {
+      add_caller( index, caller );
+    }
+    queue->index = index;
+    index = 0;
+  }
+
+  OSTask *caller;
+
+  if (queue->index != 0) {
+    caller = find_caller( queue->index, match_swi, swi, match_core, core );
+  }
+  else {
+    caller = detach_head( &queue->queue );
+  }
+
+  if (caller == 0) {
 #ifdef DEBUG__FOLLOW_QUEUES
   Task_LogString( "Blocking ", 9 );
   Task_LogHex( ostask_handle( running ) );
@@ -125,37 +412,37 @@ OSTask *QueueWait( svc_registers *regs, OSQueue *queue,
     result = stop_running_task( regs );
     assert( !running->running );
 
-    dll_attach_OSTask( running, &queue->handlers );
+    running->handler.match_swi = match_swi;
+    running->handler.swi_offset = swi;
+    running->handler.match_core = match_core;
+    // Unless it's waiting for a specific core, remember where the
+    // handler last ran, see detach_preferred.
+    running->handler.core = match_core ? core : workspace.core;
+
+    attach_at_tail( running,
+                    handler_list( queue, match_swi, swi, match_core, core ) );
   }
   else {
-    // TODO scan queue for matching swi and/or core, if required
-    // For now, just return the head
-
-    OSTask *head = queue->queue;
-    queue->queue = head->next;
-    if (queue->queue == head) {
-      // Single item queue
-      queue->queue = 0;
-    }
-    else {
-      dll_detach_OSTask( head );
-    }
-    regs->r[0] = ostask_handle( head );
-    regs->r[1] = head->swi.offset;
-    regs->r[2] = head->swi.core;
+    record_delay( queue, caller );
+
+    regs->r[0] = ostask_handle( caller );
+    regs->r[1] = caller->swi.offset;
+    regs->r[2] = caller->swi.core;
 
-    if (!push_controller( head, running )) PANIC; // FIXME
+    if (!push_controller( caller, running )) PANIC; // FIXME
 #ifdef DEBUG__FOLLOW_QUEUES
   Task_LogHex( (uint32_t) running );
   Task_LogString( " found queued ", 15 );
-  Task_LogHex( (uint32_t) head );
+  Task_LogHex( (uint32_t) caller );
   Task_LogString( " on ", 4 );
   Task_LogHex( queue_handle( queue ) );
   Task_LogNewLine();
 #endif
   }
 
-  core_release_lock( &shared.ostask.queues_lock );
+  core_release_lock( &queue->lock );
+
+  if (index != 0) system_heap_free( index );
 
   return result;
 }
@@ -190,34 +477,18 @@ OSTask *queue_running_OSTask( svc_registers *regs, uint32_t queue_handle, uint32
   int op = SWI;
   int core = workspace.core;
 
-  bool reclaimed = core_claim_lock( &shared.ostask.queues_lock,
-                                    workspace.core + 1 );
+  running->queued_on = queue;
+  running->queue_timestamp = timer_count();
+
+  bool reclaimed = core_claim_lock( &queue->lock, workspace.core + 1 );
 
   if (reclaimed) PANIC;
 
-  OSTask *matched_handler = 0;
-
-  if (queue->handlers != 0) {
-    OSTask *head = queue->handlers;
-    OSTask *handler = head;
-    do {
-      if ((!handler->handler.match_swi
-         || handler->handler.swi_offset == op)
-       && (!handler->handler.match_core
-         || handler->handler.core == core)) {
-        matched_handler = handler;
-        if (queue->handlers == matched_handler)
-          queue->handlers = matched_handler->next;
-        if (queue->handlers == matched_handler)
-          queue->handlers = 0;
-        else
-          dll_detach_OSTask( matched_handler );
-      }
-      handler = handler->next;
-    } while (matched_handler == 0 && handler != head);
-  }
+  OSTask *matched_handler = find_handler( queue, op, core );
 
   if (matched_handler) {
+    record_delay( queue, running );
+
 #ifdef DEBUG__FOLLOW_QUEUES
   Task_LogString( "Handled by ", 11 );
   Task_LogHex( ostask_handle( matched_handler ) );
@@ -240,15 +511,61 @@ OSTask *queue_running_OSTask( svc_registers *regs, uint32_t queue_handle, uint32
   Task_LogString( "Blocking\n", 9 );
 #endif
     // No matching handler, block caller
+    queue->stats.blocked++;
     running->swi.offset = op;
     running->swi.core = core;
-    dll_attach_OSTask( running, &queue->queue );
+    if (queue->index != 0)
+      add_caller( queue->index, running );
+    else
+      attach_at_tail( running, &queue->queue );
   }
 
-  core_release_lock( &shared.ostask.queues_lock );
+  core_release_lock( &queue->lock );
 
   if (result == 0) PANIC;
 
   return result;
 }
 
+
+void queued_swi_completed( OSTask *caller )
+{
+  OSQueue *queue = caller->queued_on;
+  uint32_t service = (uint32_t) timer_count() - caller->queue_timestamp;
+
+  caller->queued_on = 0;
+
+  bool reclaimed = core_claim_lock( &queue->lock, workspace.core + 1 );
+
+  if (reclaimed) PANIC;
+
+  queue->stats.completed++;
+  queue->stats.total_service += service;
+  if (service > queue->stats.max_service) queue->stats.max_service = service;
+
+  core_release_lock( &queue->lock );
+}
+
+OSTask *QueueStatistics( svc_registers *regs, OSQueue *queue )
+{
+  queue_statistics *stats = (void*) regs->r[1];
+  bool reset = regs->r[2] != 0;
+
+  // Write to the caller's memory after releasing the lock, in case
+  // it's not mapped in yet.
+  queue_statistics copy;
+
+  bool reclaimed = core_claim_lock( &queue->lock, workspace.core + 1 );
+
+  if (reclaimed) PANIC;
+
+  copy = queue->stats;
+  if (reset) memset( &queue->stats, 0, sizeof( queue->stats ) );
+
+  core_release_lock( &queue->lock );
+
+  copy.ticks_per_second = timer_frequency();
+  *stats = copy;
+
+  return 0;
+}
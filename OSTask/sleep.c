@@ -80,16 +80,6 @@ OSTask *wakey_wakey( OSTask *volatile *headptr, void *p )
   return head;
 }
 
-static inline 
-void add_woken( OSTask *volatile *headptr, void *p )
-{
-  OSTask *head = *headptr;
-
-  dll_insert_OSTask_list_at_head( p, headptr );
-  // I really want it at the tail... I think.
-  if (head != 0) *headptr = head;
-}
-
 void sleeping_tasks_add( OSTask *tired )
 {
   mpsafe_manipulate_OSTask_list( &shared.ostask.sleeping, put_to_sleep, tired );
@@ -98,7 +88,16 @@ void sleeping_tasks_add( OSTask *tired )
 void sleeping_tasks_tick()
 {
   OSTask *list = mpsafe_manipulate_OSTask_list_returning_item( &shared.ostask.sleeping, wakey_wakey, 0 );
-  if (list != 0)
-    mpsafe_manipulate_OSTask_list( &shared.ostask.runnable, add_woken, list );
+  if (list != 0) {
+    // See make_runnable
+    uint32_t now = timer_count();
+    OSTask *t = list;
+    do {
+      t->times.runnable = now;
+      t = t->next;
+    } while (t != list);
+
+    mpsafe_enqueue_OSTask_list( &shared.ostask.runnable, list );
+  }
 }
 
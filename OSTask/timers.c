@@ -0,0 +1,164 @@
+/* Copyright 2025 Simon Willcocks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Per-core timers
+// OSTask_Sleep is driven by a single ticker, with millisecond resolution.
+// OSTask_SleepUntil and OSTask_SleepMicroseconds are one-shot timers on the
+// calling core, using the generic timer's physical timer (CNTP), which is
+// set for the earliest deadline in the core's list (workspace.ostask.timers,
+// in order of deadline, stored in the sleepers' r0 and r1).
+// irq_handler calls timers_expired, which releases the tasks whose deadline
+// has passed, to the runnable list, and sets the timer for the next one or
+// stops it, which also clears the interrupt. The interrupt controller module
+// routes the timer's interrupt to each core, and tells the kernel which
+// source it is (OSTask_InterruptSources), so that the controller module's
+// task isn't resumed for it.
+// The times are in ticks of the physical count, CNTPCT (OSTask_Time).
+
+#include "ostask.h"
+
+DEFINE_ERROR( TimerUnavailable, 0x888, "Per-core timer interrupt not routed" );
+
+static inline uint64_t physical_count()
+{
+  uint32_t lo, hi;
+  asm volatile ( "mrrc p15, 0, %[lo], %[hi], c14"
+                 : [lo] "=r" (lo), [hi] "=r" (hi) );
+  return (((uint64_t) hi) << 32) | lo;
+}
+
+static inline void physical_timer_set( uint64_t deadline )
+{
+  // CNTP_CVAL, then CNTP_CTL: enabled, not masked
+  asm volatile ( "mcrr p15, 2, %[lo], %[hi], c14"
+                 : : [lo] "r" ((uint32_t) deadline)
+                   , [hi] "r" ((uint32_t) (deadline >> 32)) );
+  asm volatile ( "mcr p15, 0, %[c], c14, c2, 1" : : [c] "r" (1) );
+  asm volatile ( "isb" );
+}
+
+static inline void physical_timer_stop()
+{
+  asm volatile ( "mcr p15, 0, %[c], c14, c2, 1" : : [c] "r" (0) );
+  asm volatile ( "isb" );
+}
+
+static inline uint64_t deadline( OSTask *task )
+{
+  return (((uint64_t) task->regs.r[1]) << 32) | task->regs.r[0];
+}
+
+// Avoiding 64-bit division; the frequency is a whole number of kHz
+static inline uint64_t microseconds_to_ticks( uint32_t us )
+{
+  uint32_t per_ms = timer_frequency() / 1000;
+  return (uint64_t) (us / 1000) * per_ms + ((us % 1000) * per_ms) / 1000;
+}
+
+static void add_timer( OSTask *task )
+{
+  OSTask *head = workspace.ostask.timers;
+  uint64_t when = deadline( task );
+
+  if (head == 0) {
+    workspace.ostask.timers = task;
+  }
+  else if (when < deadline( head )) {
+    dll_attach_OSTask( task, &workspace.ostask.timers );
+  }
+  else {
+    OSTask *t = head->next;
+    while (t != head && deadline( t ) <= when) t = t->next;
+    // Insert before t (which may be head, in which case this will be the
+    // last item in the list)
+    dll_attach_OSTask( task, &t );
+  }
+
+  if (workspace.ostask.timers == task) physical_timer_set( when );
+}
+
+void timers_expired()
+{
+  OSTask *head = workspace.ostask.timers;
+
+  if (head == 0) return;
+
+  uint64_t now = physical_count();
+
+  if (deadline( head ) > now) return;
+
+  OSTask *end = head;
+  while (end->next != head && deadline( end->next ) <= now) end = end->next;
+
+  dll_detach_OSTasks_until( &workspace.ostask.timers, end );
+
+  if (workspace.ostask.timers != 0)
+    physical_timer_set( deadline( workspace.ostask.timers ) );
+  else
+    physical_timer_stop();
+
+  // See make_runnable
+  uint32_t stamp = timer_count();
+  OSTask *t = head;
+  do {
+    t->times.runnable = stamp;
+    t = t->next;
+  } while (t != head);
+
+  mpsafe_enqueue_OSTask_list( &shared.ostask.runnable, head );
+}
+
+static OSTask *sleep_until( svc_registers *regs, uint64_t when )
+{
+  // The source register must be mapped for irq_handler to ignore the
+  // timer's interrupt
+  if (shared.ostask.timer_source == 0 || !interrupt_sources_mapped()) {
+    return Error_TimerUnavailable( regs );
+  }
+
+  regs->r[0] = (uint32_t) when;
+  regs->r[1] = (uint32_t) (when >> 32);
+
+  if (when <= physical_count()) return 0;
+
+  OSTask *running = workspace.ostask.running;
+  OSTask *resume = stop_running_task( regs );
+
+  add_timer( running );
+
+  return resume;
+}
+
+// Returns r0, r1 = physical count, r2 = ticks per second
+OSTask *TaskOpTime( svc_registers *regs )
+{
+  uint64_t now = physical_count();
+  regs->r[0] = (uint32_t) now;
+  regs->r[1] = (uint32_t) (now >> 32);
+  regs->r[2] = timer_frequency();
+  return 0;
+}
+
+// r0, r1 = deadline (physical count)
+OSTask *TaskOpSleepUntil( svc_registers *regs )
+{
+  return sleep_until( regs, (((uint64_t) regs->r[1]) << 32) | regs->r[0] );
+}
+
+// r0 = microseconds; returns the deadline in r0, r1
+OSTask *TaskOpSleepMicroseconds( svc_registers *regs )
+{
+  return sleep_until( regs, physical_count() + microseconds_to_ticks( regs->r[0] ) );
+}
@@ -18,6 +18,13 @@ typedef struct OSTaskSlot OSTaskSlot;
 typedef struct OSPipe OSPipe;
 typedef union OSQueue OSQueue;
 
+#include "mpsafe_dll.h"
+
+MPSC_QUEUE_TYPE( OSTask );
+
+// Samples per core, see profile.c
+#define OSTASK_PROFILE_SAMPLES 256
+
 typedef struct {
   OSTask *running;
   OSTask *idle;
@@ -26,6 +33,34 @@ typedef struct {
   OSTask *irq_task;
   OSTask *interrupted_tasks;
 
+  // Interrupt sources, see interrupts.c: this core's source register
+  // (0 until mapped), and the tasks bound to its sources.
+  uint32_t volatile *irq_sources;
+  uint32_t bound;               // Sources with a bound task
+  uint32_t bound_waiting;       // Those whose task is waiting
+  OSTask *bound_task[32];
+
+  // Tasks waiting for this core's timer, earliest deadline first, see
+  // timers.c
+  OSTask *timers;
+
+  // Low word of the generic timer count at the last CPU time accounting
+  // event on this core (see account_user_time in ostask.h).
+  uint32_t accounted;
+
+  // Sampling profiler (see profile.c); only ever accessed on this core
+  struct {
+    uint32_t interval;  // Timer ticks between samples, 0 when not sampling
+    uint32_t written;
+    uint32_t read;
+    uint32_t lost;
+    struct {
+      uint32_t pc;
+      uint32_t task;
+      uint32_t mode;
+    } sample[OSTASK_PROFILE_SAMPLES];
+  } profile;
+
   struct {
     uint32_t stack[64];
   } fiq_stack;
@@ -47,12 +82,17 @@ typedef struct {
 #endif
 } workspace_ostask;
 
+// Kernel event trace rings, see trace in ostask.h
+// The entries must be a power of two.
+#define OSTASK_TRACE_CORES 4
+#define OSTASK_TRACE_ENTRIES 256
+
 typedef struct {
   uint32_t lock;        // Used for boot and for when manipulating blocked
   uint32_t pipes_lock;
   OSPipe *pipes;
 
-  OSTask *runnable;
+  OSTask_mpsc_queue runnable;
   OSTask *sleeping;
   OSTask *blocked;      // Claiming a lock
   OSTask *moving;       // List of tasks wanting to run on a specific core
@@ -61,6 +101,7 @@ typedef struct {
 
   OSTaskSlot *first;
 
+  // Stacks, see MPSAFE_STACK_TYPE
   OSTask *task_pool;
   OSTaskSlot *slot_pool;
   OSQueue *queue_pool;
@@ -71,9 +112,42 @@ typedef struct {
 
   uint32_t number_of_cores;
 
-  uint32_t queues_lock;
+  // Physical address of core 0's interrupt source register, or 0, and
+  // the distance to the next core's (OSTask_InterruptSources)
+  uint32_t irq_sources;
+  uint32_t irq_sources_stride;
+  // The source of each core's physical timer interrupt, as a mask, or 0
+  // if it isn't routed to the cores (see timers.c)
+  uint32_t timer_source;
+
+  // Kernel event trace: bit n enables TraceEvent n (see ostaskops.h)
+  // Each core only writes to its own ring, so no lock is needed; count
+  // is the number of records ever written.
+  uint32_t trace_mask;
+  struct {
+    uint32_t count;
+    struct {
+      uint32_t time;
+      uint32_t event;
+      uint32_t task;
+      uint32_t a;
+      uint32_t b;
+    } record[OSTASK_TRACE_ENTRIES];
+  } trace[OSTASK_TRACE_CORES];
+
 #ifdef DEBUG__SEQUENCE_LOG_ENTRIES
   uint32_t log_index;
 #endif
+#ifdef DEBUG__BOOT_TRACE
+  // See boot_trace, in ostask.h
+  uint32_t boot_trace_count;
+  uint32_t boot_trace_entries;  // Recorded, once boot is complete
+  struct {
+    uint32_t time;      // Low word of CNTVCT
+    uint32_t core;
+    char const *stage;
+    char const *detail;
+  } boot_trace[256];
+#endif
 } shared_ostask;
 
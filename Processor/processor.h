@@ -63,6 +63,23 @@ static inline void wait_for_event()
 
 uint32_t number_of_cores();
 
+// The generic timer's virtual count, always readable at PL1. The
+// frequency is in CNTFRQ.
+static inline uint64_t timer_count()
+{
+  uint32_t lo, hi;
+  asm volatile ( "mrrc p15, 1, %[lo], %[hi], c14"
+                 : [lo] "=r" (lo), [hi] "=r" (hi) );
+  return (((uint64_t) hi) << 32) | lo;
+}
+
+static inline uint32_t timer_frequency()
+{
+  uint32_t hz;
+  asm ( "mrc p15, 0, %[hz], c14, c0, 0" : [hz] "=r" (hz) );
+  return hz;
+}
+
 #define PANIC do { asm ( "bkpt %[line]\n wfi" : : [line] "i" (__LINE__) ); for (;;) {} } while (true)
 
 void push_writes_out_of_cache( uint32_t va, uint32_t size );
@@ -105,6 +122,52 @@ uint32_t change_word_if_equal( uint32_t volatile *word, uint32_t from, uint32_t
   return value;
 }
 
+// Replace the word at `head' with the word `link' bytes into the structure
+// it points to, unless it is zero (an empty list).
+// Returns the original content of head.
+// Unlike a compare and swap, this will fail and retry if the head has been
+// written to at all since it was read, even if it has been changed back to
+// the same value (the ABA problem), so it is safe for stacks of items
+// that are popped and pushed by several cores.
+// The ARM ARM leaves it IMPLEMENTATION DEFINED whether an ordinary load
+// between the ldrex and strex clears the local monitor, on the Cortex-A7
+// (Pi 2) as much as on the Cortex-A53 (Pi 3), and recommends avoiding
+// them. Here, the load of the link word can't be moved out: it has to be
+// the link of the item the ldrex read. If the load does clear the monitor
+// (or evicts its cache line), the strex fails and the loop tries again,
+// so the pop is still ABA safe; it could only stop making progress if
+// every attempt's load cleared the monitor, which neither core is known
+// to do.
+static inline
+uint32_t detach_first_linked_word( uint32_t volatile *head, uint32_t link )
+{
+  uint32_t failed = true;
+  uint32_t value;
+
+  do {
+    asm volatile ( "ldrex %[value], [%[head]]"
+                   : [value] "=&r" (value)
+                   : [head] "r" (head) );
+
+    if (value != 0) {
+      uint32_t next = *(uint32_t volatile *) (value + link);
+
+      asm volatile ( "strex %[failed], %[next], [%[head]]"
+                     : [failed] "=&r" (failed)
+                     , [head] "+r" (head)
+                     : [next] "r" (next) );
+
+      if (!failed) ensure_changes_observable();
+    }
+    else {
+      asm ( "clrex" );
+      break;
+    }
+  } while (failed);
+
+  return value;
+}
+
 // core_claim_lock returns true if this core already owns the lock.
 // It is assumed that the lock is unlocked iff it contains zero.
 
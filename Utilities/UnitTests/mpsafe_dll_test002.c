@@ -14,6 +14,16 @@
  *
  */
 
+// Host test, using pthreads as cores and C11 atomics in place of the
+// ldrex/strex primitives.
+// gcc -m32 -O2 -pthread -I ../.. -I .. mpsafe_dll_test002.c
+// -m32 to make pointers 32-bit, you need to install multilib, iirc
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+
 #include "CK_types.h"
 #include "mpsafe_dll.h"
 
@@ -26,16 +36,95 @@ int strcmp(const char *s1, const char *s2)
   return result;
 }
 
+// An emulation of the exclusive monitor, per word (well, per hash of its
+// address). Every write made through change_word_if_equal or
+// detach_first_linked_word counts as a write to the word, and the
+// "strex" in detach_first_linked_word only succeeds if there have been
+// no writes since its "ldrex". So, as on the real thing, a pop fails if
+// another core has pushed or popped the same stack in between, even if
+// the head has been changed back to the value it read (the ABA problem).
+// The writes are counted under a spin lock for the hash, which only
+// makes each change and its count atomic; the pops still read the link
+// word without holding anything.
+#define MONITORS 64
+
+static struct {
+  atomic_flag lock;
+  uint32_t writes;
+} monitor[MONITORS];
+
+_Atomic uint32_t aba_failures = 0; // strex failed, head had the same value
+
+static inline uint32_t monitor_index( uint32_t *word )
+{
+  return (((uint32_t) word) >> 2) % MONITORS;
+}
+
+static inline void monitor_lock( uint32_t m )
+{
+  while (atomic_flag_test_and_set_explicit( &monitor[m].lock, memory_order_acquire )) {
+  }
+}
+
+static inline void monitor_unlock( uint32_t m )
+{
+  atomic_flag_clear_explicit( &monitor[m].lock, memory_order_release );
+}
+
 uint32_t change_word_if_equal( uint32_t *lock, uint32_t cmp, uint32_t val )
 {
-  uint32_t old = *lock;
-  if (old == cmp) *lock = val;
-  return old;
+  uint32_t m = monitor_index( lock );
+
+  monitor_lock( m );
+
+  // On failure, cmp is updated to the current value
+  if (atomic_compare_exchange_strong( (_Atomic uint32_t *) lock, &cmp, val ))
+    monitor[m].writes++;
+
+  monitor_unlock( m );
+
+  return cmp;
+}
+
+uint32_t detach_first_linked_word( uint32_t *head, uint32_t link )
+{
+  _Atomic uint32_t *word = (_Atomic uint32_t *) head;
+  uint32_t m = monitor_index( head );
+
+  for (;;) {
+    // ldrex
+    monitor_lock( m );
+    uint32_t value = atomic_load( word );
+    uint32_t writes = monitor[m].writes;
+    monitor_unlock( m );
+
+    if (value == 0) return 0; // clrex
+
+    uint32_t next = *(uint32_t volatile *) (value + link);
+
+    // Now and then, give the other cores time to pop and push the item
+    // back (they may be threads on the same host core)
+    static _Thread_local uint32_t pops = 0;
+    if ((++pops & 15) == 0) sched_yield();
+
+    // strex
+    monitor_lock( m );
+    uint32_t expected = value;
+    bool stored = (writes == monitor[m].writes)
+               && atomic_compare_exchange_strong( word, &expected, next );
+    if (stored)
+      monitor[m].writes++;
+    else if (expected == value)
+      atomic_fetch_add( &aba_failures, 1 );
+    monitor_unlock( m );
+
+    if (stored) return value;
+  }
 }
 
-void push_writes_to_cache() {}
-void wait_for_event() {}
-void ensure_changes_observable() {}
+void push_writes_to_cache() { atomic_thread_fence( memory_order_seq_cst ); }
+void wait_for_event() { sched_yield(); }
+void ensure_changes_observable() { atomic_thread_fence( memory_order_seq_cst ); }
 void signal_event() {}
 
 
@@ -44,9 +133,15 @@ typedef struct example example;
 struct example {
   example *prev;
   example *next;
+  uint32_t producer;
+  uint32_t sequence;
+  _Atomic uint32_t owner;
 };
 
 MPSAFE_DLL_TYPE( example );
+MPSAFE_STACK_TYPE( example );
+MPSC_QUEUE_TYPE( example );
+MPSAFE_MPSC_TYPE( example );
 
 example items[8];
 
@@ -111,7 +206,7 @@ void reset()
 // Concentrating on dll_insert_..._list_at_head
 // Destination list consists of 0, 1, 2, or 3 items
 // Added list consists of 1, 2, or 3 items
-int main()
+int single_threaded_checks()
 {
   // 3 in destination list, 3 in added list
   reset();
@@ -481,3 +576,231 @@ int main()
 
   return 0;
 }
+
+// Multi-threaded stress tests and benchmarks.
+
+#define CORES 4
+#define POOL_SIZE 64
+#define ITERATIONS 200000
+#define PER_PRODUCER 100000
+
+example pool_items[POOL_SIZE];
+example queue_items[CORES][PER_PRODUCER];
+
+example *volatile pool = 0;
+example_mpsc_queue queue = { 0 };
+
+_Atomic uint32_t failures = 0;
+_Atomic uint32_t consumed = 0;
+
+static void fail( char const *why )
+{
+  printf( "FAILED: %s\n", why );
+  atomic_fetch_add( &failures, 1 );
+}
+
+static void claim( example *e, uint32_t core )
+{
+  uint32_t unowned = 0;
+  if (!atomic_compare_exchange_strong( &e->owner, &unowned, core + 1 ))
+    fail( "Item given to two cores at once" );
+}
+
+static void release( example *e, uint32_t core )
+{
+  uint32_t owned = core + 1;
+  if (!atomic_compare_exchange_strong( &e->owner, &owned, 0 ))
+    fail( "Item released by the wrong core" );
+}
+
+static uint64_t ns_now()
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void run_on_cores( int cores, void *(*code)( void * ) )
+{
+  pthread_t threads[CORES];
+  for (int i = 0; i < cores; i++)
+    pthread_create( &threads[i], 0, code, (void*) i );
+  for (int i = 0; i < cores; i++)
+    pthread_join( threads[i], 0 );
+}
+
+static void *stack_stress( void *p )
+{
+  uint32_t core = (uint32_t) p;
+  for (int i = 0; i < ITERATIONS; i++) {
+    example *e = mpsafe_pop_example( &pool );
+    if (e == 0) continue; // All in use, which is allowed
+    if (e->next != e || e->prev != e) fail( "Popped item not a list of one" );
+    claim( e, core );
+    release( e, core );
+    mpsafe_push_example( &pool, e );
+  }
+  return 0;
+}
+
+static void *locked_pool_stress( void *p )
+{
+  uint32_t core = (uint32_t) p;
+  for (int i = 0; i < ITERATIONS; i++) {
+    example *e = mpsafe_detach_example_at_head( &pool );
+    if (e == 0) continue;
+    claim( e, core );
+    release( e, core );
+    mpsafe_insert_example_at_tail( &pool, e );
+  }
+  return 0;
+}
+
+static void *producer( void *p )
+{
+  uint32_t core = (uint32_t) p;
+  for (int i = 0; i < PER_PRODUCER; i++) {
+    example *e = &queue_items[core][i];
+    e->producer = core;
+    e->sequence = i;
+    atomic_store( &e->owner, 0 );
+    mpsafe_enqueue_example( &queue, e );
+  }
+  return 0;
+}
+
+static uint32_t last_sequence[CORES];
+
+// Single consumer, checks the items from each producer arrive in order
+static void *consumer( void *p )
+{
+  for (int i = 0; i < CORES; i++) last_sequence[i] = -1;
+  uint32_t count = 0;
+  while (count < CORES * PER_PRODUCER) {
+    example *e = mpsc_dequeue_example( &queue );
+    if (e == 0) { sched_yield(); continue; }
+    if (e->sequence != last_sequence[e->producer] + 1)
+      fail( "Items from a producer out of order" );
+    last_sequence[e->producer] = e->sequence;
+    count++;
+  }
+  return 0;
+}
+
+// Producers and consumers, any thread can take any item
+static void *producer_consumer( void *p )
+{
+  uint32_t core = (uint32_t) p;
+  for (int i = 0; i < PER_PRODUCER; i++) {
+    example *e = &queue_items[core][i];
+    atomic_store( &e->owner, 0 );
+    mpsafe_enqueue_example( &queue, e );
+    e = mpsafe_dequeue_example( &queue );
+    if (e != 0) {
+      claim( e, core );
+      atomic_fetch_add( &consumed, 1 );
+    }
+  }
+  return 0;
+}
+
+static void *locked_producer_consumer( void *p )
+{
+  uint32_t core = (uint32_t) p;
+  for (int i = 0; i < PER_PRODUCER; i++) {
+    example *e = &queue_items[core][i];
+    atomic_store( &e->owner, 0 );
+    dll_new_example( e );
+    mpsafe_insert_example_at_tail( &list, e );
+    e = mpsafe_detach_example_at_head( &list );
+    if (e != 0) {
+      claim( e, core );
+      atomic_fetch_add( &consumed, 1 );
+    }
+  }
+  return 0;
+}
+
+static void fill_pool( bool stack )
+{
+  pool = 0;
+  for (int i = 0; i < POOL_SIZE; i++) {
+    example *e = &pool_items[i];
+    dll_new_example( e );
+    atomic_store( &e->owner, 0 );
+    if (stack)
+      mpsafe_push_example( &pool, e );
+    else
+      mpsafe_insert_example_at_tail( &pool, e );
+  }
+}
+
+static bool pool_intact( bool stack )
+{
+  bool seen[POOL_SIZE] = { 0 };
+  for (int i = 0; i < POOL_SIZE; i++) {
+    example *e = stack ? mpsafe_pop_example( &pool )
+                       : mpsafe_detach_example_at_head( &pool );
+    if (e == 0 || seen[e - pool_items]) return false;
+    seen[e - pool_items] = true;
+  }
+  return pool == 0;
+}
+
+static void report( char const *name, uint64_t start, uint32_t operations )
+{
+  uint64_t ns = ns_now() - start;
+  printf( "%s: %u ns per operation\n", name, (uint32_t) (ns / operations) );
+}
+
+int multi_threaded_checks()
+{
+  uint64_t start;
+
+  fill_pool( true );
+  start = ns_now();
+  run_on_cores( CORES, stack_stress );
+  report( "Lock-free pool, pop and push", start, CORES * ITERATIONS );
+  printf( "Pops failed with the top changed and changed back: %u\n",
+          atomic_load( &aba_failures ) );
+  if (aba_failures == 0) fail( "The ABA case was not exercised" );
+  if (!pool_intact( true )) fail( "Stack corrupted" );
+
+  fill_pool( false );
+  start = ns_now();
+  run_on_cores( CORES, locked_pool_stress );
+  report( "Locked list pool, detach and insert", start, CORES * ITERATIONS );
+  if (!pool_intact( false )) fail( "Locked pool corrupted" );
+
+  pthread_t single;
+  start = ns_now();
+  pthread_create( &single, 0, consumer, 0 );
+  run_on_cores( CORES, producer );
+  pthread_join( single, 0 );
+  report( "MPSC queue, enqueue", start, CORES * PER_PRODUCER );
+  if (!mpsafe_example_queue_empty( &queue )) fail( "Queue not emptied" );
+
+  atomic_store( &consumed, 0 );
+  start = ns_now();
+  run_on_cores( CORES, producer_consumer );
+  while (0 != mpsafe_dequeue_example( &queue )) atomic_fetch_add( &consumed, 1 );
+  report( "MPSC queue, shared consumer, enqueue and dequeue", start, CORES * PER_PRODUCER );
+  if (consumed != CORES * PER_PRODUCER) fail( "Items lost from queue" );
+
+  atomic_store( &consumed, 0 );
+  list = 0;
+  start = ns_now();
+  run_on_cores( CORES, locked_producer_consumer );
+  while (0 != mpsafe_detach_example_at_head( &list )) atomic_fetch_add( &consumed, 1 );
+  report( "Locked list, insert and detach", start, CORES * PER_PRODUCER );
+  if (consumed != CORES * PER_PRODUCER) fail( "Items lost from locked list" );
+
+  return failures == 0 ? 0 : 1;
+}
+
+int main()
+{
+  if (0 != single_threaded_checks()) return 1;
+
+  return multi_threaded_checks();
+}
@@ -167,3 +167,137 @@ static inline void mpsafe_insert_##T##_at_tail( T * volatile*head, T *item ) \
 { \
   mpsafe_manipulate_##T##_list( head, DO_NOT_USE_insert_tail_##T, item ); \
 }
+
+// Lock-free alternatives for the busiest lists.
+//
+// The lists above are locked by replacing the head pointer with 1, so
+// if the core holding the lock is interrupted (or the holder is a task
+// that gets descheduled), every other core wanting the list waits.
+//
+// MPSAFE_STACK_TYPE is a Treiber stack, suitable for pools of free
+// items. Items are pushed with a single change_word_if_equal, and popped
+// with detach_first_linked_word, which uses the exclusive monitor to
+// avoid the ABA problem (another core popping the item and pushing it
+// back between us reading its next pointer and updating the top).
+// The stack is linked through the next fields only, and must not be
+// mixed with the dll routines while the items are in it. Popped items
+// are returned as a list of one item.
+//
+// MPSC_QUEUE_TYPE/MPSAFE_MPSC_TYPE is a FIFO queue, linked through the
+// next and prev fields. Producers never wait; they push onto a stack
+// of incoming items. The consumer takes the whole incoming stack in one
+// go, when it runs out of outgoing items, and reverses it into an
+// ordinary circular list that only it accesses.
+//
+// mpsafe_dequeue_T allows more than one consumer, one at a time. That
+// means an interrupted consumer can only hold up other consumers, never
+// the producers.
+//
+// Both require DLL_TYPE( T ) (or MPSAFE_DLL_TYPE( T )) first.
+
+#define MPSAFE_STACK_TYPE( T ) \
+static inline void mpsafe_push_##T( T * volatile*top, T *item ) \
+{ \
+  for (;;) { \
+    T *old = *top; \
+    item->next = old; \
+    ensure_changes_observable(); \
+    if ((uint32_t) old == change_word_if_equal( (uint32_t*) top, (uint32_t) old, (uint32_t) item )) { \
+      return; \
+    } \
+  } \
+} \
+ \
+/* Returns the item at the top of the stack, or null */ \
+static inline T *mpsafe_pop_##T( T * volatile*top ) \
+{ \
+  T *item = (void*) detach_first_linked_word( (uint32_t*) top, \
+                                              offset_of( T, next ) ); \
+  if (item != 0) dll_new_##T( item ); \
+  return item; \
+}
+
+#define MPSC_QUEUE_TYPE( T ) \
+typedef struct { \
+  T *volatile incoming; /* Newest first, linked by next */ \
+  T *outgoing;          /* Circular list, oldest first */ \
+  uint32_t volatile consumer; \
+} T##_mpsc_queue;
+
+#define MPSAFE_MPSC_TYPE( T ) \
+/* Hint only; the queue may change at any time */ \
+static inline bool mpsafe_##T##_queue_empty( T##_mpsc_queue volatile *q ) \
+{ \
+  return q->incoming == 0 && q->outgoing == 0; \
+} \
+ \
+/* Adds all the items in the (circular) list, in order. */ \
+static inline void mpsafe_enqueue_##T##_list( T##_mpsc_queue volatile *q, T *list ) \
+{ \
+  /* Re-link the list, newest first, through the next fields. */ \
+  T *newest = list->prev; \
+  for (T *i = newest; i != list; i = i->prev) { \
+    i->next = i->prev; \
+  } \
+  for (;;) { \
+    T *old = q->incoming; \
+    list->next = old; \
+    ensure_changes_observable(); \
+    if ((uint32_t) old == change_word_if_equal( (uint32_t*) &q->incoming, (uint32_t) old, (uint32_t) newest )) { \
+      push_writes_to_cache(); \
+      signal_event(); return; \
+    } \
+  } \
+} \
+ \
+static inline void mpsafe_enqueue_##T( T##_mpsc_queue volatile *q, T *item ) \
+{ \
+  dll_new_##T( item ); \
+  mpsafe_enqueue_##T##_list( q, item ); \
+} \
+ \
+/* Only to be called by the single consumer of the queue */ \
+static inline T *mpsc_dequeue_##T( T##_mpsc_queue volatile *q ) \
+{ \
+  if (q->outgoing == 0) { \
+    T *taken; \
+    do { \
+      taken = q->incoming; \
+      if (taken == 0) return 0; \
+    } while ((uint32_t) taken != change_word_if_equal( (uint32_t*) &q->incoming, (uint32_t) taken, 0 )); \
+    /* Attaching each at the head, newest first, leaves the oldest */ \
+    /* at the head of the list. */ \
+    T *list = 0; \
+    while (taken != 0) { \
+      T *next = taken->next; \
+      dll_new_##T( taken ); \
+      dll_attach_##T( taken, &list ); \
+      taken = next; \
+    } \
+    q->outgoing = list; \
+  } \
+  T *h = q->outgoing; \
+  if (h->next == h) { \
+    q->outgoing = 0; \
+  } \
+  else { \
+    q->outgoing = h->next; \
+    dll_detach_##T( h ); \
+  } \
+  return h; \
+} \
+ \
+/* For queues with more than one consumer. */ \
+static inline T *mpsafe_dequeue_##T( T##_mpsc_queue volatile *q ) \
+{ \
+  while (0 != change_word_if_equal( (uint32_t*) &q->consumer, 0, 1 )) { \
+    /* Another core is consuming, try again later */ \
+    wait_for_event(); \
+  } \
+  T *result = mpsc_dequeue_##T( q ); \
+  ensure_changes_observable(); \
+  q->consumer = 0; \
+  push_writes_to_cache(); \
+  signal_event(); \
+  return result; \
+}